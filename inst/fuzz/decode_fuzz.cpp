@@ -0,0 +1,119 @@
+// Fuzz target for everything that reads bytes off the network or out of a
+// capture: the visitor and callback message parsers, the DNS-SD enumeration
+// parser, the record decoder (names, SRV/TXT/A/AAAA rdata, JSON formatting),
+// the traffic analytics' question walk and the pcap/pcapng slicer. Each input
+// is tried both as an mDNS message and as a capture file.
+//
+// With libFuzzer (clang), from the package root:
+//
+//   clang++ -std=c++11 -g -O1 -fsanitize=fuzzer,address,undefined -Isrc/core
+//     inst/fuzz/decode_fuzz.cpp src/core/bonjour-record.cpp src/core/bonjour-pcap.cpp
+//     src/core/bonjour-filter.cpp src/core/bonjour-mmap.cpp src/core/bonjour-iface.cpp
+//     src/core/bonjour-traffic.cpp -pthread -o decode_fuzz
+//   ./decode_fuzz -max_len=9000 -timeout=1 corpus/
+//
+// Any compiler can build it with -DBNJR_FUZZ_MAIN (drop "fuzzer," from the
+// sanitizers) to replay files instead, e.g. a crash libFuzzer saved or the
+// datagrams of a capture:
+//
+//   ./decode_fuzz crash-* mdns.pcapng
+//
+// Name walks are capped (MDNS_MAX_NAME_HOPS, MDNS_MAX_LABELS in mdns.h), so
+// even the costliest 9000-byte message decodes in milliseconds under the
+// sanitizers; -timeout=1 flags anything that makes a parser loop.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bonjour-pcap.h"
+#include "bonjour-visit.h"
+
+struct fuzz_sink {
+  std::string json;
+  void operator()(bnjr_record& rec) {
+    json.clear();
+    bnjr_record_to_json(rec, json);
+  }
+};
+
+static int fuzz_callback(int sock, const struct sockaddr* from, size_t addrlen,
+                         mdns_entry_type_t entry, uint16_t query_id, uint16_t rtype,
+                         uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                         size_t name_offset, size_t name_length, size_t record_offset,
+                         size_t record_length, void* user_data) {
+  bnjr_decoder* decoder = (bnjr_decoder*)user_data;
+  bnjr_record rec;
+  decoder->decode(from, addrlen, entry, rtype, rclass, ttl, data, size, name_offset,
+                  record_offset, record_length, rec);
+  return 0;
+}
+
+static void fuzz_message(const uint8_t* data, size_t size, const struct sockaddr* from,
+                         size_t addrlen) {
+
+  bnjr_decoder decoder;
+  fuzz_sink sink;
+  bnjr_record_builder<fuzz_sink> builder(decoder, sink);
+  builder.source(from, addrlen);
+
+  bnjr_visit_message(builder, data, size, 0, -1);
+  bnjr_visit_discovery(builder, data, size);
+
+  mdns_message_parse(-1, from, addrlen, data, size, fuzz_callback, &decoder, 0, -1);
+  mdns_discovery_parse(-1, from, addrlen, data, size, fuzz_callback, &decoder);
+
+  static bnjr_traffic traffic(bnjr_traffic_defaults());
+  traffic.observe(from, addrlen, data, size, 0);
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+
+  struct sockaddr_in from;
+  memset(&from, 0, sizeof(from));
+  from.sin_family = AF_INET;
+  from.sin_port = htons(MDNS_PORT);
+
+  // exact-size heap copy, so reading one byte past the message is caught
+  std::vector<uint8_t> msg(data, data + size);
+  fuzz_message(msg.data(), msg.size(), (const struct sockaddr*)&from, sizeof(from));
+
+  std::vector<bnjr_pcap_datagram> dgrams;
+  bnjr_pcap_stats stats = { 0, 0, 0 };
+  std::string err;
+  if (bnjr_pcap_datagrams(msg.data(), msg.size(), dgrams, stats, err)) {
+    for (size_t i = 0; i < dgrams.size(); ++i) {
+      fuzz_message(dgrams[i].payload, dgrams[i].length, (const struct sockaddr*)&dgrams[i].from,
+                   dgrams[i].addrlen);
+    }
+  }
+
+  return 0;
+
+}
+
+#ifdef BNJR_FUZZ_MAIN
+
+int main(int argc, char** argv) {
+
+  for (int i = 1; i < argc; ++i) {
+    FILE* f = fopen(argv[i], "rb");
+    if (!f) {
+      fprintf(stderr, "can't open %s\n", argv[i]);
+      return 1;
+    }
+    std::vector<uint8_t> buf;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + n);
+    fclose(f);
+    LLVMFuzzerTestOneInput(buf.data(), buf.size());
+  }
+
+  return 0;
+
+}
+
+#endif
@@ -6,36 +6,462 @@
 using namespace Rcpp;
 
 // int_bnjr_discover
-std::string int_bnjr_discover(int scan_time);
-RcppExport SEXP _bonjour_int_bnjr_discover(SEXP scan_timeSEXP) {
+SEXP int_bnjr_discover(int scan_time, List opts, int as);
+RcppExport SEXP _bonjour_int_bnjr_discover(SEXP scan_timeSEXP, SEXP optsSEXP, SEXP asSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< int >::type scan_time(scan_timeSEXP);
-    rcpp_result_gen = Rcpp::wrap(int_bnjr_discover(scan_time));
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_discover(scan_time, opts, as));
     return rcpp_result_gen;
 END_RCPP
 }
 // int_bnjr_query
-std::string int_bnjr_query(std::string q, int scan_time);
-RcppExport SEXP _bonjour_int_bnjr_query(SEXP qSEXP, SEXP scan_timeSEXP) {
+SEXP int_bnjr_query(CharacterVector q, int scan_time, List opts, int as);
+RcppExport SEXP _bonjour_int_bnjr_query(SEXP qSEXP, SEXP scan_timeSEXP, SEXP optsSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type q(qSEXP);
+    Rcpp::traits::input_parameter< int >::type scan_time(scan_timeSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_query(q, scan_time, opts, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_read_pcap
+SEXP int_bnjr_read_pcap(std::string path, int threads, List opts, int as);
+RcppExport SEXP _bonjour_int_bnjr_read_pcap(SEXP pathSEXP, SEXP threadsSEXP, SEXP optsSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_read_pcap(path, threads, opts, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_resolve
+List int_bnjr_resolve(CharacterVector names, IntegerVector rtypes, double timeout, List opts);
+RcppExport SEXP _bonjour_int_bnjr_resolve(SEXP namesSEXP, SEXP rtypesSEXP, SEXP timeoutSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type names(namesSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rtypes(rtypesSEXP);
+    Rcpp::traits::input_parameter< double >::type timeout(timeoutSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_resolve(names, rtypes, timeout, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_reverse
+List int_bnjr_reverse(CharacterVector addresses, double timeout, List opts);
+RcppExport SEXP _bonjour_int_bnjr_reverse(SEXP addressesSEXP, SEXP timeoutSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type addresses(addressesSEXP);
+    Rcpp::traits::input_parameter< double >::type timeout(timeoutSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_reverse(addresses, timeout, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_async_start
+SEXP int_bnjr_async_start(std::string q, int scan_time, bool discover, List opts);
+RcppExport SEXP _bonjour_int_bnjr_async_start(SEXP qSEXP, SEXP scan_timeSEXP, SEXP discoverSEXP, SEXP optsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< std::string >::type q(qSEXP);
     Rcpp::traits::input_parameter< int >::type scan_time(scan_timeSEXP);
-    rcpp_result_gen = Rcpp::wrap(int_bnjr_query(q, scan_time));
+    Rcpp::traits::input_parameter< bool >::type discover(discoverSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_async_start(q, scan_time, discover, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_async_done
+bool int_bnjr_async_done(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_async_done(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_async_done(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_async_wait
+bool int_bnjr_async_wait(SEXP handle, double timeout);
+RcppExport SEXP _bonjour_int_bnjr_async_wait(SEXP handleSEXP, SEXP timeoutSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< double >::type timeout(timeoutSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_async_wait(handle, timeout));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_async_fd
+int int_bnjr_async_fd(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_async_fd(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_async_fd(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_async_collect
+SEXP int_bnjr_async_collect(SEXP handle, int as);
+RcppExport SEXP _bonjour_int_bnjr_async_collect(SEXP handleSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_async_collect(handle, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_cache_new
+SEXP int_bnjr_cache_new(std::string path);
+RcppExport SEXP _bonjour_int_bnjr_cache_new(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_cache_new(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_cache_load
+void int_bnjr_cache_load(SEXP handle, std::string path);
+RcppExport SEXP _bonjour_int_bnjr_cache_load(SEXP handleSEXP, SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    int_bnjr_cache_load(handle, path);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_cache_save
+void int_bnjr_cache_save(SEXP handle, std::string path);
+RcppExport SEXP _bonjour_int_bnjr_cache_save(SEXP handleSEXP, SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    int_bnjr_cache_save(handle, path);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_cache_records
+SEXP int_bnjr_cache_records(SEXP handle, int as);
+RcppExport SEXP _bonjour_int_bnjr_cache_records(SEXP handleSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_cache_records(handle, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_cache_size
+int int_bnjr_cache_size(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_cache_size(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_cache_size(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_recorder_new
+SEXP int_bnjr_recorder_new(std::string path, int slots);
+RcppExport SEXP _bonjour_int_bnjr_recorder_new(SEXP pathSEXP, SEXP slotsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< int >::type slots(slotsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_recorder_new(path, slots));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_recorder_close
+void int_bnjr_recorder_close(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_recorder_close(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    int_bnjr_recorder_close(handle);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_recorder_stats
+NumericVector int_bnjr_recorder_stats(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_recorder_stats(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_recorder_stats(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_cache_changes
+List int_bnjr_cache_changes(SEXP handle, double since);
+RcppExport SEXP _bonjour_int_bnjr_cache_changes(SEXP handleSEXP, SEXP sinceSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< double >::type since(sinceSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_cache_changes(handle, since));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_arrow_move
+void int_bnjr_arrow_move(SEXP batch, SEXP schema, SEXP array);
+RcppExport SEXP _bonjour_int_bnjr_arrow_move(SEXP batchSEXP, SEXP schemaSEXP, SEXP arraySEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type batch(batchSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type schema(schemaSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type array(arraySEXP);
+    int_bnjr_arrow_move(batch, schema, array);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_responder_new
+SEXP int_bnjr_responder_new(std::string hostname, CharacterVector addresses, int family, int ttl, int threads);
+RcppExport SEXP _bonjour_int_bnjr_responder_new(SEXP hostnameSEXP, SEXP addressesSEXP, SEXP familySEXP, SEXP ttlSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type hostname(hostnameSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type addresses(addressesSEXP);
+    Rcpp::traits::input_parameter< int >::type family(familySEXP);
+    Rcpp::traits::input_parameter< int >::type ttl(ttlSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_responder_new(hostname, addresses, family, ttl, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_responder_publish
+void int_bnjr_responder_publish(SEXP handle, CharacterVector instance, std::string service, std::string hostname, IntegerVector port, CharacterVector txt, int ttl);
+RcppExport SEXP _bonjour_int_bnjr_responder_publish(SEXP handleSEXP, SEXP instanceSEXP, SEXP serviceSEXP, SEXP hostnameSEXP, SEXP portSEXP, SEXP txtSEXP, SEXP ttlSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type instance(instanceSEXP);
+    Rcpp::traits::input_parameter< std::string >::type service(serviceSEXP);
+    Rcpp::traits::input_parameter< std::string >::type hostname(hostnameSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type port(portSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type txt(txtSEXP);
+    Rcpp::traits::input_parameter< int >::type ttl(ttlSEXP);
+    int_bnjr_responder_publish(handle, instance, service, hostname, port, txt, ttl);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_responder_stop
+void int_bnjr_responder_stop(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_responder_stop(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    int_bnjr_responder_stop(handle);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_responder_stats
+NumericVector int_bnjr_responder_stats(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_responder_stats(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_responder_stats(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_mdns_send
+int int_bnjr_mdns_send(RawVector msg, List opts);
+RcppExport SEXP _bonjour_int_bnjr_mdns_send(SEXP msgSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RawVector >::type msg(msgSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_mdns_send(msg, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_daemon_new
+SEXP int_bnjr_daemon_new(std::string socket, std::string snapshot, List opts);
+RcppExport SEXP _bonjour_int_bnjr_daemon_new(SEXP socketSEXP, SEXP snapshotSEXP, SEXP optsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type socket(socketSEXP);
+    Rcpp::traits::input_parameter< std::string >::type snapshot(snapshotSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_daemon_new(socket, snapshot, opts));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_daemon_stop
+void int_bnjr_daemon_stop(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_daemon_stop(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    int_bnjr_daemon_stop(handle);
+    return R_NilValue;
+END_RCPP
+}
+// int_bnjr_daemon_stats
+NumericVector int_bnjr_daemon_stats(SEXP handle);
+RcppExport SEXP _bonjour_int_bnjr_daemon_stats(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_daemon_stats(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_daemon_request
+SEXP int_bnjr_daemon_request(std::string socket, std::string request, double timeout, int as);
+RcppExport SEXP _bonjour_int_bnjr_daemon_request(SEXP socketSEXP, SEXP requestSEXP, SEXP timeoutSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type socket(socketSEXP);
+    Rcpp::traits::input_parameter< std::string >::type request(requestSEXP);
+    Rcpp::traits::input_parameter< double >::type timeout(timeoutSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_daemon_request(socket, request, timeout, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_snapshot
+SEXP int_bnjr_snapshot(std::string path, int as);
+RcppExport SEXP _bonjour_int_bnjr_snapshot(SEXP pathSEXP, SEXP asSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< int >::type as(asSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_snapshot(path, as));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_pacing
+NumericVector int_bnjr_pacing(NumericVector limits);
+RcppExport SEXP _bonjour_int_bnjr_pacing(SEXP limitsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type limits(limitsSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_pacing(limits));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_pacing_stats
+List int_bnjr_pacing_stats(bool reset);
+RcppExport SEXP _bonjour_int_bnjr_pacing_stats(SEXP resetSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< bool >::type reset(resetSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_pacing_stats(reset));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_traffic
+List int_bnjr_traffic(int scan_time, int window, double limit, int top, List opts, std::string pcap);
+RcppExport SEXP _bonjour_int_bnjr_traffic(SEXP scan_timeSEXP, SEXP windowSEXP, SEXP limitSEXP, SEXP topSEXP, SEXP optsSEXP, SEXP pcapSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type scan_time(scan_timeSEXP);
+    Rcpp::traits::input_parameter< int >::type window(windowSEXP);
+    Rcpp::traits::input_parameter< double >::type limit(limitSEXP);
+    Rcpp::traits::input_parameter< int >::type top(topSEXP);
+    Rcpp::traits::input_parameter< List >::type opts(optsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type pcap(pcapSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_traffic(scan_time, window, limit, top, opts, pcap));
+    return rcpp_result_gen;
+END_RCPP
+}
+// int_bnjr_decode_bench
+List int_bnjr_decode_bench(std::string path, int passes);
+RcppExport SEXP _bonjour_int_bnjr_decode_bench(SEXP pathSEXP, SEXP passesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< int >::type passes(passesSEXP);
+    rcpp_result_gen = Rcpp::wrap(int_bnjr_decode_bench(path, passes));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_bonjour_int_bnjr_discover", (DL_FUNC) &_bonjour_int_bnjr_discover, 1},
-    {"_bonjour_int_bnjr_query", (DL_FUNC) &_bonjour_int_bnjr_query, 2},
+    {"_bonjour_int_bnjr_discover", (DL_FUNC) &_bonjour_int_bnjr_discover, 3},
+    {"_bonjour_int_bnjr_query", (DL_FUNC) &_bonjour_int_bnjr_query, 4},
+    {"_bonjour_int_bnjr_read_pcap", (DL_FUNC) &_bonjour_int_bnjr_read_pcap, 4},
+    {"_bonjour_int_bnjr_resolve", (DL_FUNC) &_bonjour_int_bnjr_resolve, 4},
+    {"_bonjour_int_bnjr_reverse", (DL_FUNC) &_bonjour_int_bnjr_reverse, 3},
+    {"_bonjour_int_bnjr_async_start", (DL_FUNC) &_bonjour_int_bnjr_async_start, 4},
+    {"_bonjour_int_bnjr_async_done", (DL_FUNC) &_bonjour_int_bnjr_async_done, 1},
+    {"_bonjour_int_bnjr_async_wait", (DL_FUNC) &_bonjour_int_bnjr_async_wait, 2},
+    {"_bonjour_int_bnjr_async_fd", (DL_FUNC) &_bonjour_int_bnjr_async_fd, 1},
+    {"_bonjour_int_bnjr_async_collect", (DL_FUNC) &_bonjour_int_bnjr_async_collect, 2},
+    {"_bonjour_int_bnjr_cache_new", (DL_FUNC) &_bonjour_int_bnjr_cache_new, 1},
+    {"_bonjour_int_bnjr_cache_load", (DL_FUNC) &_bonjour_int_bnjr_cache_load, 2},
+    {"_bonjour_int_bnjr_cache_save", (DL_FUNC) &_bonjour_int_bnjr_cache_save, 2},
+    {"_bonjour_int_bnjr_cache_records", (DL_FUNC) &_bonjour_int_bnjr_cache_records, 2},
+    {"_bonjour_int_bnjr_cache_size", (DL_FUNC) &_bonjour_int_bnjr_cache_size, 1},
+    {"_bonjour_int_bnjr_recorder_new", (DL_FUNC) &_bonjour_int_bnjr_recorder_new, 2},
+    {"_bonjour_int_bnjr_recorder_close", (DL_FUNC) &_bonjour_int_bnjr_recorder_close, 1},
+    {"_bonjour_int_bnjr_recorder_stats", (DL_FUNC) &_bonjour_int_bnjr_recorder_stats, 1},
+    {"_bonjour_int_bnjr_cache_changes", (DL_FUNC) &_bonjour_int_bnjr_cache_changes, 2},
+    {"_bonjour_int_bnjr_arrow_move", (DL_FUNC) &_bonjour_int_bnjr_arrow_move, 3},
+    {"_bonjour_int_bnjr_responder_new", (DL_FUNC) &_bonjour_int_bnjr_responder_new, 5},
+    {"_bonjour_int_bnjr_responder_publish", (DL_FUNC) &_bonjour_int_bnjr_responder_publish, 7},
+    {"_bonjour_int_bnjr_responder_stop", (DL_FUNC) &_bonjour_int_bnjr_responder_stop, 1},
+    {"_bonjour_int_bnjr_responder_stats", (DL_FUNC) &_bonjour_int_bnjr_responder_stats, 1},
+    {"_bonjour_int_bnjr_mdns_send", (DL_FUNC) &_bonjour_int_bnjr_mdns_send, 2},
+    {"_bonjour_int_bnjr_daemon_new", (DL_FUNC) &_bonjour_int_bnjr_daemon_new, 3},
+    {"_bonjour_int_bnjr_daemon_stop", (DL_FUNC) &_bonjour_int_bnjr_daemon_stop, 1},
+    {"_bonjour_int_bnjr_daemon_stats", (DL_FUNC) &_bonjour_int_bnjr_daemon_stats, 1},
+    {"_bonjour_int_bnjr_daemon_request", (DL_FUNC) &_bonjour_int_bnjr_daemon_request, 4},
+    {"_bonjour_int_bnjr_snapshot", (DL_FUNC) &_bonjour_int_bnjr_snapshot, 2},
+    {"_bonjour_int_bnjr_pacing", (DL_FUNC) &_bonjour_int_bnjr_pacing, 1},
+    {"_bonjour_int_bnjr_pacing_stats", (DL_FUNC) &_bonjour_int_bnjr_pacing_stats, 1},
+    {"_bonjour_int_bnjr_traffic", (DL_FUNC) &_bonjour_int_bnjr_traffic, 6},
+    {"_bonjour_int_bnjr_decode_bench", (DL_FUNC) &_bonjour_int_bnjr_decode_bench, 2},
     {NULL, NULL, 0}
 };
 
+void bnjr_frame_init(DllInfo* dll);
 RcppExport void R_init_bonjour(DllInfo *dll) {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    bnjr_frame_init(dll);
 }
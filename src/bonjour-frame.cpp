@@ -0,0 +1,500 @@
+#include "bonjour-frame.h"
+
+#include <R_ext/Altrep.h>
+
+#include <climits>
+
+#include "b64.h"
+#include "bonjour-iface.h"
+
+using namespace Rcpp;
+
+typedef enum {
+  COL_FROM = 0,
+  COL_ENTRY_TYPE,
+  COL_TYPE,
+  COL_NAME,
+  COL_SRV_NAME,
+  COL_ADDR,
+  COL_IFACE,
+  COL_NETNS
+} lazy_col;
+
+// What a lazy string column points at. index maps the column's elements to
+// records (empty = one element per record, in order) so subsets stay lazy.
+struct lazy_column {
+  bnjr_records_ref records;
+  lazy_col col;
+  std::vector<int> index;
+};
+
+static R_altrep_class_t lazy_chr_class;
+
+static void lazy_finalizer(SEXP ptr) {
+  lazy_column* c = (lazy_column*)R_ExternalPtrAddr(ptr);
+  delete c;
+  R_ClearExternalPtr(ptr);
+}
+
+static inline lazy_column* lazy_get(SEXP x) {
+  return((lazy_column*)R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+static SEXP lazy_new(lazy_column* c) {
+  SEXP ptr = PROTECT(R_MakeExternalPtr(c, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, lazy_finalizer, TRUE);
+  SEXP x = R_new_altrep(lazy_chr_class, ptr, R_NilValue);
+  UNPROTECT(1);
+  return(x);
+}
+
+static const char* entry_name(mdns_entry_type_t entry) {
+  return((entry == MDNS_ENTRYTYPE_ANSWER) ? "answer" :
+           ((entry == MDNS_ENTRYTYPE_AUTHORITY) ? "authority" : "additional"));
+}
+
+static const char* type_name(uint16_t rtype, char* buffer, size_t capacity) {
+  switch (rtype) {
+  case MDNS_RECORDTYPE_PTR: return("PTR");
+  case MDNS_RECORDTYPE_SRV: return("SRV");
+  case MDNS_RECORDTYPE_A: return("A");
+  case MDNS_RECORDTYPE_AAAA: return("AAAA");
+  case MDNS_RECORDTYPE_TXT: return("TXT");
+  default:
+    snprintf(buffer, capacity, "%u", (unsigned)rtype);
+    return(buffer);
+  }
+}
+
+SEXP bnjr_mkchar(const std::string& s) {
+  std::string escaped;
+  if (bnjr_text_escape(s.data(), s.size(), escaped)) {
+    return(Rf_mkCharLenCE(escaped.data(), (int)escaped.size(), CE_UTF8));
+  }
+  return(Rf_mkCharLenCE(s.data(), (int)s.size(), CE_UTF8));
+}
+
+// The one place a record's text turns into a CHARSXP.
+static SEXP record_string(const bnjr_record& rec, lazy_col col) {
+
+  char buffer[64];
+
+  switch (col) {
+
+  case COL_FROM: {
+    mdns_string_t s = bnjr_record_from(buffer, sizeof(buffer), rec);
+    return(Rf_mkCharLenCE(s.str, (int)s.length, CE_UTF8));
+  }
+
+  case COL_ENTRY_TYPE:
+    return(Rf_mkChar(entry_name(rec.entry)));
+
+  case COL_TYPE:
+    return(Rf_mkChar(type_name(rec.rtype, buffer, sizeof(buffer))));
+
+  case COL_NAME:
+    if (rec.rtype != MDNS_RECORDTYPE_PTR) return(NA_STRING);
+    break;
+
+  case COL_SRV_NAME:
+    if (rec.rtype != MDNS_RECORDTYPE_SRV) return(NA_STRING);
+    break;
+
+  case COL_ADDR:
+    if ((rec.rtype != MDNS_RECORDTYPE_A) && (rec.rtype != MDNS_RECORDTYPE_AAAA)) return(NA_STRING);
+    break;
+
+  case COL_IFACE:
+    if (!rec.ifindex) return(NA_STRING);
+    return(bnjr_mkchar(bnjr_interface_name(rec.netns, rec.ifindex)));
+
+  case COL_NETNS:
+    if (!rec.netns) return(NA_STRING);
+    return(bnjr_mkchar(rec.netns->name()));
+
+  }
+
+  return(bnjr_mkchar(rec.target));
+
+}
+
+static R_xlen_t lazy_length(SEXP x) {
+  SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue) return(XLENGTH(data2));
+  lazy_column* c = lazy_get(x);
+  return((R_xlen_t)(c->index.empty() ? c->records->size() : c->index.size()));
+}
+
+static SEXP lazy_elt(SEXP x, R_xlen_t i) {
+  SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue) return(STRING_ELT(data2, i));
+  lazy_column* c = lazy_get(x);
+  size_t row = c->index.empty() ? (size_t)i : (size_t)c->index[i];
+  return(record_string((*c->records)[row], c->col));
+}
+
+// Turn the whole column into a regular STRSXP (kept as data2) and drop the
+// reference to the records.
+static SEXP lazy_materialize(SEXP x) {
+
+  SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue) return(data2);
+
+  R_xlen_t n = lazy_length(x);
+  data2 = PROTECT(Rf_allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; ++i) SET_STRING_ELT(data2, i, lazy_elt(x, i));
+
+  R_set_altrep_data2(x, data2);
+
+  delete lazy_get(x);
+  R_ClearExternalPtr(R_altrep_data1(x));
+
+  UNPROTECT(1);
+
+  return(data2);
+
+}
+
+static void* lazy_dataptr(SEXP x, Rboolean writeable) {
+  return(DATAPTR(lazy_materialize(x)));
+}
+
+static const void* lazy_dataptr_or_null(SEXP x) {
+  SEXP data2 = R_altrep_data2(x);
+  return((data2 == R_NilValue) ? 0 : DATAPTR(data2));
+}
+
+static void lazy_set_elt(SEXP x, R_xlen_t i, SEXP v) {
+  SET_STRING_ELT(lazy_materialize(x), i, v);
+}
+
+static int lazy_no_na(SEXP x) {
+  if (R_altrep_data2(x) != R_NilValue) return(0);
+  lazy_col col = lazy_get(x)->col;
+  return(((col == COL_FROM) || (col == COL_ENTRY_TYPE) || (col == COL_TYPE)) ? 1 : 0);
+}
+
+// x[i] with plain in-range indices becomes another lazy column over the same
+// records; anything else (NA, out of range, negative) takes R's default path.
+static SEXP lazy_extract_subset(SEXP x, SEXP indx, SEXP call) {
+
+  if (R_altrep_data2(x) != R_NilValue) return(NULL);
+  if ((TYPEOF(indx) != INTSXP) && (TYPEOF(indx) != REALSXP)) return(NULL);
+
+  lazy_column* c = lazy_get(x);
+  R_xlen_t n = lazy_length(x);
+  R_xlen_t k = XLENGTH(indx);
+
+  std::unique_ptr<lazy_column> sub(new lazy_column);
+  sub->records = c->records;
+  sub->col = c->col;
+  sub->index.resize((size_t)k);
+
+  for (R_xlen_t j = 0; j < k; ++j) {
+    double i = (TYPEOF(indx) == INTSXP) ?
+      ((INTEGER(indx)[j] == NA_INTEGER) ? -1 : (double)INTEGER(indx)[j]) : REAL(indx)[j];
+    if (!(i >= 1) || (i > (double)n)) return(NULL);
+    R_xlen_t row = (R_xlen_t)i - 1;
+    sub->index[(size_t)j] = c->index.empty() ? (int)row : c->index[(size_t)row];
+  }
+
+  return(lazy_new(sub.release()));
+
+}
+
+// Saved workspaces and saveRDS() get plain character vectors.
+static SEXP lazy_serialized_state(SEXP x) {
+  return(lazy_materialize(x));
+}
+
+static SEXP lazy_unserialize(SEXP cls, SEXP state) {
+  return(state);
+}
+
+static Rboolean lazy_inspect(SEXP x, int pre, int deep, int pvec,
+                             void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf("bnjr lazy character (len=%d, %s)\n", (int)lazy_length(x),
+          (R_altrep_data2(x) != R_NilValue) ? "materialized" : "lazy");
+  return(TRUE);
+}
+
+// [[Rcpp::init]]
+void bnjr_frame_init(DllInfo* dll) {
+
+  lazy_chr_class = R_make_altstring_class("bnjr_lazy_chr", "bonjour", dll);
+
+  R_set_altrep_Length_method(lazy_chr_class, lazy_length);
+  R_set_altrep_Inspect_method(lazy_chr_class, lazy_inspect);
+  R_set_altrep_Serialized_state_method(lazy_chr_class, lazy_serialized_state);
+  R_set_altrep_Unserialize_method(lazy_chr_class, lazy_unserialize);
+
+  R_set_altvec_Dataptr_method(lazy_chr_class, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_chr_class, lazy_dataptr_or_null);
+  R_set_altvec_Extract_subset_method(lazy_chr_class, lazy_extract_subset);
+
+  R_set_altstring_Elt_method(lazy_chr_class, lazy_elt);
+  R_set_altstring_Set_elt_method(lazy_chr_class, lazy_set_elt);
+  R_set_altstring_No_NA_method(lazy_chr_class, lazy_no_na);
+
+}
+
+static SEXP lazy_chr(const bnjr_records_ref& records, lazy_col col) {
+  lazy_column* c = new lazy_column;
+  c->records = records;
+  c->col = col;
+  return(lazy_new(c));
+}
+
+// TXT key/value pairs as a two-column data frame (values base64 encoded,
+// since they may be binary).
+static List txt_frame(const std::vector<bnjr_txt>& txt) {
+
+  size_t n = txt.size();
+  CharacterVector key(n), value(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    if (txt[i].key.size()) {
+      key[i] = bnjr_mkchar(txt[i].key);
+    } else {
+      key[i] = NA_STRING;
+    }
+    value[i] = macaron::Base64::Encode(txt[i].value);
+  }
+
+  List df = List::create(_["key"] = key, _["value"] = value);
+  df.attr("class") = "data.frame";
+  df.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  return(df);
+
+}
+
+List bnjr_records_frame(bnjr_records_ref records) {
+
+  const std::vector<bnjr_record>& recs = *records;
+  R_xlen_t n = (R_xlen_t)recs.size();
+
+  IntegerVector rclass(n), ttl(n), length(n), rtype(n);
+  IntegerVector srv_priority(n, NA_INTEGER), srv_weight(n, NA_INTEGER), srv_port(n, NA_INTEGER);
+  NumericVector received(n, NA_REAL), latency(n, NA_REAL);
+  List info(n);
+
+  for (R_xlen_t i = 0; i < n; ++i) {
+    const bnjr_record& rec = recs[i];
+    rclass[i] = rec.rclass;
+    ttl[i] = (rec.ttl > (uint32_t)INT_MAX) ? NA_INTEGER : (int)rec.ttl;
+    length[i] = (int)rec.length;
+    rtype[i] = rec.rtype;
+    if (rec.rtype == MDNS_RECORDTYPE_SRV) {
+      srv_priority[i] = rec.srv_priority;
+      srv_weight[i] = rec.srv_weight;
+      srv_port[i] = rec.srv_port;
+    } else if (rec.rtype == MDNS_RECORDTYPE_TXT) {
+      info[i] = txt_frame(rec.txt);
+    }
+    if (rec.received_ns) {
+      received[i] = (double)rec.received_ns / 1e9;
+      if (rec.sent_ns) latency[i] = (double)(rec.received_ns - rec.sent_ns) / 1e6;
+    }
+  }
+
+  received.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+
+  List df(18);
+  CharacterVector names(18);
+  int k = 0;
+
+  names[k] = "from";         df[k++] = lazy_chr(records, COL_FROM);
+  names[k] = "entry_type";   df[k++] = lazy_chr(records, COL_ENTRY_TYPE);
+  names[k] = "type";         df[k++] = lazy_chr(records, COL_TYPE);
+  names[k] = "name";         df[k++] = lazy_chr(records, COL_NAME);
+  names[k] = "rclass";       df[k++] = rclass;
+  names[k] = "ttl";          df[k++] = ttl;
+  names[k] = "length";       df[k++] = length;
+  names[k] = "srv_name";     df[k++] = lazy_chr(records, COL_SRV_NAME);
+  names[k] = "srv_priority"; df[k++] = srv_priority;
+  names[k] = "srv_weight";   df[k++] = srv_weight;
+  names[k] = "srv_port";     df[k++] = srv_port;
+  names[k] = "addr";         df[k++] = lazy_chr(records, COL_ADDR);
+  names[k] = "info";         df[k++] = info;
+  names[k] = "rtype";        df[k++] = rtype;
+  names[k] = "interface";    df[k++] = lazy_chr(records, COL_IFACE);
+  names[k] = "received";     df[k++] = received;
+  names[k] = "latency";      df[k++] = latency;
+  names[k] = "netns";        df[k++] = lazy_chr(records, COL_NETNS);
+
+  df.attr("names") = names;
+  df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  df.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  return(df);
+
+}
+
+static CharacterVector chr(const std::vector<std::string>& v) {
+  CharacterVector out(v.size());
+  for (size_t i = 0; i < v.size(); ++i) out[i] = bnjr_mkchar(v[i]);
+  return(out);
+}
+
+static List services_frame(const std::vector<bnjr_host_service>& services) {
+
+  size_t n = services.size();
+  CharacterVector name(n), type(n), target(n);
+  IntegerVector port(n, NA_INTEGER), priority(n, NA_INTEGER), weight(n, NA_INTEGER);
+  List info(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    const bnjr_host_service& s = services[i];
+    name[i] = bnjr_mkchar(s.name);
+    if (s.type.size()) {
+      type[i] = bnjr_mkchar(s.type);
+    } else {
+      type[i] = NA_STRING;
+    }
+    if (s.target.size()) {
+      target[i] = bnjr_mkchar(s.target);
+      port[i] = s.port;
+      priority[i] = s.priority;
+      weight[i] = s.weight;
+    } else {
+      target[i] = NA_STRING;
+    }
+    info[i] = txt_frame(s.txt);
+  }
+
+  List df = List::create(_["name"] = name, _["type"] = type, _["target"] = target,
+                         _["port"] = port, _["priority"] = priority, _["weight"] = weight,
+                         _["info"] = info);
+  df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  df.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  return(df);
+
+}
+
+List bnjr_hosts_frame(const std::vector<bnjr_host>& hosts) {
+
+  R_xlen_t n = (R_xlen_t)hosts.size();
+
+  CharacterVector hostname(n), netns(n);
+  List hostnames(n), addresses(n), services(n), types(n), interfaces(n);
+  IntegerVector records(n);
+  NumericVector first_seen(n, NA_REAL), last_seen(n, NA_REAL);
+
+  for (R_xlen_t i = 0; i < n; ++i) {
+    const bnjr_host& h = hosts[i];
+    if (h.hostnames.size()) {
+      hostname[i] = bnjr_mkchar(h.hostnames[0]);
+    } else {
+      hostname[i] = NA_STRING;
+    }
+    hostnames[i] = chr(h.hostnames);
+    addresses[i] = chr(h.addresses);
+    services[i] = services_frame(h.services);
+    types[i] = chr(h.types);
+    std::vector<std::string> ifnames;
+    for (size_t f = 0; f < h.ifindexes.size(); ++f)
+      ifnames.push_back(bnjr_interface_name(h.netns, h.ifindexes[f]));
+    interfaces[i] = chr(ifnames);
+    if (h.netns) {
+      netns[i] = bnjr_mkchar(h.netns->name());
+    } else {
+      netns[i] = NA_STRING;
+    }
+    records[i] = (int)h.records;
+    if (h.first_ns) first_seen[i] = (double)h.first_ns / 1e9;
+    if (h.last_ns) last_seen[i] = (double)h.last_ns / 1e9;
+  }
+
+  first_seen.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  last_seen.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+
+  List df = List::create(_["hostname"] = hostname, _["hostnames"] = hostnames,
+                         _["addresses"] = addresses, _["services"] = services,
+                         _["types"] = types, _["interfaces"] = interfaces,
+                         _["netns"] = netns, _["records"] = records, _["first_seen"] = first_seen,
+                         _["last_seen"] = last_seen);
+  df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  df.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  return(df);
+
+}
+
+static List traffic_items_frame(const std::vector<bnjr_traffic_item>& items, const char* key,
+                                int window) {
+
+  R_xlen_t n = (R_xlen_t)items.size();
+  CharacterVector keys(n);
+  NumericVector count(n), error(n), recent(n), rate(n);
+
+  for (R_xlen_t i = 0; i < n; ++i) {
+    keys[i] = bnjr_mkchar(items[i].key);
+    count[i] = (double)items[i].count;
+    error[i] = (double)items[i].error;
+    recent[i] = (double)items[i].recent;
+    rate[i] = (double)items[i].recent * 60 / window;
+  }
+
+  List df = List::create(_[key] = keys, _["count"] = count, _["error"] = error,
+                         _["recent"] = recent, _["rate"] = rate);
+  df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  df.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  return(df);
+
+}
+
+static double posix_seconds(int64_t ns) {
+  return(ns ? (double)ns / 1e9 : NA_REAL);
+}
+
+List bnjr_traffic_frames(const bnjr_traffic_report& report, const bnjr_traffic_spec& spec) {
+
+  R_xlen_t n = (R_xlen_t)report.flagged.size();
+  CharacterVector source(n);
+  NumericVector first(n), last(n), peak(n), datagrams(n);
+
+  for (R_xlen_t i = 0; i < n; ++i) {
+    const bnjr_traffic_flag& f = report.flagged[i];
+    source[i] = f.source;
+    first[i] = posix_seconds(f.first_ns);
+    last[i] = posix_seconds(f.last_ns);
+    peak[i] = f.peak;
+    datagrams[i] = (double)f.datagrams;
+  }
+
+  first.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  last.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+
+  List flagged = List::create(_["source"] = source, _["first"] = first, _["last"] = last,
+                              _["peak"] = peak, _["datagrams"] = datagrams);
+  flagged.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  flagged.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+
+  NumericVector summary = NumericVector::create(
+    _["datagrams"] = (double)report.datagrams,
+    _["bytes"] = (double)report.bytes,
+    _["queries"] = (double)report.queries,
+    _["responses"] = (double)report.responses,
+    _["malformed"] = (double)report.malformed,
+    _["recent"] = (double)report.recent,
+    _["window"] = (double)spec.window,
+    _["limit"] = spec.limit
+  );
+
+  NumericVector span = NumericVector::create(posix_seconds(report.first_ns),
+                                             posix_seconds(report.last_ns));
+  span.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+
+  return(List::create(
+    _["summary"] = summary,
+    _["span"] = span,
+    _["sources"] = traffic_items_frame(report.top[BNJR_TRAFFIC_SOURCE], "source", spec.window),
+    _["names"] = traffic_items_frame(report.top[BNJR_TRAFFIC_NAME], "name", spec.window),
+    _["rtypes"] = traffic_items_frame(report.top[BNJR_TRAFFIC_RTYPE], "rtype", spec.window),
+    _["flagged"] = flagged
+  ));
+
+}
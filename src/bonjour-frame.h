@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Rcpp.h>
+
+#include <memory>
+#include <vector>
+
+#include "bonjour-hosts.h"
+#include "bonjour-record.h"
+#include "bonjour-traffic.h"
+
+typedef std::shared_ptr<const std::vector<bnjr_record>> bnjr_records_ref;
+
+// Build the result data frame for a set of records without formatting them.
+//
+// Numeric columns are filled in directly. The string columns (from,
+// entry_type, type, name, srv_name, addr) are ALTREP vectors that keep a
+// reference to the records and only create a CHARSXP when R asks for an
+// element. Length and subsetting work without touching the strings, and
+// a column is materialized in full only when something needs its data
+// pointer (or serializes it). Columns that are never looked at cost
+// nothing beyond the records themselves.
+Rcpp::List bnjr_records_frame(bnjr_records_ref records);
+
+// One row per host: `hostname` (the first one seen), list columns of
+// `hostnames`, `addresses`, `services` (a data frame each: name, type,
+// target, port, priority, weight and TXT `info`), `types` and `interfaces`,
+// then the number of `records` and when the first and last arrived.
+Rcpp::List bnjr_hosts_frame(const std::vector<bnjr_host>& hosts);
+
+// A traffic report as a list: `summary` (named counters), one data frame
+// per top-K table (`sources`, `names`, `rtypes`: key, count, error, recent
+// and the per-minute `rate` over the window) and `flagged` sources.
+Rcpp::List bnjr_traffic_frames(const bnjr_traffic_report& report, const bnjr_traffic_spec& spec);
+
+// Text from the network as a CHARSXP: as it came when it is valid UTF-8,
+// escaped by bnjr_text_escape() when not, so a NUL or a stray byte in a name
+// can't make R error out of an ALTREP Elt method or mislabel bytes as UTF-8.
+SEXP bnjr_mkchar(const std::string& s);
+
+// Registered from R_init_bonjour().
+void bnjr_frame_init(DllInfo* dll);
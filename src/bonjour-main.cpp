@@ -1,583 +1,935 @@
 #include <Rcpp.h>
-#include <cstdio>
-#include <fstream>
-#include <iostream>
 
 using namespace Rcpp;
 
-#include "mdns.h"
-#include "b64.h"
-
-#include <stdio.h>
-#include <errno.h>
-
-#ifdef _WIN32
-#  include <iphlpapi.h>
-#  define sleep(x) Sleep(x * 1000)
-#else
-#  include <netdb.h>
-#  include <ifaddrs.h>
-#endif
-
-static uint32_t service_address_ipv4;
-static uint8_t service_address_ipv6[16];
-
-static int has_ipv4;
-static int has_ipv6;
-
-static char addrbuffer[64];
-static char entrybuffer[256];
-static char namebuffer[256];
-//static char sendbuffer[256];
-static mdns_record_txt_t txtbuffer[128];
-
-typedef struct {
-  const char* service;
-  const char* hostname;
-  uint32_t address_ipv4;
-  uint8_t* address_ipv6;
-  int port;
-} service_record_t;
-
-static mdns_string_t
-  ipv4_address_to_string(char* buffer, size_t capacity, const struct sockaddr_in* addr,
-                         size_t addrlen) {
-    char host[NI_MAXHOST] = {0};
-    char service[NI_MAXSERV] = {0};
-    int ret = getnameinfo((const struct sockaddr*)addr, (socklen_t)addrlen, host, NI_MAXHOST,
-                          service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
-    int len = 0;
-    if (ret == 0) {
-      if (addr->sin_port != 0)
-        len = snprintf(buffer, capacity, "%s:%s", host, service);
-      else
-        len = snprintf(buffer, capacity, "%s", host);
+#include "bonjour-scan.h"
+#include "bonjour-arrow.h"
+#include "bonjour-async.h"
+#include "bonjour-bench.h"
+#include "bonjour-daemon.h"
+#include "bonjour-frame.h"
+#include "bonjour-mmap.h"
+#include "bonjour-pcap.h"
+#include "bonjour-resolve.h"
+#include "bonjour-responder.h"
+
+static void scan_check(const bnjr_scan_result& result) {
+
+  if (result.error.size()) stop(result.error);
+
+  for (size_t i = 0; i < result.warnings.size(); ++i)
+    Rf_warning("%s\n", result.warnings[i].c_str());
+
+}
+
+static List records_frame(std::vector<bnjr_record>& records) {
+  std::shared_ptr<std::vector<bnjr_record>> owned = std::make_shared<std::vector<bnjr_record>>();
+  owned->swap(records);
+  return(bnjr_records_frame(owned));
+}
+
+typedef XPtr<bnjr_arrow_batch> arrow_xptr;
+
+// What a result comes back as (result_format() on the R side).
+typedef enum {
+  RESULT_FRAME = 0,
+  RESULT_ARROW = 1,
+  RESULT_HOSTS = 2
+} result_format;
+
+// A data frame, an Arrow batch for arrow_move() to hand to nanoarrow, or the
+// per-host view of the records.
+static SEXP records_result(std::vector<bnjr_record>& records, int as) {
+  if (as == RESULT_HOSTS) {
+    bnjr_host_table hosts;
+    hosts.add(records);
+    return(bnjr_hosts_frame(hosts.hosts()));
+  }
+  if (as != RESULT_ARROW) return(records_frame(records));
+  arrow_xptr x(new bnjr_arrow_batch, true);
+  bnjr_records_to_arrow(records, &x->schema, &x->array);
+  return(x);
+}
+
+static SEXP scan_to_result(bnjr_scan_result& result, int as) {
+  scan_check(result);
+  return(records_result(result.records, as));
+}
+
+typedef std::shared_ptr<bnjr_cache> cache_ref;
+typedef XPtr<cache_ref> cache_xptr;
+
+static cache_ref cache_get(SEXP handle) {
+  cache_xptr x(handle);
+  if (!x.get()) stop("invalid cache handle");
+  return(*x);
+}
+
+typedef std::shared_ptr<bnjr_recorder> recorder_ref;
+typedef XPtr<recorder_ref> recorder_xptr;
+
+static recorder_ref recorder_get(SEXP handle) {
+  recorder_xptr x(handle);
+  if (!x.get()) stop("invalid recorder handle");
+  return(*x);
+}
+
+// Options shared by every scan entry point arrive as one named list built by
+// scan_opts() on the R side.
+static void spec_from_opts(List opts, bnjr_scan_spec& spec) {
+
+  std::string err;
+
+  if (opts.containsElementNamed("rtypes")) {
+    IntegerVector rtypes = opts["rtypes"];
+    for (R_xlen_t i = 0; i < rtypes.size(); ++i) spec.filter.add_rtype((uint16_t)rtypes[i]);
+  }
+
+  if (opts.containsElementNamed("sections")) {
+    IntegerVector sections = opts["sections"];
+    for (R_xlen_t i = 0; i < sections.size(); ++i)
+      spec.filter.add_section((mdns_entry_type_t)sections[i]);
+  }
+
+  if (opts.containsElementNamed("name")) {
+    CharacterVector names = opts["name"];
+    for (R_xlen_t i = 0; i < names.size(); ++i) {
+      if (!spec.filter.add_name(as<std::string>(names[i]), err)) stop(err);
     }
-    if (len >= (int)capacity)
-      len = (int)capacity - 1;
-    mdns_string_t str;
-    str.str = buffer;
-    str.length = len;
-    return str;
-  }
-
-static mdns_string_t
-  ipv6_address_to_string(char* buffer, size_t capacity, const struct sockaddr_in6* addr,
-                         size_t addrlen) {
-    char host[NI_MAXHOST] = {0};
-    char service[NI_MAXSERV] = {0};
-    int ret = getnameinfo((const struct sockaddr*)addr, (socklen_t)addrlen, host, NI_MAXHOST,
-                          service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
-    int len = 0;
-    if (ret == 0) {
-      if (addr->sin6_port != 0)
-        len = snprintf(buffer, capacity, "[%s]:%s", host, service);
-      else
-        len = snprintf(buffer, capacity, "%s", host);
+  }
+
+  if (opts.containsElementNamed("interfaces")) {
+    CharacterVector ifaces = opts["interfaces"];
+    for (R_xlen_t i = 0; i < ifaces.size(); ++i) {
+      if (!spec.interfaces.allow(as<std::string>(ifaces[i]), err)) stop(err);
     }
-    if (len >= (int)capacity)
-      len = (int)capacity - 1;
-    mdns_string_t str;
-    str.str = buffer;
-    str.length = len;
-    return str;
   }
 
-static mdns_string_t
-  ip_address_to_string(char* buffer, size_t capacity, const struct sockaddr* addr, size_t addrlen) {
-    if (addr->sa_family == AF_INET6)
-      return ipv6_address_to_string(buffer, capacity, (const struct sockaddr_in6*)addr, addrlen);
-    return ipv4_address_to_string(buffer, capacity, (const struct sockaddr_in*)addr, addrlen);
+  if (opts.containsElementNamed("exclude")) {
+    CharacterVector ifaces = opts["exclude"];
+    for (R_xlen_t i = 0; i < ifaces.size(); ++i) {
+      if (!spec.interfaces.deny(as<std::string>(ifaces[i]), err)) stop(err);
+    }
   }
 
+  if (opts.containsElementNamed("family")) {
+    spec.interfaces.family = (bnjr_family)as<int>(opts["family"]);
+  }
 
+  if (opts.containsElementNamed("sockets")) {
+    spec.sockets = (bnjr_socket_model)as<int>(opts["sockets"]);
+  }
 
-static int open_client_sockets(int* sockets, int max_sockets, int port) {
-  // When sending, each socket can only send to one network interface
-  // Thus we need to open one socket for each interface and address family
-  int num_sockets = 0;
+  if (opts.containsElementNamed("cache")) {
+    spec.cache = cache_get(opts["cache"]);
+  }
 
-#ifdef _WIN32
+  if (opts.containsElementNamed("recorder")) {
+    spec.recorder = recorder_get(opts["recorder"]);
+    if (!spec.recorder->is_open()) stop("recorder has been closed");
+  }
 
-  IP_ADAPTER_ADDRESSES* adapter_address = 0;
-  ULONG address_size = 8000;
-  unsigned int ret;
-  unsigned int num_retries = 4;
-  do {
-    adapter_address = malloc(address_size);
-    ret = GetAdaptersAddresses(AF_UNSPEC, GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_ANYCAST, 0,
-                               adapter_address, &address_size);
-    if (ret == ERROR_BUFFER_OVERFLOW) {
-      free(adapter_address);
-      adapter_address = 0;
-    } else {
-      break;
+  if (opts.containsElementNamed("from")) {
+    CharacterVector from = opts["from"];
+    for (R_xlen_t i = 0; i < from.size(); ++i) {
+      if (!spec.filter.add_source(as<std::string>(from[i]), err)) stop(err);
     }
-  } while (num_retries-- > 0);
+  }
+
+}
+
+// One copy of spec per network namespace in opts$netns ("" = ours), or
+// just spec when there is none.
+static std::vector<bnjr_scan_spec> netns_specs(List opts, const bnjr_scan_spec& spec) {
+
+  std::vector<bnjr_scan_spec> specs;
 
-  if (!adapter_address || (ret != NO_ERROR)) {
-    free(adapter_address);
-    printf("Failed to get network adapter addresses\n");
-    return num_sockets;
+  if (!opts.containsElementNamed("netns")) {
+    specs.push_back(spec);
+    return(specs);
   }
 
-  int first_ipv4 = 1;
-  int first_ipv6 = 1;
-  for (PIP_ADAPTER_ADDRESSES adapter = adapter_address; adapter; adapter = adapter->Next) {
-    if (adapter->TunnelType == TUNNEL_TYPE_TEREDO)
-      continue;
-    if (adapter->OperStatus != IfOperStatusUp)
-      continue;
+  CharacterVector netns = opts["netns"];
+  for (R_xlen_t i = 0; i < netns.size(); ++i) {
+    specs.push_back(spec);
+    specs.back().netns = as<std::string>(netns[i]);
+  }
 
-    for (IP_ADAPTER_UNICAST_ADDRESS* unicast = adapter->FirstUnicastAddress; unicast;
-    unicast = unicast->Next) {
-      if (unicast->Address.lpSockaddr->sa_family == AF_INET) {
-        struct sockaddr_in* saddr = (struct sockaddr_in*)unicast->Address.lpSockaddr;
-        if ((saddr->sin_addr.S_un.S_un_b.s_b1 != 127) ||
-            (saddr->sin_addr.S_un.S_un_b.s_b2 != 0) ||
-            (saddr->sin_addr.S_un.S_un_b.s_b3 != 0) ||
-            (saddr->sin_addr.S_un.S_un_b.s_b4 != 1)) {
-          int log_addr = 0;
-          if (first_ipv4) {
-            service_address_ipv4 = saddr->sin_addr.S_un.S_addr;
-            first_ipv4 = 0;
-            log_addr = 1;
-          }
-          has_ipv4 = 1;
-          if (num_sockets < max_sockets) {
-            saddr->sin_port = htons((unsigned short)port);
-            int sock = mdns_socket_open_ipv4(saddr);
-            if (sock >= 0) {
-              sockets[num_sockets++] = sock;
-              log_addr = 1;
-            } else {
-              log_addr = 0;
-            }
-          }
-          if (log_addr) {
-            char buffer[128];
-            mdns_string_t addr = ipv4_address_to_string(buffer, sizeof(buffer), saddr,
-                                                        sizeof(struct sockaddr_in));
-            // printf("Local IPv4 address: %.*s\n", MDNS_STRING_FORMAT(addr));
-          }
-        }
-      } else if (unicast->Address.lpSockaddr->sa_family == AF_INET6) {
-        struct sockaddr_in6* saddr = (struct sockaddr_in6*)unicast->Address.lpSockaddr;
-        static const unsigned char localhost[] = {0, 0, 0, 0, 0, 0, 0, 0,
-                                                  0, 0, 0, 0, 0, 0, 0, 1};
-        static const unsigned char localhost_mapped[] = {0, 0, 0,    0,    0,    0, 0, 0,
-                                                         0, 0, 0xff, 0xff, 0x7f, 0, 0, 1};
-        if ((unicast->DadState == NldsPreferred) &&
-            memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
-            memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16)) {
-          int log_addr = 0;
-          if (first_ipv6) {
-            memcpy(service_address_ipv6, &saddr->sin6_addr, 16);
-            first_ipv6 = 0;
-            log_addr = 1;
-          }
-          has_ipv6 = 1;
-          if (num_sockets < max_sockets) {
-            saddr->sin6_port = htons((unsigned short)port);
-            int sock = mdns_socket_open_ipv6(saddr);
-            if (sock >= 0) {
-              sockets[num_sockets++] = sock;
-              log_addr = 1;
-            } else {
-              log_addr = 0;
-            }
-          }
-          if (log_addr) {
-            char buffer[128];
-            mdns_string_t addr = ipv6_address_to_string(buffer, sizeof(buffer), saddr,
-                                                        sizeof(struct sockaddr_in6));
-            // printf("Local IPv6 address: %.*s\n", MDNS_STRING_FORMAT(addr));
-          }
-        }
-      }
-    }
+  return(specs);
+
+}
+
+// Run specs side by side and merge what they heard.
+static std::vector<bnjr_record> scan_merged(const std::vector<bnjr_scan_spec>& specs) {
+
+  std::vector<bnjr_scan_result> results;
+  bnjr_scan_all(specs, results);
+
+  std::vector<bnjr_record> records;
+  for (size_t i = 0; i < results.size(); ++i) {
+    scan_check(results[i]);
+    records.insert(records.end(), results[i].records.begin(), results[i].records.end());
   }
 
-  free(adapter_address);
+  return(records);
+
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_discover(int scan_time, List opts, int as) {
+
+  bnjr_scan_spec spec;
+  spec.mode = BNJR_SCAN_DISCOVER;
+  spec.scan_time = scan_time;
+  spec_from_opts(opts, spec);
 
-#else
+  // hosts are aggregated by the engine as records arrive
+  if (as == RESULT_HOSTS) spec.hosts = std::make_shared<bnjr_host_table>();
 
-  struct ifaddrs* ifaddr = 0;
-  struct ifaddrs* ifa = 0;
+  // each namespace gets its own scan, all running at once
+  std::vector<bnjr_record> records = scan_merged(netns_specs(opts, spec));
 
-  if (getifaddrs(&ifaddr) < 0)
-    printf("Unable to get interface addresses\n");
+  if (spec.hosts) return(bnjr_hosts_frame(spec.hosts->hosts()));
 
-  int first_ipv4 = 1;
-  int first_ipv6 = 1;
-  for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
-    if (!ifa->ifa_addr)
-      continue;
+  return(records_result(records, as));
 
-    if (ifa->ifa_addr->sa_family == AF_INET) {
-      struct sockaddr_in* saddr = (struct sockaddr_in*)ifa->ifa_addr;
-      if (saddr->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
-        int log_addr = 0;
-        if (first_ipv4) {
-          service_address_ipv4 = saddr->sin_addr.s_addr;
-          first_ipv4 = 0;
-          log_addr = 1;
-        }
-        has_ipv4 = 1;
-        if (num_sockets < max_sockets) {
-          saddr->sin_port = htons(port);
-          int sock = mdns_socket_open_ipv4(saddr);
-          if (sock >= 0) {
-            sockets[num_sockets++] = sock;
-            log_addr = 1;
-          } else {
-            log_addr = 0;
-          }
-        }
-        if (log_addr) {
-          char buffer[128];
-          mdns_string_t addr = ipv4_address_to_string(buffer, sizeof(buffer), saddr,
-                                                      sizeof(struct sockaddr_in));
-          // printf("Local IPv4 address: %.*s\n", MDNS_STRING_FORMAT(addr));
-        }
-      }
-    } else if (ifa->ifa_addr->sa_family == AF_INET6) {
-      struct sockaddr_in6* saddr = (struct sockaddr_in6*)ifa->ifa_addr;
-      static const unsigned char localhost[] = {0, 0, 0, 0, 0, 0, 0, 0,
-                                                0, 0, 0, 0, 0, 0, 0, 1};
-      static const unsigned char localhost_mapped[] = {0, 0, 0,    0,    0,    0, 0, 0,
-                                                       0, 0, 0xff, 0xff, 0x7f, 0, 0, 1};
-      if (memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
-          memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16)) {
-        int log_addr = 0;
-        if (first_ipv6) {
-          memcpy(service_address_ipv6, &saddr->sin6_addr, 16);
-          first_ipv6 = 0;
-          log_addr = 1;
-        }
-        has_ipv6 = 1;
-        if (num_sockets < max_sockets) {
-          saddr->sin6_port = htons(port);
-          int sock = mdns_socket_open_ipv6(saddr);
-          if (sock >= 0) {
-            sockets[num_sockets++] = sock;
-            log_addr = 1;
-          } else {
-            log_addr = 0;
-          }
-        }
-        if (log_addr) {
-          char buffer[128];
-          mdns_string_t addr = ipv6_address_to_string(buffer, sizeof(buffer), saddr,
-                                                      sizeof(struct sockaddr_in6));
-          // printf("Local IPv6 address: %.*s\n", MDNS_STRING_FORMAT(addr));
-        }
-      }
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_query(CharacterVector q, int scan_time, List opts, int as) {
+
+  bnjr_scan_spec spec;
+  spec.mode = BNJR_SCAN_QUERY;
+  spec.scan_time = scan_time;
+  spec_from_opts(opts, spec);
+
+  // one table for all the scans, so a host answering several queries is one row
+  if (as == RESULT_HOSTS) spec.hosts = std::make_shared<bnjr_host_table>();
+
+  // several questions (in each namespace) are asked by independent scans
+  // running in parallel
+  std::vector<bnjr_scan_spec> per_ns = netns_specs(opts, spec), specs;
+  for (R_xlen_t i = 0; i < q.size(); ++i) {
+    for (size_t j = 0; j < per_ns.size(); ++j) {
+      specs.push_back(per_ns[j]);
+      specs.back().query = as<std::string>(q[i]);
     }
   }
 
-  freeifaddrs(ifaddr);
+  std::vector<bnjr_record> records = scan_merged(specs);
+
+  if (spec.hosts) return(bnjr_hosts_frame(spec.hosts->hosts()));
+
+  return(records_result(records, as));
+
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_read_pcap(std::string path, int threads, List opts, int as) {
+
+  bnjr_scan_spec spec;
+  spec_from_opts(opts, spec);
+
+  std::vector<bnjr_record> records;
+  bnjr_pcap_stats stats;
+  std::string err;
+
+  if (!bnjr_read_pcap(path, &spec.filter, threads, records, stats, err)) stop(err);
+
+  if (spec.cache) {
+    int64_t now = bnjr_cache::now_ms();
+    for (size_t i = 0; i < records.size(); ++i) spec.cache->insert(records[i], now);
+  }
+
+  if (stats.skipped) {
+    Rf_warning("%d mDNS datagram(s) could not be decoded "
+               "(IP fragments or cut short by the snap length)\n", (int)stats.skipped);
+  }
 
-#endif
+  return(records_result(records, as));
 
-  return num_sockets;
 }
 
-static int query_callback(int sock,
-                          const struct sockaddr* from,
-                          size_t addrlen,
-                          mdns_entry_type_t entry,
-                          uint16_t transaction_id,
-                          uint16_t rtype,
-                          uint16_t rclass,
-                          uint32_t ttl,
-                          const void* data,
-                          size_t size,
-                          size_t name_offset,
-                          size_t name_length,
-                          size_t offset,
-                          size_t length,
-                          void* user_data) {
+// IPv4/IPv6 address strings to socket addresses; stops on anything else.
+static void parse_addresses(CharacterVector addresses, std::vector<struct sockaddr_storage>& out) {
+  for (R_xlen_t i = 0; i < addresses.size(); ++i) {
+    std::string a = as<std::string>(addresses[i]);
+    struct sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if (inet_pton(AF_INET, a.c_str(), &((struct sockaddr_in*)&ss)->sin_addr) == 1) {
+      ss.ss_family = AF_INET;
+    } else if (inet_pton(AF_INET6, a.c_str(), &((struct sockaddr_in6*)&ss)->sin6_addr) == 1) {
+      ss.ss_family = AF_INET6;
+    } else {
+      stop("invalid address '" + a + "'");
+    }
+    out.push_back(ss);
+  }
+}
 
-// static int query_callback(int sock, const struct sockaddr* from, size_t addrlen,
-//                           mdns_entry_type_t entry, uint16_t transaction_id,
-//                           uint16_t rtype, uint16_t rclass, uint32_t ttl,
-//                           const void* data, size_t size, size_t offset, size_t length,
-//                           void* user_data) {
+static std::string from_string(const bnjr_record& rec) {
+  char buffer[64];
+  mdns_string_t s = ip_address_to_string(buffer, sizeof(buffer),
+                                         (const struct sockaddr*)&rec.from, rec.addrlen);
+  return(std::string(s.str, s.length));
+}
 
-  mdns_string_t fromaddrstr = ip_address_to_string(addrbuffer, sizeof(addrbuffer), from, addrlen);
-  std::string fromstr = std::string(fromaddrstr.str, fromaddrstr.length);
+static void resolve_run(bnjr_resolve_spec& spec, double timeout, List opts,
+                        bnjr_resolve_result& result) {
 
-  mdns_string_t entrystr =
-    mdns_string_extract(data, size, &name_offset, entrybuffer, sizeof(entrybuffer));
+  bnjr_scan_spec scan;
+  spec_from_opts(opts, scan);
 
-  const char* entrytype = (entry == MDNS_ENTRYTYPE_ANSWER) ? "answer" :
-    ((entry == MDNS_ENTRYTYPE_AUTHORITY) ? "authority" : "additional");
+  spec.timeout_ms = (int)(timeout * 1000);
+  spec.interfaces = scan.interfaces;
+  spec.sockets = scan.sockets;
+  spec.priority = scan.priority;
+  spec.cache = scan.cache;
 
-  std::string rec = "{ \"from\" : \"" + fromstr +
-                    "\", \"entry_type\": \"" + entrytype + "\"";
+  bnjr_resolve(spec, result);
 
-  if (rtype == MDNS_RECORDTYPE_PTR) {
+  if (result.error.size()) stop(result.error);
+  for (size_t i = 0; i < result.warnings.size(); ++i)
+    Rf_warning("%s\n", result.warnings[i].c_str());
 
-    mdns_string_t namestr = mdns_record_parse_ptr(data, size, offset, length,
-                                                  namebuffer, sizeof(namebuffer));
+}
 
-    rec = rec + ", \"type\": \"PTR\"";
-    rec = rec + ", \"name\": \"" + std::string(namestr.str, namestr.length) + "\"";
-    rec = rec + ", \"rclass\": " + std::to_string(rclass) + "";
-    rec = rec + ", \"ttl\": " + std::to_string(ttl) + "";
-    rec = rec + ", \"length\": " + std::to_string(length) + "";
+// Row order for a lookup result: each name's answers in the order the names
+// were given, with a single NA row (SIZE_MAX) for names nobody answered.
+static std::vector<std::pair<size_t, size_t>> resolve_rows(const bnjr_resolve_result& result,
+                                                           size_t num_names) {
 
-    // printf("%.*s : %s PTR %.*s rclass 0x%x ttl %u length %d\n",
-    //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-    //        MDNS_STRING_FORMAT(namestr), rclass, ttl, (int)length);
+  std::vector<std::vector<size_t>> by_name(num_names);
+  for (size_t i = 0; i < result.records.size(); ++i) by_name[result.index[i]].push_back(i);
 
-  } else if (rtype == MDNS_RECORDTYPE_SRV) {
+  std::vector<std::pair<size_t, size_t>> rows;
+  for (size_t i = 0; i < num_names; ++i) {
+    if (by_name[i].empty()) rows.push_back(std::make_pair(i, (size_t)SIZE_MAX));
+    for (size_t j = 0; j < by_name[i].size(); ++j) rows.push_back(std::make_pair(i, by_name[i][j]));
+  }
 
-    mdns_record_srv_t srv = mdns_record_parse_srv(data, size, offset, length,
-                                                  namebuffer, sizeof(namebuffer));
+  return(rows);
 
-    rec = rec + ", \"type\": \"SRV\"";
-    rec = rec + ", \"srv_name\": \"" + std::string(srv.name.str, srv.name.length) + "\"";
-    rec = rec + ", \"srv_priority\": " + std::to_string(srv.priority) + "";
-    rec = rec + ", \"srv_weight\": " + std::to_string(srv.weight) + "";
-    rec = rec + ", \"srv_port\": " + std::to_string(srv.port) + "";
+}
 
-    // printf("%.*s : %s SRV %.*s priority %d weight %d port %d\n",
-    //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-    //        MDNS_STRING_FORMAT(srv.name), srv.priority, srv.weight, srv.port);
+static List resolve_frame(List out, const bnjr_resolve_result& result, size_t n) {
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  out.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+  out.attr("packets") = result.packets;
+  out.attr("cached") = result.cached;
+  return(out);
+}
 
-  } else if (rtype == MDNS_RECORDTYPE_A) {
+// [[Rcpp::export]]
+List int_bnjr_resolve(CharacterVector names, IntegerVector rtypes, double timeout, List opts) {
 
-    struct sockaddr_in addr;
-    mdns_record_parse_a(data, size, offset, length, &addr);
-    mdns_string_t addrstr = ipv4_address_to_string(namebuffer, sizeof(namebuffer), &addr, sizeof(addr));
+  bnjr_resolve_spec spec;
+  spec.names = as<std::vector<std::string>>(names);
+  for (R_xlen_t i = 0; i < rtypes.size(); ++i) spec.rtypes.push_back((uint16_t)rtypes[i]);
 
-    rec = rec + ", \"type\": \"A\"";
-    rec = rec + ", \"addr\": \"" + std::string(addrstr.str, addrstr.length) + "\"";
+  bnjr_resolve_result result;
+  resolve_run(spec, timeout, opts, result);
 
-    // printf("%.*s : %s A %.*s\n",
-    //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-    //        MDNS_STRING_FORMAT(addrstr));
+  std::vector<std::pair<size_t, size_t>> rows = resolve_rows(result, spec.names.size());
+  size_t n = rows.size();
 
-  } else if (rtype == MDNS_RECORDTYPE_AAAA) {
+  CharacterVector host(n), type(n), addr(n), from(n);
+  IntegerVector ttl(n);
 
-    struct sockaddr_in6 addr;
-    mdns_record_parse_aaaa(data, size, offset, length, &addr);
-    mdns_string_t addrstr = ipv6_address_to_string(namebuffer, sizeof(namebuffer), &addr, sizeof(addr));
+  for (size_t row = 0; row < n; ++row) {
 
-    rec = rec + ", \"type\": \"AAAA\"";
-    rec = rec + ", \"addr\": \"" + std::string(addrstr.str, addrstr.length) + "\"";
+    host[row] = names[rows[row].first];
 
-    // printf("%.*s : %s AAAA %.*s\n",
-    //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-    //        MDNS_STRING_FORMAT(addrstr));
+    if (rows[row].second == SIZE_MAX) {
+      type[row] = NA_STRING;
+      addr[row] = NA_STRING;
+      ttl[row] = NA_INTEGER;
+      from[row] = NA_STRING;
+      continue;
+    }
 
-  } else if (rtype == MDNS_RECORDTYPE_TXT) {
+    const bnjr_record& rec = result.records[rows[row].second];
+    type[row] = (rec.rtype == MDNS_RECORDTYPE_A) ? "A" :
+      ((rec.rtype == MDNS_RECORDTYPE_AAAA) ? "AAAA" : std::to_string(rec.rtype));
+    addr[row] = rec.target;
+    ttl[row] = (int)rec.ttl;
+    from[row] = from_string(rec);
 
-    size_t parsed = mdns_record_parse_txt(data, size, offset, length,
-                                          txtbuffer, sizeof(txtbuffer) / sizeof(mdns_record_txt_t));
+  }
 
-    rec = rec + ", \"type\": \"TXT\", \"info\": [ ";
+  return(resolve_frame(List::create(
+    _["host"] = host, _["type"] = type, _["addr"] = addr, _["ttl"] = ttl, _["from"] = from
+  ), result, n));
 
-    for (size_t itxt = 0; itxt < parsed; ++itxt) {
+}
 
-      if (itxt > 0) rec = rec + ", ";
+// [[Rcpp::export]]
+List int_bnjr_reverse(CharacterVector addresses, double timeout, List opts) {
 
-      if (txtbuffer[itxt].value.length) {
+  std::vector<struct sockaddr_storage> addrs;
+  parse_addresses(addresses, addrs);
 
-        rec = rec + "{ ";
-        rec = rec + "\"key\":";
-        rec = rec + "\"" + std::string(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length) + "\"";
-        rec = rec + ", \"value\":" ;
-        rec = rec + "\"" + macaron::Base64::Encode(std::string(txtbuffer[itxt].value.str, txtbuffer[itxt].value.length)) + "\"";
-        rec = rec + " }";
+  bnjr_resolve_spec spec;
+  for (size_t i = 0; i < addrs.size(); ++i)
+    spec.names.push_back(bnjr_reverse_name((const struct sockaddr*)&addrs[i]));
+  spec.rtypes.push_back(MDNS_RECORDTYPE_PTR);
 
-        // rec = rec + "\"key\": \"" + std::string(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length) + "\"";
-        // rec = rec + "\"key\": \"" + std::string(txtbuffer[itxt].value.str, txtbuffer[itxt].value.length) + "\"";
+  bnjr_resolve_result result;
+  resolve_run(spec, timeout, opts, result);
 
-        // printf("%.*s : %s TXT %.*s = %.*s\n",
-        //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-        //        MDNS_STRING_FORMAT(txtbuffer[itxt].key),
-        //        MDNS_STRING_FORMAT(txtbuffer[itxt].value));
+  std::vector<std::pair<size_t, size_t>> rows = resolve_rows(result, spec.names.size());
+  size_t n = rows.size();
 
-      } else {
+  CharacterVector addr(n), name(n), from(n);
+  IntegerVector ttl(n);
 
-        rec = rec + "{ \"value\": \"" + macaron::Base64::Encode(std::string(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length)) + "\" }";
+  for (size_t row = 0; row < n; ++row) {
 
-        // printf("%.*s : %s TXT %.*s\n",
-        //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-        //        MDNS_STRING_FORMAT(txtbuffer[itxt].key));
-      }
+    addr[row] = addresses[rows[row].first];
 
+    if (rows[row].second == SIZE_MAX) {
+      name[row] = NA_STRING;
+      ttl[row] = NA_INTEGER;
+      from[row] = NA_STRING;
+      continue;
     }
 
-    rec = rec + " ]";
+    const bnjr_record& rec = result.records[rows[row].second];
+    name[row] = bnjr_mkchar(rec.target);
+    ttl[row] = (int)rec.ttl;
+    from[row] = from_string(rec);
 
-  } else {
+  }
+
+  return(resolve_frame(List::create(
+    _["addr"] = addr, _["name"] = name, _["ttl"] = ttl, _["from"] = from
+  ), result, n));
+
+}
+
+static void async_finalizer(bnjr_async* x) {
+  delete x;
+}
+
+typedef XPtr<bnjr_async, PreserveStorage, async_finalizer, true> async_xptr;
+
+static bnjr_async* async_get(SEXP handle) {
+  async_xptr x(handle);
+  if (!x.get()) stop("scan handle has already been collected");
+  return(x.get());
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_async_start(std::string q, int scan_time, bool discover, List opts) {
+
+  bnjr_scan_spec spec;
+  spec.mode = discover ? BNJR_SCAN_DISCOVER : BNJR_SCAN_QUERY;
+  spec.query = q;
+  spec.scan_time = scan_time;
+  spec_from_opts(opts, spec);
+
+  // nobody is blocked on it, so it yields to blocking scans when sending
+  spec.priority = BNJR_PRIORITY_BACKGROUND;
+
+  async_xptr x(new bnjr_async(spec), true);
+
+  return(x);
+
+}
+
+// [[Rcpp::export]]
+bool int_bnjr_async_done(SEXP handle) {
+  async_xptr x(handle);
+  return(x.get() ? x->done() : true);
+}
+
+// [[Rcpp::export]]
+bool int_bnjr_async_wait(SEXP handle, double timeout) {
+  async_xptr x(handle);
+  return(x.get() ? x->wait(timeout) : true);
+}
+
+// [[Rcpp::export]]
+int int_bnjr_async_fd(SEXP handle) {
+  return(async_get(handle)->fd());
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_async_collect(SEXP handle, int as) {
+
+  async_xptr x(handle);
+  if (!x.get()) stop("scan handle has already been collected");
+
+  bnjr_scan_result result = x->collect();
+  x.release();
+
+  return(scan_to_result(result, as));
+
+}
 
-    rec = rec + ", \"type\": \"" + std::to_string((long)entrytype) + "";
-    rec = rec + ", \"rclass\": " + std::to_string(rclass) + "";
-    rec = rec + ", \"rtype\": " + std::to_string(rtype) + "";
-    rec = rec + ", \"ttl\": " + std::to_string(ttl) + "";
-    rec = rec + ", \"length\": " + std::to_string(length) + "";
+// Scans still running when the package is unloaded would go on running code
+// that's about to be unmapped, so wait for them first.
+extern "C" void R_unload_bonjour(DllInfo*) {
+  bnjr_async_shutdown();
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_cache_new(std::string path) {
 
-    // printf("%.*s : %s type %u rclass 0x%x ttl %u length %d\n",
-    //        MDNS_STRING_FORMAT(fromaddrstr), entrytype,
-    //        rtype, rclass, ttl, (int)length);
+  cache_ref cache = std::make_shared<bnjr_cache>();
 
+  if (path.size()) {
+    std::string err;
+    if (!cache->load(path, bnjr_cache::now_ms(), err)) stop(err);
   }
 
-  rec = rec + " }\n";
+  cache_xptr x(new cache_ref(cache), true);
 
-  std::fputs(rec.c_str(), (FILE *)user_data);
+  return(x);
 
-  return 0;
+}
 
+// [[Rcpp::export]]
+void int_bnjr_cache_load(SEXP handle, std::string path) {
+  std::string err;
+  if (!cache_get(handle)->load(path, bnjr_cache::now_ms(), err)) stop(err);
 }
 
 // [[Rcpp::export]]
-std::string int_bnjr_discover(int scan_time = 10L) {
+void int_bnjr_cache_save(SEXP handle, std::string path) {
+  std::string err;
+  cache_ref cache = cache_get(handle);
+  cache->expire(bnjr_cache::now_ms());
+  if (!cache->save(path, err)) stop(err);
+}
 
-  int sockets[32];
-  int num_sockets = open_client_sockets(sockets, sizeof(sockets) / sizeof(sockets[0]), 0);
-  if (num_sockets <= 0) Rf_error("Failed to open any client sockets\n");
+// [[Rcpp::export]]
+SEXP int_bnjr_cache_records(SEXP handle, int as) {
+  std::vector<bnjr_record> records = cache_get(handle)->records(bnjr_cache::now_ms());
+  return(records_result(records, as));
+}
+
+// [[Rcpp::export]]
+int int_bnjr_cache_size(SEXP handle) {
+  cache_ref cache = cache_get(handle);
+  cache->expire(bnjr_cache::now_ms());
+  return((int)cache->size());
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_recorder_new(std::string path, int slots) {
+
+  if ((slots < 1) || ((size_t)slots > BNJR_RECORDER_MAX_SLOTS))
+    stop("slots must be between 1 and %d", (int)BNJR_RECORDER_MAX_SLOTS);
+
+  recorder_ref recorder = std::make_shared<bnjr_recorder>((size_t)slots);
+
+  std::string err;
+  if (!recorder->open(path, err)) stop(err);
+
+  recorder_xptr x(new recorder_ref(recorder), true);
+
+  return(x);
+
+}
+
+// [[Rcpp::export]]
+void int_bnjr_recorder_close(SEXP handle) {
+  recorder_get(handle)->close();
+}
+
+// [[Rcpp::export]]
+NumericVector int_bnjr_recorder_stats(SEXP handle) {
+  recorder_ref recorder = recorder_get(handle);
+  return(NumericVector::create(
+    _["recorded"] = (double)recorder->recorded(),
+    _["dropped"] = (double)recorder->dropped(),
+    _["open"] = recorder->is_open() ? 1 : 0
+  ));
+}
+
+// [[Rcpp::export]]
+List int_bnjr_cache_changes(SEXP handle, double since) {
+
+  cache_ref cache = cache_get(handle);
+  cache->expire(bnjr_cache::now_ms());
 
-  std::string out;
+  std::vector<bnjr_cache_change> changes;
+  bool complete;
+  uint64_t seq = cache->changes((since > 0) ? (uint64_t)since : 0, changes, complete);
 
-  std::FILE* tmpf = std::tmpfile();
+  size_t n = changes.size();
+  NumericVector seqs(n), at(n);
+  CharacterVector kind(n);
+  std::vector<bnjr_record> records(n);
 
-  for (int isock = 0; isock < num_sockets; ++isock) {
-    if ((mdns_discovery_send(sockets[isock])) && (errno != EHOSTUNREACH))
-      Rf_warning("Failed to send DNS-DS discovery: %s\n", strerror(errno));
+  for (size_t i = 0; i < n; ++i) {
+    seqs[i] = (double)changes[i].seq;
+    kind[i] = bnjr_change_name(changes[i].kind);
+    at[i] = (double)changes[i].at_ms / 1000.0;
+    records[i] = changes[i].rec;
   }
 
-  size_t capacity = 2048;
-  void* buffer = malloc(capacity);
-  void* user_data = 0;
-  size_t records;
+  // the change columns go in front of the usual record columns
+  List recs = records_frame(records);
+  CharacterVector rec_names = recs.names();
+  List out(recs.size() + 3);
+  CharacterVector names(recs.size() + 3);
+
+  out[0] = seqs;  names[0] = "seq";
+  out[1] = kind;  names[1] = "change";
+  out[2] = at;    names[2] = "at";
+  for (R_xlen_t i = 0; i < recs.size(); ++i) {
+    out[i + 3] = recs[i];
+    names[i + 3] = rec_names[i];
+  }
 
-  int res;
+  out.attr("names") = names;
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  out.attr("row.names") = IntegerVector::create(NA_INTEGER, -(int)n);
+  out.attr("sequence") = (double)seq;
+  out.attr("complete") = complete;
 
-  do {
-    struct timeval timeout;
-    timeout.tv_sec = scan_time;
-    timeout.tv_usec = 0;
+  return(out);
 
-    int nfds;
-    nfds = 0;
-    fd_set readfs;
-    FD_ZERO(&readfs);
-    for (int isock = 0; isock < num_sockets; ++isock) {
-      if (sockets[isock] >= nfds)
-        nfds = sockets[isock] + 1;
-      FD_SET(sockets[isock], &readfs);
-    }
+}
 
-    records = 0;
-    res = select(nfds, &readfs, 0, 0, &timeout);
-    if (res > 0) {
-      for (int isock = 0; isock < num_sockets; ++isock) {
-        if (FD_ISSET(sockets[isock], &readfs)) {
-          records += mdns_discovery_recv(sockets[isock],
-                                         buffer,
-                                         capacity,
-                                         query_callback,
-                                         tmpf);
-        }
-      }
-    }
-  } while (res > 0);
+// Move an exported batch into structs allocated by
+// nanoarrow::nanoarrow_allocate_schema()/nanoarrow_allocate_array(). Only
+// the two small structs are copied; the buffers go along untouched.
+// [[Rcpp::export]]
+void int_bnjr_arrow_move(SEXP batch, SEXP schema, SEXP array) {
+
+  arrow_xptr x(batch);
+  if (!x.get() || x->moved()) stop("Arrow batch has already been moved");
+
+  struct ArrowSchema* out_schema = (struct ArrowSchema*)R_ExternalPtrAddr(schema);
+  struct ArrowArray* out_array = (struct ArrowArray*)R_ExternalPtrAddr(array);
+
+  if (!out_schema || !out_array) stop("invalid Arrow schema/array pointers");
+  if (out_schema->release || out_array->release) stop("Arrow schema/array are already in use");
+
+  x->move_to(out_schema, out_array);
+
+}
+
+typedef std::shared_ptr<bnjr_responder> responder_ref;
+typedef XPtr<responder_ref> responder_xptr;
+
+static responder_ref responder_get(SEXP handle) {
+  responder_xptr x(handle);
+  if (!x.get()) stop("invalid responder handle");
+  return(*x);
+}
 
-  std::rewind(tmpf);
+// [[Rcpp::export]]
+SEXP int_bnjr_responder_new(std::string hostname, CharacterVector addresses, int family,
+                            int ttl, int threads) {
+
+  responder_ref responder = std::make_shared<bnjr_responder>();
 
-  char fbuf[1024];
+  std::vector<struct sockaddr_storage> addrs;
+
+  if (addresses.size()) {
+    parse_addresses(addresses, addrs);
+  } else {
+    bnjr_iface_select select;
+    select.family = (bnjr_family)family;
+    local_addresses(select, addrs);
+  }
 
-  while (std::fgets(fbuf, sizeof(fbuf), tmpf)) {
-    out = out + std::string(fbuf, strlen(fbuf));
+  std::vector<bnjr_rr> rrs;
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    const struct sockaddr* sa = (const struct sockaddr*)&addrs[i];
+    rrs.push_back(bnjr_rr_addr(hostname, sa, (uint32_t)ttl));
+    rrs.push_back(bnjr_rr_reverse(sa, hostname, (uint32_t)ttl));
   }
+  responder->add(rrs);
+
+  std::string err;
+  if (!responder->start((bnjr_family)family, threads, err)) stop(err);
 
-  std::fclose(tmpf);
+  responder_xptr x(new responder_ref(responder), true);
 
-  free(buffer);
+  return(x);
+
+}
 
-  for (int isock = 0; isock < num_sockets; ++isock){
-    mdns_socket_close(sockets[isock]);
+// [[Rcpp::export]]
+void int_bnjr_responder_publish(SEXP handle, CharacterVector instance, std::string service,
+                                std::string hostname, IntegerVector port, CharacterVector txt,
+                                int ttl) {
+
+  responder_ref responder = responder_get(handle);
+
+  std::vector<bnjr_txt> items;
+  for (R_xlen_t i = 0; i < txt.size(); ++i) {
+    std::string kv = as<std::string>(txt[i]);
+    size_t eq = kv.find('=');
+    bnjr_txt item;
+    item.key = kv.substr(0, eq);
+    if (eq != std::string::npos) item.value = kv.substr(eq + 1);
+    items.push_back(item);
   }
 
-  return(out);
+  // one snapshot update for the whole catalog
+  std::vector<bnjr_rr> rrs;
+  for (R_xlen_t i = 0; i < instance.size(); ++i) {
+    bnjr_responder::service_records(as<std::string>(instance[i]), service, hostname,
+                                    (uint16_t)port[i % port.size()], items, (uint32_t)ttl, rrs);
+  }
+  responder->add(rrs);
+
+}
+
+// [[Rcpp::export]]
+void int_bnjr_responder_stop(SEXP handle) {
+  responder_get(handle)->stop();
+}
 
+// [[Rcpp::export]]
+NumericVector int_bnjr_responder_stats(SEXP handle) {
+  responder_ref responder = responder_get(handle);
+  bnjr_responder_stats st = responder->stats();
+  return(NumericVector::create(
+    _["queries"] = (double)st.queries,
+    _["answers"] = (double)st.answers,
+    _["packets"] = (double)st.packets,
+    _["known_suppressed"] = (double)st.known_suppressed,
+    _["duplicate_suppressed"] = (double)st.duplicate_suppressed,
+    _["rate_limited"] = (double)st.rate_limited,
+    _["records"] = (double)responder->size(),
+    _["shards"] = (double)responder->shards()
+  ));
 }
 
+// Multicast one raw message from port 5353 out of the first selected
+// interface, as a querier on the mDNS port would (so its questions are QM
+// and answers to it are multicast). Returns the number of datagrams sent.
+// Lets the tests drive a responder over the loopback of our own multicast.
 // [[Rcpp::export]]
-std::string int_bnjr_query(std::string q, int scan_time = 5L) {
+int int_bnjr_mdns_send(RawVector msg, List opts) {
+
+  bnjr_scan_spec spec;
+  spec_from_opts(opts, spec);
 
   int sockets[32];
-  int query_id[32];
+  std::vector<bnjr_egress> egress;
+  int num_sockets = open_query_sockets(sockets, sizeof(sockets) / sizeof(sockets[0]), MDNS_PORT,
+                                       spec.interfaces, BNJR_SOCKETS_FAMILY, egress);
 
-  int num_sockets = open_client_sockets(sockets, sizeof(sockets) / sizeof(sockets[0]), 0);
-  if (num_sockets <= 0) Rf_error("Failed to open any client sockets");
+  int sent = (egress.size() && !bnjr_multicast_send(egress[0], msg.begin(), msg.size())) ? 1 : 0;
 
-  size_t capacity = 2048;
-  void* buffer = malloc(capacity);
-  void* user_data = 0;
-  size_t records;
+  for (int isock = 0; isock < num_sockets; ++isock) mdns_socket_close(sockets[isock]);
 
-  std::FILE* tmpf = std::tmpfile();
+  return(sent);
 
-  std::string out;
+}
 
-  for (int isock = 0; isock < num_sockets; ++isock) {
-    query_id[isock] = mdns_query_send(sockets[isock], MDNS_RECORDTYPE_PTR, q.c_str(),
-                                      q.length(), buffer, capacity, 0);
-    if ((query_id[isock] < 0) && (errno != EHOSTUNREACH))
-      Rf_warning("Failed to send mDNS query: %s\n", strerror(errno));
-  }
+typedef std::shared_ptr<bnjr_daemon> daemon_ref;
+typedef XPtr<daemon_ref> daemon_xptr;
 
-  int res;
+static daemon_ref daemon_get(SEXP handle) {
+  daemon_xptr x(handle);
+  if (!x.get()) stop("invalid daemon handle");
+  return(*x);
+}
 
-  do {
-    struct timeval timeout;
-    timeout.tv_sec = scan_time;
-    timeout.tv_usec = 0;
+// [[Rcpp::export]]
+SEXP int_bnjr_daemon_new(std::string socket, std::string snapshot, List opts) {
 
-    int nfds = 0;
-    fd_set readfs;
-    FD_ZERO(&readfs);
-    for (int isock = 0; isock < num_sockets; ++isock) {
-      if (sockets[isock] >= nfds)
-        nfds = sockets[isock] + 1;
-      FD_SET(sockets[isock], &readfs);
-    }
+  bnjr_daemon_spec spec;
+  spec.socket_path = socket;
+  spec.snapshot_path = snapshot;
+  spec_from_opts(opts, spec.scan);
 
-    records = 0;
-    res = select(nfds, &readfs, 0, 0, &timeout);
-    if (res > 0) {
-      for (int isock = 0; isock < num_sockets; ++isock) {
-        if (FD_ISSET(sockets[isock], &readfs)) {
-          records += mdns_query_recv(sockets[isock], buffer, capacity, query_callback,
-                                     tmpf, query_id[isock]);
-        }
-        FD_SET(sockets[isock], &readfs);
-      }
-    }
-  } while (res > 0);
+  daemon_ref daemon = std::make_shared<bnjr_daemon>();
+
+  std::string err;
+  if (!daemon->start(spec, err)) stop(err);
+
+  daemon_xptr x(new daemon_ref(daemon), true);
+
+  return(x);
+
+}
+
+// [[Rcpp::export]]
+void int_bnjr_daemon_stop(SEXP handle) {
+  daemon_get(handle)->stop();
+}
+
+// [[Rcpp::export]]
+NumericVector int_bnjr_daemon_stats(SEXP handle) {
+  daemon_ref daemon = daemon_get(handle);
+  bnjr_daemon_stats st = daemon->stats();
+  return(NumericVector::create(
+    _["clients"] = (double)st.clients,
+    _["requests"] = (double)st.requests,
+    _["scans"] = (double)st.scans,
+    _["shared"] = (double)st.shared,
+    _["snapshots"] = (double)st.snapshots,
+    _["errors"] = (double)st.errors,
+    _["running"] = daemon->running() ? 1 : 0
+  ));
+}
+
+// Results come over the socket as a cache image and are decoded here.
+// [[Rcpp::export]]
+SEXP int_bnjr_daemon_request(std::string socket, std::string request, double timeout, int as) {
+
+  std::string body, err;
+  if (!bnjr_daemon_request(socket, request, (int)(timeout * 1000), body, err)) stop(err);
+
+  std::vector<bnjr_record> records;
+  if (!bnjr_cache_decode((const uint8_t*)body.data(), body.size(), bnjr_cache::now_ms(), records,
+                         err))
+    stop(err);
+
+  return(records_result(records, as));
+
+}
+
+// [[Rcpp::export]]
+SEXP int_bnjr_snapshot(std::string path, int as) {
+
+  bnjr_mapped_file file;
+  std::vector<bnjr_record> records;
+  std::string err;
 
-  std::rewind(tmpf);
+  if (!file.open(path, err) ||
+      !bnjr_cache_decode(file.data(), file.size(), bnjr_cache::now_ms(), records, err))
+    stop(err);
 
-  char fbuf[1024];
+  return(records_result(records, as));
 
-  while (std::fgets(fbuf, sizeof(fbuf), tmpf)) {
-    out = out + std::string(fbuf, strlen(fbuf));
+}
+
+// limits: packets, bytes, interface_packets, interface_bytes, burst; NA
+// leaves a setting as it is. Returns the settings now in force.
+// [[Rcpp::export]]
+NumericVector int_bnjr_pacing(NumericVector limits) {
+
+  bnjr_pacer& pacer = bnjr_pacer::shared();
+
+  bnjr_rate global, iface;
+  pacer.limits(global, iface);
+
+  double* fields[5] = {
+    &global.packets_per_sec, &global.bytes_per_sec,
+    &iface.packets_per_sec, &iface.bytes_per_sec, &global.burst
+  };
+
+  bool changed = false;
+  for (R_xlen_t i = 0; (i < limits.size()) && (i < 5); ++i) {
+    if (NumericVector::is_na(limits[i])) continue;
+    double v = limits[i];
+    if ((v < 0) || std::isnan(v)) stop("pacing limits must be positive (or 0/Inf for none)");
+    *fields[i] = std::isinf(v) ? 0 : v;
+    changed = true;
   }
+  iface.burst = global.burst;
 
-  std::fclose(tmpf);
+  if (changed) pacer.set_limits(global, iface);
 
-  free(buffer);
+  return(NumericVector::create(
+    _["packets"] = global.packets_per_sec,
+    _["bytes"] = global.bytes_per_sec,
+    _["interface_packets"] = iface.packets_per_sec,
+    _["interface_bytes"] = iface.bytes_per_sec,
+    _["burst"] = global.burst
+  ));
 
-  for (int isock = 0; isock < num_sockets; ++isock)
-    mdns_socket_close(sockets[isock]);
+}
+
+// [[Rcpp::export]]
+List int_bnjr_pacing_stats(bool reset) {
+
+  bnjr_pacer_stats stats[2];
+  bnjr_pacer::shared().stats(stats);
+  if (reset) bnjr_pacer::shared().reset_stats();
+
+  NumericVector packets(2), bytes(2), delayed(2), mean_wait(2), max_wait(2);
+  for (int i = 0; i < 2; ++i) {
+    packets[i] = (double)stats[i].packets;
+    bytes[i] = (double)stats[i].bytes;
+    delayed[i] = (double)stats[i].delayed;
+    mean_wait[i] = stats[i].packets ? (double)stats[i].wait_ns / stats[i].packets / 1e6 : 0;
+    max_wait[i] = (double)stats[i].max_wait_ns / 1e6;
+  }
+
+  List out = List::create(
+    _["priority"] = CharacterVector::create("interactive", "background"),
+    _["packets"] = packets,
+    _["bytes"] = bytes,
+    _["delayed"] = delayed,
+    _["mean_wait"] = mean_wait,
+    _["max_wait"] = max_wait
+  );
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  out.attr("row.names") = IntegerVector::create(NA_INTEGER, -2);
 
   return(out);
 
-}
\ No newline at end of file
+}
+
+// Passive analytics: listen on the mDNS port for scan_time seconds, or
+// replay a capture when pcap is given.
+// [[Rcpp::export]]
+List int_bnjr_traffic(int scan_time, int window, double limit, int top, List opts,
+                      std::string pcap) {
+
+  bnjr_traffic_spec tspec = bnjr_traffic_defaults();
+  tspec.window = window;
+  tspec.limit = limit;
+  tspec.top = (size_t)top;
+  if (tspec.capacity < tspec.top * 4) tspec.capacity = tspec.top * 4;
+
+  bnjr_scan_spec spec;
+  spec.mode = BNJR_SCAN_LISTEN;
+  spec.scan_time = scan_time;
+  spec_from_opts(opts, spec);
+  spec.traffic = std::make_shared<bnjr_traffic>(tspec);
+
+  if (pcap.size()) {
+    bnjr_pcap_stats stats;
+    std::string err;
+    if (!bnjr_pcap_traffic(pcap, *spec.traffic, stats, err)) stop(err);
+    return(bnjr_traffic_frames(spec.traffic->report(), spec.traffic->spec()));
+  }
+
+  bnjr_scan_result result;
+  bnjr_scan(spec, result);
+  scan_check(result);
+
+  return(bnjr_traffic_frames(spec.traffic->report(bnjr_wall_ns()), spec.traffic->spec()));
+
+}
+
+// Time the callback parser against the template visitor on a capture's
+// datagrams (inst/bench/decode.R).
+// [[Rcpp::export]]
+List int_bnjr_decode_bench(std::string path, int passes) {
+
+  bnjr_mapped_file file;
+  std::vector<bnjr_pcap_datagram> dgrams;
+  bnjr_pcap_stats stats;
+  std::string err;
+
+  if (!file.open(path, err) || !bnjr_pcap_datagrams(file.data(), file.size(), dgrams, stats, err))
+    stop(err);
+
+  std::vector<bnjr_bench_result> res = bnjr_decode_bench(dgrams, passes);
+
+  CharacterVector method(res.size());
+  NumericVector records(res.size()), seconds(res.size());
+  for (size_t i = 0; i < res.size(); ++i) {
+    method[i] = res[i].method;
+    records[i] = (double)res[i].records;
+    seconds[i] = res[i].seconds;
+  }
+
+  return(List::create(_["method"] = method, _["records"] = records, _["seconds"] = seconds,
+                      _["datagrams"] = (double)dgrams.size()));
+
+}
@@ -0,0 +1,352 @@
+#include "bonjour-arrow.h"
+#include "bonjour-iface.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#endif
+
+// Column builder: enough of Arrow's layouts for the record batch we export
+// (fixed-width integers, utf8/binary, list and struct). Each column keeps
+// its own validity bitmap, offsets and data and moves them into the exported
+// array's private data, so nothing is copied on export.
+class arrow_column {
+
+public:
+
+  arrow_column(const char* format, const char* name, bool nullable) :
+    format_(format), name_(name), nullable_(nullable), length_(0), null_count_(0) {
+    if (is_variable()) offsets_.push_back(0);
+  }
+
+  arrow_column* add_child(const char* format, const char* name, bool nullable) {
+    children_.push_back(std::unique_ptr<arrow_column>(new arrow_column(format, name, nullable)));
+    return(children_.back().get());
+  }
+
+  void append_null() {
+    set_valid(false);
+    if (is_variable()) offsets_.push_back(offsets_.back());
+    data_.resize(data_.size() + fixed_width(), 0);
+  }
+
+  template <class T>
+  void append(T v) {
+    set_valid(true);
+    const uint8_t* p = (const uint8_t*)&v;
+    data_.insert(data_.end(), p, p + sizeof(T));
+  }
+
+  void append_bytes(const void* p, size_t len) {
+    set_valid(true);
+    data_.insert(data_.end(), (const uint8_t*)p, (const uint8_t*)p + len);
+    offsets_.push_back((int32_t)data_.size());
+  }
+
+  void append_string(const std::string& s) { append_bytes(s.data(), s.size()); }
+
+  // utf8 from the network, which has to be valid UTF-8 to be utf8
+  void append_text(const std::string& s) {
+    std::string escaped;
+    if (bnjr_text_escape(s.data(), s.size(), escaped)) {
+      append_string(escaped);
+    } else {
+      append_string(s);
+    }
+  }
+
+  // list: call after appending this row's elements to the child
+  void end_list() {
+    set_valid(true);
+    offsets_.push_back((int32_t)children_[0]->length_);
+  }
+
+  // struct: call after appending one value to every child
+  void end_struct() { set_valid(true); }
+
+  void export_to(struct ArrowSchema* schema, struct ArrowArray* array);
+
+private:
+
+  struct array_data {
+    std::vector<uint8_t> validity;
+    std::vector<int32_t> offsets;
+    std::vector<uint8_t> data;
+    std::vector<const void*> buffers;
+    std::vector<struct ArrowArray*> children;
+  };
+
+  struct schema_data {
+    std::string format;
+    std::string name;
+    std::vector<struct ArrowSchema*> children;
+  };
+
+  bool is_variable() const {
+    return((format_ == "u") || (format_ == "z") || (format_ == "+l"));
+  }
+
+  size_t fixed_width() const {
+    if ((format_ == "S") || (format_ == "s")) return(2);
+    if ((format_ == "I") || (format_ == "i")) return(4);
+    if ((format_ == "l") || (format_ == "g") || (format_.compare(0, 3, "tsn") == 0)) return(8);
+    return(0);
+  }
+
+  void set_valid(bool valid) {
+    if ((length_ % 8) == 0) validity_.push_back(0);
+    if (valid) {
+      validity_[length_ / 8] |= (uint8_t)(1 << (length_ % 8));
+    } else {
+      ++null_count_;
+    }
+    ++length_;
+  }
+
+  static void release_array(struct ArrowArray* array);
+  static void release_schema(struct ArrowSchema* schema);
+
+  std::string format_;
+  std::string name_;
+  bool nullable_;
+  int64_t length_;
+  int64_t null_count_;
+  std::vector<uint8_t> validity_;
+  std::vector<int32_t> offsets_;
+  std::vector<uint8_t> data_;
+  std::vector<std::unique_ptr<arrow_column>> children_;
+
+};
+
+// consumers may dereference buffers even for empty arrays
+static const uint64_t empty_buffer[1] = {0};
+
+void arrow_column::release_array(struct ArrowArray* array) {
+  array_data* d = (array_data*)array->private_data;
+  for (size_t i = 0; i < d->children.size(); ++i) {
+    if (d->children[i]->release) d->children[i]->release(d->children[i]);
+    delete d->children[i];
+  }
+  delete d;
+  array->release = 0;
+}
+
+void arrow_column::release_schema(struct ArrowSchema* schema) {
+  schema_data* d = (schema_data*)schema->private_data;
+  for (size_t i = 0; i < d->children.size(); ++i) {
+    if (d->children[i]->release) d->children[i]->release(d->children[i]);
+    delete d->children[i];
+  }
+  delete d;
+  schema->release = 0;
+}
+
+void arrow_column::export_to(struct ArrowSchema* schema, struct ArrowArray* array) {
+
+  schema_data* sd = new schema_data;
+  sd->format = format_;
+  sd->name = name_;
+
+  array_data* ad = new array_data;
+  ad->validity.swap(validity_);
+  ad->offsets.swap(offsets_);
+  ad->data.swap(data_);
+
+  ad->buffers.push_back(null_count_ ? (const void*)ad->validity.data() : 0);
+  if (is_variable()) ad->buffers.push_back(ad->offsets.data());
+  if ((format_ == "u") || (format_ == "z") || fixed_width()) {
+    ad->buffers.push_back(ad->data.empty() ? (const void*)empty_buffer : ad->data.data());
+  }
+
+  for (size_t i = 0; i < children_.size(); ++i) {
+    struct ArrowSchema* cs = new struct ArrowSchema;
+    struct ArrowArray* ca = new struct ArrowArray;
+    children_[i]->export_to(cs, ca);
+    sd->children.push_back(cs);
+    ad->children.push_back(ca);
+  }
+
+  schema->format = sd->format.c_str();
+  schema->name = sd->name.c_str();
+  schema->metadata = 0;
+  schema->flags = nullable_ ? ARROW_FLAG_NULLABLE : 0;
+  schema->n_children = (int64_t)sd->children.size();
+  schema->children = sd->children.empty() ? 0 : sd->children.data();
+  schema->dictionary = 0;
+  schema->release = release_schema;
+  schema->private_data = sd;
+
+  array->length = length_;
+  array->null_count = null_count_;
+  array->offset = 0;
+  array->n_buffers = (int64_t)ad->buffers.size();
+  array->n_children = (int64_t)ad->children.size();
+  array->buffers = ad->buffers.data();
+  array->children = ad->children.empty() ? 0 : ad->children.data();
+  array->dictionary = 0;
+  array->release = release_array;
+  array->private_data = ad;
+
+}
+
+// A/AAAA targets are kept formatted; turn them back into address bytes.
+static size_t address_bytes(const bnjr_record& rec, uint8_t* out) {
+  std::string host = rec.target.substr(0, rec.target.find('%'));
+  int family = (rec.rtype == MDNS_RECORDTYPE_AAAA) ? AF_INET6 : AF_INET;
+  if (inet_pton(family, host.c_str(), out) != 1) return(0);
+  return((family == AF_INET6) ? 16 : 4);
+}
+
+void bnjr_records_to_arrow(const std::vector<bnjr_record>& records, struct ArrowSchema* schema,
+                           struct ArrowArray* array) {
+
+  arrow_column batch("+s", "", false);
+
+  arrow_column* from_addr = batch.add_child("z", "from_addr", false);
+  arrow_column* from_port = batch.add_child("S", "from_port", false);
+  arrow_column* entry_type = batch.add_child("u", "entry_type", false);
+  arrow_column* name = batch.add_child("u", "name", false);
+  arrow_column* type = batch.add_child("u", "type", false);
+  arrow_column* rtype = batch.add_child("S", "rtype", false);
+  arrow_column* rclass = batch.add_child("S", "rclass", false);
+  arrow_column* ttl = batch.add_child("I", "ttl", false);
+  arrow_column* length = batch.add_child("I", "length", false);
+  arrow_column* target = batch.add_child("u", "target", true);
+  arrow_column* srv_priority = batch.add_child("S", "srv_priority", true);
+  arrow_column* srv_weight = batch.add_child("S", "srv_weight", true);
+  arrow_column* srv_port = batch.add_child("S", "srv_port", true);
+  arrow_column* addr = batch.add_child("z", "addr", true);
+  arrow_column* txt = batch.add_child("+l", "txt", true);
+  arrow_column* txt_item = txt->add_child("+s", "item", false);
+  arrow_column* txt_key = txt_item->add_child("u", "key", true);
+  arrow_column* txt_value = txt_item->add_child("z", "value", false);
+  arrow_column* iface = batch.add_child("u", "interface", true);
+  arrow_column* received = batch.add_child("tsn:UTC", "received", true);
+  arrow_column* latency = batch.add_child("g", "latency", true);
+  arrow_column* netns = batch.add_child("u", "netns", true);
+
+  char typebuf[8];
+
+  // records mostly come in on one or two interfaces: look each name up once
+  unsigned int last_ifindex = 0;
+  const bnjr_netns* last_netns = 0;
+  std::string last_ifname;
+
+  for (size_t i = 0; i < records.size(); ++i) {
+
+    const bnjr_record& rec = records[i];
+
+    if (rec.from.ss_family == AF_INET6) {
+      const struct sockaddr_in6* sa = (const struct sockaddr_in6*)&rec.from;
+      from_addr->append_bytes(&sa->sin6_addr, 16);
+      from_port->append<uint16_t>(ntohs(sa->sin6_port));
+    } else {
+      const struct sockaddr_in* sa = (const struct sockaddr_in*)&rec.from;
+      from_addr->append_bytes(&sa->sin_addr, 4);
+      from_port->append<uint16_t>(ntohs(sa->sin_port));
+    }
+
+    entry_type->append_string((rec.entry == MDNS_ENTRYTYPE_ANSWER) ? "answer" :
+                                ((rec.entry == MDNS_ENTRYTYPE_AUTHORITY) ? "authority" :
+                                   "additional"));
+    name->append_text(rec.name);
+
+    const char* tname;
+    switch (rec.rtype) {
+    case MDNS_RECORDTYPE_PTR: tname = "PTR"; break;
+    case MDNS_RECORDTYPE_SRV: tname = "SRV"; break;
+    case MDNS_RECORDTYPE_A: tname = "A"; break;
+    case MDNS_RECORDTYPE_AAAA: tname = "AAAA"; break;
+    case MDNS_RECORDTYPE_TXT: tname = "TXT"; break;
+    default:
+      snprintf(typebuf, sizeof(typebuf), "%u", (unsigned)rec.rtype);
+      tname = typebuf;
+    }
+    type->append_string(tname);
+
+    rtype->append<uint16_t>(rec.rtype);
+    rclass->append<uint16_t>(rec.rclass);
+    ttl->append<uint32_t>(rec.ttl);
+    length->append<uint32_t>((uint32_t)rec.length);
+
+    bool is_srv = (rec.rtype == MDNS_RECORDTYPE_SRV);
+
+    if ((rec.rtype == MDNS_RECORDTYPE_PTR) || is_srv) {
+      target->append_text(rec.target);
+    } else {
+      target->append_null();
+    }
+
+    if (is_srv) {
+      srv_priority->append<uint16_t>(rec.srv_priority);
+      srv_weight->append<uint16_t>(rec.srv_weight);
+      srv_port->append<uint16_t>(rec.srv_port);
+    } else {
+      srv_priority->append_null();
+      srv_weight->append_null();
+      srv_port->append_null();
+    }
+
+    uint8_t abuf[16];
+    size_t alen = ((rec.rtype == MDNS_RECORDTYPE_A) || (rec.rtype == MDNS_RECORDTYPE_AAAA)) ?
+      address_bytes(rec, abuf) : 0;
+    if (alen) {
+      addr->append_bytes(abuf, alen);
+    } else {
+      addr->append_null();
+    }
+
+    if (rec.rtype == MDNS_RECORDTYPE_TXT) {
+      for (size_t j = 0; j < rec.txt.size(); ++j) {
+        if (rec.txt[j].key.size()) {
+          txt_key->append_text(rec.txt[j].key);
+        } else {
+          txt_key->append_null();
+        }
+        txt_value->append_string(rec.txt[j].value);
+        txt_item->end_struct();
+      }
+      txt->end_list();
+    } else {
+      txt->append_null();
+    }
+
+    if (rec.ifindex) {
+      if ((rec.ifindex != last_ifindex) || (rec.netns != last_netns)) {
+        last_ifindex = rec.ifindex;
+        last_netns = rec.netns;
+        last_ifname = bnjr_interface_name(rec.netns, rec.ifindex);
+      }
+      iface->append_string(last_ifname);
+    } else {
+      iface->append_null();
+    }
+
+    if (rec.received_ns) {
+      received->append<int64_t>(rec.received_ns);
+    } else {
+      received->append_null();
+    }
+
+    if (rec.received_ns && rec.sent_ns) {
+      latency->append<double>((double)(rec.received_ns - rec.sent_ns) / 1e6);
+    } else {
+      latency->append_null();
+    }
+
+    if (rec.netns) {
+      netns->append_string(rec.netns->name());
+    } else {
+      netns->append_null();
+    }
+
+    batch.end_struct();
+
+  }
+
+  batch.export_to(schema, array);
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bonjour-record.h"
+
+// Arrow C data interface (https://arrow.apache.org/docs/format/CDataInterface.html)
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif
+
+// Export records as one Arrow record batch: a struct array with a row per
+// record and these children:
+//
+//   from_addr     binary (4 or 16 bytes)   from_port     uint16
+//   entry_type    utf8                     name          utf8 (owner name)
+//   type          utf8                     rtype         uint16
+//   rclass        uint16                   ttl           uint32
+//   length        uint32                   target        utf8 (PTR/SRV), null otherwise
+//   srv_priority  uint16 (SRV only)        srv_weight    uint16 (SRV only)
+//   srv_port      uint16 (SRV only)        addr          binary (A/AAAA only)
+//   txt           list<struct<key: utf8, value: binary>> (TXT only)
+//   interface     utf8, receiving interface (null when not known)
+//   received      timestamp[ns, UTC], when the datagram arrived
+//   latency       float64, milliseconds from our query to the answer
+//   netns         utf8, network namespace it was heard in (null for ours)
+//
+// The buffers are built once and handed over as they are; whoever imports
+// the structs owns them and must call their release callbacks.
+void bnjr_records_to_arrow(const std::vector<bnjr_record>& records, struct ArrowSchema* schema,
+                           struct ArrowArray* array);
+
+// An exported batch waiting for a consumer. move_to() hands both structs
+// over (the buffers stay where they are); anything never moved is released
+// with the holder.
+class bnjr_arrow_batch {
+
+public:
+
+  bnjr_arrow_batch() { schema.release = 0; array.release = 0; }
+
+  ~bnjr_arrow_batch() {
+    if (schema.release) schema.release(&schema);
+    if (array.release) array.release(&array);
+  }
+
+  bool moved() const { return(array.release == 0); }
+
+  void move_to(struct ArrowSchema* out_schema, struct ArrowArray* out_array) {
+    *out_schema = schema;
+    *out_array = array;
+    schema.release = 0;
+    array.release = 0;
+  }
+
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+
+private:
+
+  bnjr_arrow_batch(const bnjr_arrow_batch&);
+  bnjr_arrow_batch& operator=(const bnjr_arrow_batch&);
+
+};
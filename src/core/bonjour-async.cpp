@@ -0,0 +1,148 @@
+#include "bonjour-async.h"
+
+#include <chrono>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+// Never destroyed: a thread still running at exit mustn't be destroyed
+// joinable, and the process ending takes it down anyway.
+bnjr_async::registry& bnjr_async::threads() {
+  static registry* r = new registry;
+  return(*r);
+}
+
+bnjr_async::state::~state() {
+#ifndef _WIN32
+  if (fds[0] >= 0) close(fds[0]);
+  if (fds[1] >= 0) close(fds[1]);
+#endif
+}
+
+bnjr_async::bnjr_async(const bnjr_scan_spec& spec) : state_(std::make_shared<state>()) {
+
+#ifndef _WIN32
+  if (pipe(state_->fds) == 0) {
+    fcntl(state_->fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(state_->fds[1], F_SETFD, FD_CLOEXEC);
+  } else {
+    state_->fds[0] = state_->fds[1] = -1;
+  }
+#endif
+
+  bnjr_scan_spec run = spec;
+  if (!run.stop) run.stop = std::make_shared<std::atomic<bool>>(false);
+  state_->stop = run.stop;
+
+  std::shared_ptr<state> st = state_;
+
+  thread_ = std::thread([st, run]() {
+
+    bnjr_scan_result res;
+    bnjr_scan(run, res);
+
+    {
+      std::lock_guard<std::mutex> lock(st->m);
+      st->result = std::move(res);
+      st->finished = true;
+    }
+    st->cv.notify_all();
+
+#ifndef _WIN32
+    // never drained, so the read end stays readable from here on
+    if (st->fds[1] >= 0) {
+      char c = 1;
+      ssize_t n = write(st->fds[1], &c, 1);
+      (void)n;
+    }
+#endif
+
+  });
+
+  registry& reg = threads();
+  std::lock_guard<std::mutex> lock(reg.m);
+  reg.live.insert(this);
+
+}
+
+bnjr_async::~bnjr_async() {
+
+  registry& reg = threads();
+  std::lock_guard<std::mutex> lock(reg.m);
+  reg.live.erase(this);
+
+  if (!thread_.joinable()) return;
+
+  if (done()) {
+    thread_.join();
+    return;
+  }
+
+  // join the orphans that have finished since, so the list stays short
+  for (size_t i = 0; i < reg.orphans.size(); ) {
+    bool finished;
+    {
+      std::lock_guard<std::mutex> slock(reg.orphans[i].first->m);
+      finished = reg.orphans[i].first->finished;
+    }
+    if (finished) {
+      reg.orphans[i].second.join();
+      reg.orphans.erase(reg.orphans.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+
+  reg.orphans.push_back(std::make_pair(state_, std::move(thread_)));
+
+}
+
+void bnjr_async_shutdown() {
+
+  bnjr_async::registry& reg = bnjr_async::threads();
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  // cut every scan short first, so they wind down side by side
+  for (std::set<bnjr_async*>::iterator it = reg.live.begin(); it != reg.live.end(); ++it)
+    (*it)->state_->stop->store(true);
+  for (size_t i = 0; i < reg.orphans.size(); ++i) reg.orphans[i].first->stop->store(true);
+
+  for (std::set<bnjr_async*>::iterator it = reg.live.begin(); it != reg.live.end(); ++it) {
+    if ((*it)->thread_.joinable()) (*it)->thread_.join();
+  }
+
+  for (size_t i = 0; i < reg.orphans.size(); ++i) reg.orphans[i].second.join();
+  reg.orphans.clear();
+
+}
+
+bool bnjr_async::done() const {
+  std::lock_guard<std::mutex> lock(state_->m);
+  return(state_->finished);
+}
+
+bool bnjr_async::wait(double timeout) {
+  std::unique_lock<std::mutex> lock(state_->m);
+  if (timeout < 0) {
+    state_->cv.wait(lock, [this] { return(state_->finished); });
+  } else {
+    state_->cv.wait_for(lock, std::chrono::duration<double>(timeout),
+                        [this] { return(state_->finished); });
+  }
+  return(state_->finished);
+}
+
+int bnjr_async::fd() const {
+  return(state_->fds[0]);
+}
+
+bnjr_scan_result bnjr_async::collect() {
+  wait(-1);
+  if (thread_.joinable()) thread_.join();
+  std::lock_guard<std::mutex> lock(state_->m);
+  bnjr_scan_result out = std::move(state_->result);
+  state_->result = bnjr_scan_result();
+  return(out);
+}
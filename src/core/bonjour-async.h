@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bonjour-scan.h"
+
+// A scan running on a background thread. The R side holds this behind an
+// external pointer and polls, waits or watches fd() (which becomes readable
+// once the scan is over, for later::later_fd()).
+//
+// The worker thread only ever touches the shared state block, so if the R
+// handle is garbage collected mid-scan the thread is left to finish on its
+// own and the state is released by whichever side finishes last. Such
+// threads, and those of live handles, stay on a registry until joined:
+// bnjr_async_shutdown() stops and waits for all of them, so nothing is still
+// running when the code they run is unloaded.
+class bnjr_async {
+
+public:
+
+  explicit bnjr_async(const bnjr_scan_spec& spec);
+  ~bnjr_async();
+
+  bool done() const;
+
+  // Wait up to timeout seconds (< 0 waits forever); returns done().
+  bool wait(double timeout);
+
+  int fd() const;
+
+  // Blocks until done, then hands over the result. Subsequent calls return
+  // an empty result.
+  bnjr_scan_result collect();
+
+private:
+
+  struct state {
+    state() : finished(false) { fds[0] = fds[1] = -1; }
+    ~state();
+    std::mutex m;
+    std::condition_variable cv;
+    bool finished;
+    bnjr_scan_result result;
+    int fds[2];
+    std::shared_ptr<std::atomic<bool>> stop;   // the scan's, for shutting down early
+  };
+
+  std::shared_ptr<state> state_;
+  std::thread thread_;
+
+  // handles still alive, and the threads of those collected before their
+  // scan was over (with the state that says when it is)
+  struct registry {
+    std::mutex m;
+    std::set<bnjr_async*> live;
+    std::vector<std::pair<std::shared_ptr<state>, std::thread>> orphans;
+  };
+
+  static registry& threads();
+
+  friend void bnjr_async_shutdown();
+
+};
+
+// Stops and joins every scan thread still running (from the DLL unload hook).
+void bnjr_async_shutdown();
@@ -0,0 +1,118 @@
+#include "bonjour-bench.h"
+#include "bonjour-visit.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct bench_ctx {
+  bnjr_decoder decoder;
+  bnjr_record rec;
+  size_t records;
+  size_t ptrs;
+};
+
+static int decode_callback(int sock, const struct sockaddr* from, size_t addrlen,
+                           mdns_entry_type_t entry, uint16_t query_id, uint16_t rtype,
+                           uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                           size_t name_offset, size_t name_length, size_t record_offset,
+                           size_t record_length, void* user_data) {
+  bench_ctx* ctx = (bench_ctx*)user_data;
+  ctx->decoder.decode(from, addrlen, entry, rtype, rclass, ttl, data, size, name_offset,
+                      record_offset, record_length, ctx->rec);
+  ++ctx->records;
+  return 0;
+}
+
+static int ptr_callback(int sock, const struct sockaddr* from, size_t addrlen,
+                        mdns_entry_type_t entry, uint16_t query_id, uint16_t rtype,
+                        uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                        size_t name_offset, size_t name_length, size_t record_offset,
+                        size_t record_length, void* user_data) {
+  bench_ctx* ctx = (bench_ctx*)user_data;
+  ++ctx->records;
+  if (rtype == MDNS_RECORDTYPE_PTR) ++ctx->ptrs;
+  return 0;
+}
+
+struct count_sink {
+  size_t records;
+  void operator()(bnjr_record&) { ++records; }
+};
+
+class ptr_counter : public bnjr_visitor<ptr_counter> {
+public:
+  ptr_counter() : records(0), ptrs(0) {}
+  bool ptr(const bnjr_wire_record&) { ++records; ++ptrs; return(true); }
+  bool record(const bnjr_wire_record&) { ++records; return(true); }
+  size_t records;
+  size_t ptrs;
+};
+
+template <class F>
+static bnjr_bench_result timed(const char* method, const std::vector<bnjr_pcap_datagram>& dgrams,
+                               int passes, F decode) {
+
+  // copied into a receive buffer first, as a live scan would have it
+  std::unique_ptr<uint32_t[]> buffer(new uint32_t[65536 / 4]);
+
+  bnjr_bench_result out;
+  out.method = method;
+  out.seconds = 0;
+
+  // best of three, so whichever runs first doesn't pay for warming caches
+  for (int round = 0; round < 3; ++round) {
+    size_t records = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (int p = 0; p < passes; ++p) {
+      for (size_t i = 0; i < dgrams.size(); ++i) {
+        memcpy(buffer.get(), dgrams[i].payload, dgrams[i].length);
+        records += decode(dgrams[i], (const void*)buffer.get());
+      }
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    if (!round || (seconds < out.seconds)) out.seconds = seconds;
+    out.records = records;
+  }
+
+  return(out);
+
+}
+
+std::vector<bnjr_bench_result> bnjr_decode_bench(const std::vector<bnjr_pcap_datagram>& dgrams,
+                                                 int passes) {
+
+  std::vector<bnjr_bench_result> out;
+  std::unique_ptr<bench_ctx> ctx(new bench_ctx);
+
+  out.push_back(timed("callback", dgrams, passes,
+    [&](const bnjr_pcap_datagram& d, const void* buf) -> size_t {
+      return(mdns_message_parse(-1, (const struct sockaddr*)&d.from, d.addrlen, buf, d.length,
+                                decode_callback, ctx.get(), 0, -1));
+    }));
+
+  count_sink sink = { 0 };
+  bnjr_record_builder<count_sink> builder(ctx->decoder, sink);
+  out.push_back(timed("visitor", dgrams, passes,
+    [&](const bnjr_pcap_datagram& d, const void* buf) -> size_t {
+      builder.source((const struct sockaddr*)&d.from, d.addrlen);
+      return(bnjr_visit_message(builder, buf, d.length, 0, -1));
+    }));
+
+  out.push_back(timed("callback (PTR count)", dgrams, passes,
+    [&](const bnjr_pcap_datagram& d, const void* buf) -> size_t {
+      return(mdns_message_parse(-1, (const struct sockaddr*)&d.from, d.addrlen, buf, d.length,
+                                ptr_callback, ctx.get(), 0, -1));
+    }));
+
+  ptr_counter counter;
+  out.push_back(timed("visitor (PTR count)", dgrams, passes,
+    [&](const bnjr_pcap_datagram& d, const void* buf) -> size_t {
+      return(bnjr_visit_message(counter, buf, d.length, 0, -1));
+    }));
+
+  return(out);
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bonjour-pcap.h"
+
+typedef struct {
+  std::string method;
+  size_t records;     // records handed to the callback/visitor, all passes
+  double seconds;     // best of three runs
+} bnjr_bench_result;
+
+// Decode a corpus of datagrams `passes` times over with the callback parser
+// (mdns_message_parse() + a runtime rtype switch) and with the compile-time
+// visitor, both building full records and just counting PTR answers.
+std::vector<bnjr_bench_result> bnjr_decode_bench(const std::vector<bnjr_pcap_datagram>& dgrams,
+                                                 int passes);
@@ -0,0 +1,654 @@
+#include "bonjour-cache.h"
+#include "bonjour-iface.h"
+#include "bonjour-mmap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#define BNJR_CACHE_MAGIC "BNJRCACH"
+#define BNJR_CACHE_VERSION 1
+#define BNJR_CACHE_BYTE_ORDER 0x01020304U
+
+// On-disk layout (native byte order, flagged in the header):
+//
+//   header | entry[count] | string blob
+//
+// Entries are fixed size and refer into the blob by offset/length. TXT data
+// is stored in the blob as repeated (u16 key length, key, u16 value length,
+// value).
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t count;
+  uint32_t entry_size;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  int64_t saved_ms;
+} disk_header;
+
+typedef struct {
+  int64_t received_ms;
+  uint32_t ttl;
+  uint32_t length;
+  uint16_t rtype;
+  uint16_t rclass;
+  uint16_t srv_priority;
+  uint16_t srv_weight;
+  uint16_t srv_port;
+  uint16_t from_port;
+  uint16_t txt_count;
+  uint8_t entry;
+  uint8_t family;
+  uint8_t from_addr[16];
+  uint32_t name_off;
+  uint32_t name_len;
+  uint32_t target_off;
+  uint32_t target_len;
+  uint32_t txt_off;
+  uint32_t txt_len;
+} disk_entry;
+
+// records of one RRset received within this long of each other are kept
+// together when a cache-flush record arrives
+#define BNJR_CACHE_FLUSH_GRACE_MS 1000
+
+bnjr_cache::bnjr_cache() : seq_(0), generation_(0) { }
+
+int64_t bnjr_cache::now_ms() {
+  return(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::string bnjr_record_key(const bnjr_record& rec) {
+
+  std::string key;
+  key.reserve(rec.name.size() + rec.target.size() + 16);
+
+  for (size_t i = 0; i < rec.name.size(); ++i) key += (char)tolower((unsigned char)rec.name[i]);
+  key += '\0';
+  key += std::to_string(rec.rtype) + "/" + std::to_string(rec.rclass & 0x7FFF);
+  if (rec.netns) key += "@" + rec.netns->name();  // same name, another network
+  key += '\0';
+  key += rec.target;
+
+  if (rec.rtype == MDNS_RECORDTYPE_SRV) {
+    key += '\0' + std::to_string(rec.srv_port) + "/" + std::to_string(rec.srv_priority) +
+      "/" + std::to_string(rec.srv_weight);
+  }
+
+  for (size_t i = 0; i < rec.txt.size(); ++i) {
+    key += '\0';
+    key += rec.txt[i].key;
+    key += '=';
+    key += rec.txt[i].value;
+  }
+
+  return(key);
+
+}
+
+// The name/type/class prefix of a record key
+static std::string rrset_key(const std::string& key) {
+  size_t end = key.find('\0', key.find('\0') + 1);
+  return(key.substr(0, end));
+}
+
+const char* bnjr_change_name(bnjr_change_kind kind) {
+  switch (kind) {
+    case BNJR_CHANGE_ADDED: return("added");
+    case BNJR_CHANGE_REMOVED: return("removed");
+    case BNJR_CHANGE_UPDATED: return("updated");
+    case BNJR_CHANGE_EXPIRED: return("expired");
+  }
+  return("unknown");
+}
+
+// callers hold m_
+void bnjr_cache::log(bnjr_change_kind kind, const bnjr_record& rec, int64_t now) {
+  bnjr_cache_change c;
+  c.seq = ++seq_;
+  ++generation_;
+  c.kind = kind;
+  c.at_ms = now;
+  c.rec = rec;
+  log_.push_back(c);
+  if (log_.size() > BNJR_CACHE_LOG_LIMIT) log_.pop_front();
+}
+
+void bnjr_cache::link(const std::string& key) {
+  rrsets_[rrset_key(key)].push_back(key);
+}
+
+void bnjr_cache::schedule(const std::string& key, const bnjr_cache_entry& e) {
+  expiry_.push(deadline(e.received_ms + (int64_t)e.rec.ttl * 1000, key));
+}
+
+bnjr_cache::entry_map::iterator bnjr_cache::drop(entry_map::iterator it) {
+  auto set = rrsets_.find(rrset_key(it->first));
+  if (set != rrsets_.end()) {
+    std::vector<std::string>& keys = set->second;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (keys[i] == it->first) {
+        keys[i] = keys.back();
+        keys.pop_back();
+        break;
+      }
+    }
+    if (keys.empty()) rrsets_.erase(set);
+  }
+  return(entries_.erase(it));
+}
+
+static bool expired(const bnjr_cache_entry& e, int64_t now) {
+  return((now - e.received_ms) >= (int64_t)e.rec.ttl * 1000);
+}
+
+static uint32_t remaining_ttl(const bnjr_cache_entry& e, int64_t now) {
+  int64_t left = (int64_t)e.rec.ttl * 1000 - (now - e.received_ms);
+  return((left > 0) ? (uint32_t)((left + 999) / 1000) : 0);
+}
+
+void bnjr_cache::insert(const bnjr_record& rec, int64_t now) {
+
+  std::string key = bnjr_record_key(rec);
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  auto it = entries_.find(key);
+
+  if (rec.ttl == 0) {
+    if (it != entries_.end()) {
+      log(BNJR_CHANGE_REMOVED, it->second.rec, now);
+      drop(it);
+    }
+    return;
+  }
+
+  bool replaced = false;
+
+  // flushed whether or not this record is already cached: a host
+  // re-announcing the one address it has left must still flush the others
+  if (rec.rclass & MDNS_CACHE_FLUSH) {
+    auto set = rrsets_.find(rrset_key(key));
+    if (set != rrsets_.end()) {
+      std::vector<std::string> keys = set->second;
+      for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] == key) continue;
+        auto old = entries_.find(keys[i]);
+        if ((old == entries_.end()) ||
+            (now - old->second.received_ms <= BNJR_CACHE_FLUSH_GRACE_MS)) continue;
+        log(BNJR_CHANGE_REMOVED, old->second.rec, now);
+        drop(old);
+        replaced = true;
+      }
+    }
+  }
+
+  // same data again: a TTL refresh, only logged if it flushed others
+  if (it != entries_.end()) {
+    it->second.rec = rec;
+    it->second.received_ms = now;
+    schedule(key, it->second);
+    if (replaced) {
+      log(BNJR_CHANGE_UPDATED, rec, now);
+    } else {
+      ++generation_;
+    }
+    return;
+  }
+
+  bnjr_cache_entry& e = entries_[key];
+  e.rec = rec;
+  e.received_ms = now;
+  link(key);
+  schedule(key, e);
+
+  log(replaced ? BNJR_CHANGE_UPDATED : BNJR_CHANGE_ADDED, rec, now);
+
+}
+
+size_t bnjr_cache::expire(int64_t now) {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  size_t removed = 0;
+
+  while (!expiry_.empty() && (expiry_.top().first <= now)) {
+    auto it = entries_.find(expiry_.top().second);
+    expiry_.pop();
+    // gone already, or refreshed since this deadline was set
+    if ((it == entries_.end()) || !expired(it->second, now)) continue;
+    log(BNJR_CHANGE_EXPIRED, it->second.rec, now);
+    drop(it);
+    ++removed;
+  }
+
+  return(removed);
+
+}
+
+std::vector<bnjr_record> bnjr_cache::records(int64_t now) const {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  std::vector<bnjr_record> out;
+  out.reserve(entries_.size());
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (expired(it->second, now)) continue;
+    out.push_back(it->second.rec);
+    out.back().ttl = remaining_ttl(it->second, now);
+  }
+
+  return(out);
+
+}
+
+static bool name_equal(const std::string& a, const std::string& b) {
+  size_t la = a.size(), lb = b.size();
+  if (la && (a[la - 1] == '.')) --la;
+  if (lb && (b[lb - 1] == '.')) --lb;
+  if (la != lb) return(false);
+  for (size_t i = 0; i < la; ++i) {
+    if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return(false);
+  }
+  return(true);
+}
+
+std::vector<bnjr_record> bnjr_cache::known_answers(const std::string& name, uint16_t rtype,
+                                                   int64_t now, const bnjr_netns* netns) const {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  std::vector<bnjr_record> out;
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    const bnjr_cache_entry& e = it->second;
+    if ((e.rec.rtype != rtype) || (e.rec.netns != netns) || !name_equal(e.rec.name, name)) continue;
+    uint32_t left = remaining_ttl(e, now);
+    if ((uint64_t)left * 2 <= e.rec.ttl) continue;
+    out.push_back(e.rec);
+    out.back().ttl = left;
+  }
+
+  return(out);
+
+}
+
+std::vector<bnjr_record> bnjr_cache::find(const std::unordered_set<std::string>& names,
+                                          const std::vector<uint16_t>& rtypes,
+                                          int64_t now, const bnjr_netns* netns) const {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  std::vector<bnjr_record> out;
+
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    const bnjr_cache_entry& e = it->second;
+    if (e.rec.netns != netns) continue;
+    if (std::find(rtypes.begin(), rtypes.end(), e.rec.rtype) == rtypes.end()) continue;
+    if (expired(e, now) || !names.count(bnjr_name_key(e.rec.name))) continue;
+    out.push_back(e.rec);
+    out.back().ttl = remaining_ttl(e, now);
+  }
+
+  return(out);
+
+}
+
+size_t bnjr_cache::size() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return(entries_.size());
+}
+
+uint64_t bnjr_cache::sequence() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return(seq_);
+}
+
+uint64_t bnjr_cache::generation() const {
+  std::lock_guard<std::mutex> lock(m_);
+  return(generation_);
+}
+
+uint64_t bnjr_cache::changes(uint64_t since, std::vector<bnjr_cache_change>& out,
+                             bool& complete) const {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  complete = true;
+  if (since >= seq_) return(seq_);
+
+  // the log holds a contiguous run of sequence numbers ending at seq_
+  uint64_t first = log_.empty() ? seq_ + 1 : log_.front().seq;
+  if (since + 1 < first) {
+    complete = false;
+    since = first - 1;
+  }
+
+  out.insert(out.end(), log_.begin() + (size_t)(since + 1 - first), log_.end());
+
+  return(seq_);
+
+}
+
+static void blob_put(std::string& blob, const std::string& s, uint32_t& off, uint32_t& len) {
+  off = (uint32_t)blob.size();
+  len = (uint32_t)s.size();
+  blob += s;
+}
+
+static void blob_put16(std::string& blob, uint16_t v) {
+  blob.append((const char*)&v, sizeof(v));
+}
+
+// Append one record to the entry table and string blob of an image.
+static void put_entry(const bnjr_record& rec, int64_t received_ms, std::vector<disk_entry>& disk,
+                      std::string& blob) {
+
+  disk_entry d;
+  memset(&d, 0, sizeof(d));
+
+  d.received_ms = received_ms;
+  d.ttl = rec.ttl;
+  d.length = (uint32_t)rec.length;
+  d.rtype = rec.rtype;
+  d.rclass = rec.rclass;
+  d.srv_priority = rec.srv_priority;
+  d.srv_weight = rec.srv_weight;
+  d.srv_port = rec.srv_port;
+  d.entry = (uint8_t)rec.entry;
+
+  const struct sockaddr* from = (const struct sockaddr*)&rec.from;
+  if (from->sa_family == AF_INET6) {
+    const struct sockaddr_in6* sin6 = (const struct sockaddr_in6*)from;
+    d.family = 6;
+    memcpy(d.from_addr, &sin6->sin6_addr, 16);
+    d.from_port = ntohs(sin6->sin6_port);
+  } else if (from->sa_family == AF_INET) {
+    const struct sockaddr_in* sin = (const struct sockaddr_in*)from;
+    d.family = 4;
+    memcpy(d.from_addr, &sin->sin_addr, 4);
+    d.from_port = ntohs(sin->sin_port);
+  }
+
+  blob_put(blob, rec.name, d.name_off, d.name_len);
+  blob_put(blob, rec.target, d.target_off, d.target_len);
+
+  d.txt_off = (uint32_t)blob.size();
+  d.txt_count = (uint16_t)rec.txt.size();
+  for (size_t i = 0; i < rec.txt.size(); ++i) {
+    blob_put16(blob, (uint16_t)rec.txt[i].key.size());
+    blob += rec.txt[i].key;
+    blob_put16(blob, (uint16_t)rec.txt[i].value.size());
+    blob += rec.txt[i].value;
+  }
+  d.txt_len = (uint32_t)blob.size() - d.txt_off;
+
+  disk.push_back(d);
+
+}
+
+static std::string make_image(const std::vector<disk_entry>& disk, const std::string& blob) {
+
+  disk_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, BNJR_CACHE_MAGIC, 8);
+  h.version = BNJR_CACHE_VERSION;
+  h.byte_order = BNJR_CACHE_BYTE_ORDER;
+  h.count = (uint32_t)disk.size();
+  h.entry_size = sizeof(disk_entry);
+  h.strings_offset = sizeof(disk_header) + disk.size() * sizeof(disk_entry);
+  h.strings_size = blob.size();
+  h.saved_ms = bnjr_cache::now_ms();
+
+  std::string image;
+  image.reserve((size_t)h.strings_offset + blob.size());
+  image.append((const char*)&h, sizeof(h));
+  if (disk.size()) image.append((const char*)disk.data(), disk.size() * sizeof(disk_entry));
+  image += blob;
+
+  return(image);
+
+}
+
+std::string bnjr_cache::image() const {
+
+  std::vector<disk_entry> disk;
+  std::string blob;
+
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    disk.reserve(entries_.size());
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (!it->second.rec.netns) put_entry(it->second.rec, it->second.received_ms, disk, blob);
+    }
+  }
+
+  return(make_image(disk, blob));
+
+}
+
+std::string bnjr_cache_encode(const std::vector<bnjr_record>& records, int64_t now) {
+
+  std::vector<disk_entry> disk;
+  std::string blob;
+
+  disk.reserve(records.size());
+  for (size_t i = 0; i < records.size(); ++i) {
+    const bnjr_record& rec = records[i];
+    if (rec.netns) continue;  // the format has nowhere to say which one
+    put_entry(rec, rec.received_ns ? rec.received_ns / 1000000 : now, disk, blob);
+  }
+
+  return(make_image(disk, blob));
+
+}
+
+bool bnjr_cache::save(const std::string& path, std::string& err) const {
+
+  std::string img = image();
+
+  // write next to the target and rename so readers never see a torn file;
+  // records say what is on the network, so only the owner gets to read them
+  std::string tmp = path + ".tmp";
+
+#ifdef _WIN32
+  FILE* f = fopen(tmp.c_str(), "wb");
+#else
+  remove(tmp.c_str());
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+  FILE* f = (fd >= 0) ? fdopen(fd, "wb") : 0;
+  if (!f && (fd >= 0)) close(fd);
+#endif
+  if (!f) {
+    err = "cannot open '" + tmp + "' for writing";
+    return(false);
+  }
+
+  bool ok = (fwrite(img.data(), 1, img.size(), f) == img.size());
+  ok = (fclose(f) == 0) && ok;
+
+  if (!ok || (rename(tmp.c_str(), path.c_str()) != 0)) {
+    remove(tmp.c_str());
+    err = "failed writing cache file '" + path + "'";
+    return(false);
+  }
+
+  return(true);
+
+}
+
+static bool load_entries(const uint8_t* base, size_t size, int64_t now,
+                         std::vector<bnjr_cache_entry>& out, std::string& err) {
+
+  disk_header h;
+
+  if (size < sizeof(h)) {
+    err = "cache file is truncated";
+    return(false);
+  }
+
+  memcpy(&h, base, sizeof(h));
+
+  if (memcmp(h.magic, BNJR_CACHE_MAGIC, 8)) {
+    err = "not a bonjour cache file";
+    return(false);
+  }
+
+  if ((h.version != BNJR_CACHE_VERSION) || (h.byte_order != BNJR_CACHE_BYTE_ORDER) ||
+      (h.entry_size != sizeof(disk_entry))) {
+    err = "unsupported cache file version or byte order";
+    return(false);
+  }
+
+  // entries and strings must both lie inside the data; compared one at a
+  // time so a forged size can't wrap the sum around
+  if ((h.strings_offset != sizeof(h) + (uint64_t)h.count * sizeof(disk_entry)) ||
+      (h.strings_offset > size) || (h.strings_size > size - h.strings_offset)) {
+    err = "cache file is corrupt";
+    return(false);
+  }
+
+  const uint8_t* blob = base + h.strings_offset;
+  uint64_t blob_size = h.strings_size;
+
+  out.reserve(h.count);
+
+  for (uint32_t i = 0; i < h.count; ++i) {
+
+    disk_entry d;
+    memcpy(&d, base + sizeof(h) + (size_t)i * sizeof(disk_entry), sizeof(d));
+
+    if (((uint64_t)d.name_off + d.name_len > blob_size) ||
+        ((uint64_t)d.target_off + d.target_len > blob_size) ||
+        ((uint64_t)d.txt_off + d.txt_len > blob_size)) {
+      err = "cache file is corrupt";
+      return(false);
+    }
+
+    // skip what has already expired while we were away
+    if ((now - d.received_ms) >= (int64_t)d.ttl * 1000) continue;
+
+    bnjr_cache_entry e;
+    bnjr_record& rec = e.rec;
+
+    e.received_ms = d.received_ms;
+
+    memset(&rec.from, 0, sizeof(rec.from));
+    if (d.family == 6) {
+      struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&rec.from;
+      sin6->sin6_family = AF_INET6;
+      memcpy(&sin6->sin6_addr, d.from_addr, 16);
+      sin6->sin6_port = htons(d.from_port);
+      rec.addrlen = sizeof(struct sockaddr_in6);
+    } else {
+      struct sockaddr_in* sin = (struct sockaddr_in*)&rec.from;
+      sin->sin_family = AF_INET;
+      memcpy(&sin->sin_addr, d.from_addr, 4);
+      sin->sin_port = htons(d.from_port);
+      rec.addrlen = sizeof(struct sockaddr_in);
+    }
+
+    rec.entry = (mdns_entry_type_t)d.entry;
+    rec.rtype = d.rtype;
+    rec.rclass = d.rclass;
+    rec.ttl = d.ttl;
+    rec.length = d.length;
+    rec.srv_priority = d.srv_priority;
+    rec.srv_weight = d.srv_weight;
+    rec.srv_port = d.srv_port;
+    rec.ifindex = 0;
+    rec.netns = 0;
+    rec.received_ns = rec.sent_ns = 0;
+    rec.name.assign((const char*)blob + d.name_off, d.name_len);
+    rec.target.assign((const char*)blob + d.target_off, d.target_len);
+
+    const uint8_t* t = blob + d.txt_off;
+    const uint8_t* tend = t + d.txt_len;
+    for (uint16_t it = 0; it < d.txt_count; ++it) {
+      bnjr_txt txt;
+      uint16_t len;
+      if (t + 2 > tend) break;
+      memcpy(&len, t, 2);
+      t += 2;
+      if (t + len > tend) break;
+      txt.key.assign((const char*)t, len);
+      t += len;
+      if (t + 2 > tend) break;
+      memcpy(&len, t, 2);
+      t += 2;
+      if (t + len > tend) break;
+      txt.value.assign((const char*)t, len);
+      t += len;
+      rec.txt.push_back(txt);
+    }
+
+    out.push_back(e);
+
+  }
+
+  return(true);
+
+}
+
+bool bnjr_cache_decode(const uint8_t* data, size_t size, int64_t now,
+                       std::vector<bnjr_record>& out, std::string& err) {
+
+  std::vector<bnjr_cache_entry> entries;
+  if (!load_entries(data, size, now, entries, err)) return(false);
+
+  out.reserve(out.size() + entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    uint32_t left = remaining_ttl(entries[i], now);
+    out.push_back(std::move(entries[i].rec));
+    out.back().ttl = left;
+  }
+
+  return(true);
+
+}
+
+bool bnjr_cache::load(const std::string& path, int64_t now, std::string& err) {
+
+  std::vector<bnjr_cache_entry> loaded;
+
+  bnjr_mapped_file file;
+  if (!file.open(path, err)) return(false);
+
+  bool ok = load_entries(file.data(), file.size(), now, loaded, err);
+
+  file.close();
+
+  if (!ok) return(false);
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    std::string key = bnjr_record_key(loaded[i].rec);
+    auto it = entries_.find(key);
+    // never let an older on-disk copy replace something fresher
+    if (it == entries_.end()) {
+      entries_[key] = loaded[i];
+      link(key);
+      schedule(key, loaded[i]);
+      log(BNJR_CHANGE_ADDED, loaded[i].rec, now);
+    } else if (it->second.received_ms < loaded[i].received_ms) {
+      it->second = loaded[i];
+      schedule(key, loaded[i]);
+      ++generation_;
+    }
+  }
+
+  return(true);
+
+}
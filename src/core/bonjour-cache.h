@@ -0,0 +1,148 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "bonjour-record.h"
+
+// TTL-aware record cache shared between scans (and R) behind a mutex.
+//
+// Records are keyed on owner name (case-insensitive), type, class and rdata,
+// so the same record heard on several interfaces/families is stored once. A
+// record arriving with TTL 0 is a goodbye and evicts its entry.
+//
+// Every change to the live set is appended to a sequence-numbered change log
+// so consumers can poll for "what happened since sequence N" instead of
+// diffing snapshots. A unique (cache-flush) record, new or refreshed, replaces
+// other data for the same name/type/class that is more than a second old
+// (RFC 6762 10.2): the replaced records are logged as removed, the new one as
+// updated.
+//
+// The cache can be written to a compact binary file and loaded back with a
+// single mmap(); TTLs are stored with their wall-clock receive time so the
+// remaining lifetime is recomputed on load and stale records are dropped.
+
+typedef struct {
+  bnjr_record rec;      // rec.ttl is the TTL as received
+  int64_t received_ms;  // wall clock (ms since the epoch)
+} bnjr_cache_entry;
+
+typedef enum {
+  BNJR_CHANGE_ADDED = 0,
+  BNJR_CHANGE_REMOVED = 1,   // goodbye (TTL 0) or replaced by a cache-flush record
+  BNJR_CHANGE_UPDATED = 2,   // new data replacing older records for the same name/type
+  BNJR_CHANGE_EXPIRED = 3
+} bnjr_change_kind;
+
+typedef struct {
+  uint64_t seq;
+  bnjr_change_kind kind;
+  int64_t at_ms;
+  bnjr_record rec;
+} bnjr_cache_change;
+
+const char* bnjr_change_name(bnjr_change_kind kind);
+
+// changes kept for pollers before the oldest are dropped
+#define BNJR_CACHE_LOG_LIMIT 65536
+
+class bnjr_cache {
+
+public:
+
+  bnjr_cache();
+
+  static int64_t now_ms();
+
+  void insert(const bnjr_record& rec, int64_t now);
+
+  // Drop expired entries; returns how many were removed. Only the entries
+  // that are due are looked at, so polling it is cheap however big the
+  // cache is.
+  size_t expire(int64_t now);
+
+  // Live records with ttl rewritten to the remaining lifetime.
+  std::vector<bnjr_record> records(int64_t now) const;
+
+  // Records for name/rtype that still have more than half their TTL left,
+  // i.e. the ones RFC 6762 7.1 allows in a query's known-answer section.
+  // Only those heard in netns: answers from one namespace mean nothing on
+  // another's links.
+  std::vector<bnjr_record> known_answers(const std::string& name, uint16_t rtype,
+                                         int64_t now, const bnjr_netns* netns = 0) const;
+
+  // Live records of any of rtypes whose owner name is in names (as
+  // bnjr_name_key() makes them) and that were heard in netns, in a single
+  // pass over the cache.
+  std::vector<bnjr_record> find(const std::unordered_set<std::string>& names,
+                                const std::vector<uint16_t>& rtypes, int64_t now,
+                                const bnjr_netns* netns = 0) const;
+
+  size_t size() const;
+
+  // Sequence number of the latest change (0 before the first one).
+  uint64_t sequence() const;
+
+  // Bumped by every change including TTL refreshes (which the log leaves
+  // out), for writers of snapshots that must stay current.
+  uint64_t generation() const;
+
+  // Append the changes with seq > since to out and return the current
+  // sequence. complete is false when some of those changes have already been
+  // dropped from the log (the caller should re-read records()).
+  uint64_t changes(uint64_t since, std::vector<bnjr_cache_change>& out, bool& complete) const;
+
+  // The file image save() writes (header, entries, strings) as one buffer.
+  // The format has no namespace field, so records heard in other network
+  // namespaces stay out of it.
+  std::string image() const;
+
+  bool save(const std::string& path, std::string& err) const;
+  bool load(const std::string& path, int64_t now, std::string& err);
+
+private:
+
+  typedef std::unordered_map<std::string, bnjr_cache_entry> entry_map;
+
+  typedef std::pair<int64_t, std::string> deadline;
+
+  void log(bnjr_change_kind kind, const bnjr_record& rec, int64_t now);
+  void link(const std::string& key);
+  void schedule(const std::string& key, const bnjr_cache_entry& e);
+  entry_map::iterator drop(entry_map::iterator it);
+
+  mutable std::mutex m_;
+  entry_map entries_;
+
+  // when each entry runs out, soonest first. Refreshed and dropped entries
+  // leave their old deadline behind; expire() skips those when they come up.
+  std::priority_queue<deadline, std::vector<deadline>, std::greater<deadline>> expiry_;
+
+  // keys of the entries sharing each name/type/class, for cache-flush
+  std::unordered_map<std::string, std::vector<std::string>> rrsets_;
+
+  std::deque<bnjr_cache_change> log_;
+  uint64_t seq_;
+  uint64_t generation_;
+
+};
+
+// The same image for a plain list of records, e.g. to hand a scan result to
+// another process; records without a receive time count as received at now.
+// Like image(), it only holds records from our own namespace.
+std::string bnjr_cache_encode(const std::vector<bnjr_record>& records, int64_t now);
+
+// Live records of an image (a mapped cache file or an encoded result), ttl
+// rewritten to the remaining lifetime. The interface and timing columns
+// aren't part of the format and come back empty.
+bool bnjr_cache_decode(const uint8_t* data, size_t size, int64_t now,
+                       std::vector<bnjr_record>& out, std::string& err);
+
+// Identity of a record for caching/dedup purposes (not for display).
+std::string bnjr_record_key(const bnjr_record& rec);
@@ -0,0 +1,533 @@
+#include "bonjour-daemon.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#ifndef _WIN32
+#  include <sys/select.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#endif
+
+// requests are one short line; anything longer is garbage
+#define BNJR_DAEMON_MAX_REQUEST 1024
+
+// connections served at once; more are turned away
+#define BNJR_DAEMON_MAX_CLIENTS 64
+
+// longest scan a client can ask for (seconds)
+#define BNJR_DAEMON_MAX_SCAN 300
+
+// how long a client gets to send its request / take our reply
+#define BNJR_DAEMON_IO_MS 5000
+
+// accept loop wakeup, for noticing stop() and writing snapshots
+#define BNJR_DAEMON_IDLE_MS 250
+
+// snapshots are rewritten at most this often (except right after a scan)
+#define BNJR_DAEMON_SNAPSHOT_MS 1000
+
+#ifdef MSG_NOSIGNAL
+#  define BNJR_SEND_FLAGS MSG_NOSIGNAL
+#else
+#  define BNJR_SEND_FLAGS 0
+#endif
+
+#ifndef _WIN32
+
+static bool unix_address(const std::string& path, struct sockaddr_un& addr, std::string& err) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || (path.size() >= sizeof(addr.sun_path))) {
+    err = "socket path '" + path + "' is empty or too long";
+    return(false);
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return(true);
+}
+
+// Whether the other end of a connected socket runs as our user. The socket
+// file's mode keeps other users out of a daemon's socket, but a client must
+// not believe a daemon someone else planted at the path it was given.
+static bool same_user(int fd) {
+
+#if defined(SO_PEERCRED)
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return(false);
+  return(cred.uid == geteuid());
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(fd, &uid, &gid) != 0) return(false);
+  return(uid == geteuid());
+#endif
+
+}
+
+// A client that goes away mid-reply must not take the process down with
+// SIGPIPE (MSG_NOSIGNAL where there is one, SO_NOSIGPIPE on macOS).
+static void stream_options(int fd, int timeout_ms) {
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+  struct timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+}
+
+static bool send_all(int fd, const char* data, size_t size) {
+  while (size) {
+    ssize_t n = send(fd, data, size, BNJR_SEND_FLAGS);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n <= 0) return(false);
+    data += n;
+    size -= (size_t)n;
+  }
+  return(true);
+}
+
+static bool send_all(int fd, const std::string& s) {
+  return(send_all(fd, s.data(), s.size()));
+}
+
+#endif
+
+bnjr_daemon::bnjr_daemon() : listener_(-1), stop_(false), snapshot_gen_(0), snapshot_ms_(0) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bnjr_daemon::~bnjr_daemon() {
+  stop();
+}
+
+bool bnjr_daemon::start(const bnjr_daemon_spec& spec, std::string& err) {
+
+#ifdef _WIN32
+
+  (void)spec;
+  err = "the discovery daemon needs Unix domain sockets";
+  return(false);
+
+#else
+
+  if (running()) {
+    err = "daemon is already running";
+    return(false);
+  }
+
+  struct sockaddr_un addr;
+  if (!unix_address(spec.socket_path, addr, err)) return(false);
+
+  struct stat st;
+  if (lstat(spec.socket_path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      err = "'" + spec.socket_path + "' exists and is not a socket";
+      return(false);
+    }
+    // someone still answering there, or left over from a daemon that died?
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool live = (probe >= 0) && (connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    if (probe >= 0) close(probe);
+    if (live) {
+      err = "a daemon is already listening on '" + spec.socket_path + "'";
+      return(false);
+    }
+    unlink(spec.socket_path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err = std::string("Failed to open daemon socket: ") + strerror(errno);
+    return(false);
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  if ((bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+      (chmod(spec.socket_path.c_str(), 0600) != 0) || (listen(fd, 64) != 0)) {
+    err = "Failed to listen on '" + spec.socket_path + "': " + strerror(errno);
+    close(fd);
+    unlink(spec.socket_path.c_str());
+    return(false);
+  }
+
+  spec_ = spec;
+  if (!spec_.scan.cache) spec_.scan.cache = std::make_shared<bnjr_cache>();
+  spec_.scan.hosts.reset();
+  spec_.scan.priority = BNJR_PRIORITY_INTERACTIVE;  // there's always a client waiting
+
+  // pick up where an earlier daemon left off; a missing snapshot is fine
+  if (spec_.snapshot_path.size()) {
+    std::string ignored;
+    spec_.scan.cache->load(spec_.snapshot_path, bnjr_cache::now_ms(), ignored);
+  }
+
+  snapshot_gen_ = (uint64_t)-1;   // write one straight away
+  snapshot_ms_ = 0;
+  memset(&stats_, 0, sizeof(stats_));
+
+  listener_ = fd;
+  stop_.store(false);
+  thread_ = std::thread(&bnjr_daemon::serve, this);
+
+  return(true);
+
+#endif
+
+}
+
+void bnjr_daemon::stop() {
+
+#ifndef _WIN32
+
+  if (!running()) return;
+
+  stop_.store(true);
+  if (thread_.joinable()) thread_.join();
+
+  close(listener_);
+  listener_ = -1;
+  unlink(spec_.socket_path.c_str());
+
+#endif
+
+}
+
+bnjr_daemon_stats bnjr_daemon::stats() const {
+  std::lock_guard<std::mutex> lock(stats_m_);
+  return(stats_);
+}
+
+#ifndef _WIN32
+
+void bnjr_daemon::serve() {
+
+  while (!stop_.load()) {
+
+    for (auto it = clients_.begin(); it != clients_.end(); ) {
+      if ((*it)->done.load()) {
+        (*it)->thread.join();
+        it = clients_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    fd_set readfs;
+    FD_ZERO(&readfs);
+    FD_SET(listener_, &readfs);
+
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = BNJR_DAEMON_IDLE_MS * 1000;
+
+    int res = select(listener_ + 1, &readfs, 0, 0, &timeout);
+    if ((res < 0) && (errno != EINTR)) break;
+
+    if ((res > 0) && FD_ISSET(listener_, &readfs)) {
+
+      int fd = accept(listener_, 0, 0);
+
+      if (fd >= 0) {
+
+        stream_options(fd, BNJR_DAEMON_IO_MS);
+
+        bool busy = (clients_.size() >= BNJR_DAEMON_MAX_CLIENTS);
+        bool stranger = !same_user(fd);
+
+        {
+          std::lock_guard<std::mutex> lock(stats_m_);
+          ++stats_.clients;
+          if (busy || stranger) ++stats_.errors;
+        }
+
+        if (stranger) {
+          close(fd);
+        } else if (busy) {
+          send_all(fd, std::string("ERR too many clients\n"));
+          close(fd);
+        } else {
+          std::unique_ptr<client> c(new client);
+          c->fd = fd;
+          c->done.store(false);
+          c->thread = std::thread(&bnjr_daemon::handle, this, c.get());
+          clients_.push_back(std::move(c));
+        }
+
+      }
+
+    }
+
+    snapshot(false);
+
+  }
+
+  for (auto it = clients_.begin(); it != clients_.end(); ++it) (*it)->thread.join();
+  clients_.clear();
+
+  snapshot(true);
+
+}
+
+void bnjr_daemon::handle(client* c) {
+
+  std::string request;
+  char buf[256];
+
+  while (request.find('\n') == std::string::npos) {
+    ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n <= 0) break;
+    request.append(buf, (size_t)n);
+    if (request.size() > BNJR_DAEMON_MAX_REQUEST) break;
+  }
+
+  std::string err;
+  size_t eol = request.find_first_of("\r\n");
+
+  if ((eol == std::string::npos) || !answer(c->fd, request.substr(0, eol), err)) {
+    if (err.empty()) err = "incomplete request";
+    send_all(c->fd, "ERR " + err + "\n");
+    std::lock_guard<std::mutex> lock(stats_m_);
+    ++stats_.errors;
+  }
+
+  close(c->fd);
+  c->done.store(true);
+
+}
+
+bool bnjr_daemon::answer(int fd, const std::string& request, std::string& err) {
+
+  std::istringstream in(request);
+  std::string verb, format, name;
+  int seconds = 0;
+
+  in >> verb;
+  if (verb == "records") {
+    in >> format;
+  } else if ((verb == "discover") || (verb == "query")) {
+    in >> seconds >> format;
+    if (verb == "query") std::getline(in >> std::ws, name);
+  } else {
+    err = "unknown request '" + verb + "'";
+    return(false);
+  }
+
+  if ((format != "json") && (format != "cache")) {
+    err = "format must be 'json' or 'cache'";
+    return(false);
+  }
+
+  if ((verb != "records") && ((seconds <= 0) || (seconds > BNJR_DAEMON_MAX_SCAN))) {
+    err = "scan time must be 1-" + std::to_string(BNJR_DAEMON_MAX_SCAN) + " seconds";
+    return(false);
+  }
+
+  if ((verb == "query") && name.empty()) {
+    err = "no name to query";
+    return(false);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stats_m_);
+    ++stats_.requests;
+  }
+
+  std::vector<bnjr_record> own;
+  const std::vector<bnjr_record>* records = &own;
+  std::shared_ptr<job> j;
+
+  if (verb == "records") {
+    int64_t now = bnjr_cache::now_ms();
+    spec_.scan.cache->expire(now);
+    own = spec_.scan.cache->records(now);
+  } else {
+    j = scan((verb == "discover") ? BNJR_SCAN_DISCOVER : BNJR_SCAN_QUERY, name, seconds);
+    if (j->result.error.size()) {
+      err = j->result.error;
+      return(false);
+    }
+    records = &j->result.records;   // shared, read-only from here on
+  }
+
+  std::string body = (format == "json") ? bnjr_records_to_ndjson(*records) :
+    bnjr_cache_encode(*records, bnjr_cache::now_ms());
+
+  // the client may have given up; nothing more to do about it either way
+  if (send_all(fd, "OK " + std::to_string(records->size()) + "\n")) send_all(fd, body);
+
+  return(true);
+
+}
+
+std::shared_ptr<bnjr_daemon::job> bnjr_daemon::scan(bnjr_scan_mode mode, const std::string& query,
+                                                   int scan_time) {
+
+  std::string key = std::to_string((int)mode) + "/" + std::to_string(scan_time) + "/" +
+    bnjr_name_key(query);
+
+  std::shared_ptr<job> j;
+  bool mine = false;
+
+  {
+    std::lock_guard<std::mutex> lock(jobs_m_);
+    std::shared_ptr<job>& slot = jobs_[key];
+    if (!slot) {
+      slot = std::make_shared<job>();
+      mine = true;
+    }
+    j = slot;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stats_m_);
+    ++(mine ? stats_.scans : stats_.shared);
+  }
+
+  if (!mine) {
+    std::unique_lock<std::mutex> lock(j->m);
+    j->cv.wait(lock, [&j] { return(j->finished); });
+    return(j);
+  }
+
+  bnjr_scan_spec spec = spec_.scan;
+  spec.mode = mode;
+  spec.query = query;
+  spec.scan_time = scan_time;
+
+  bnjr_scan_result result;
+  bnjr_scan(spec, result);
+
+  // requests arriving from now on start a fresh scan
+  {
+    std::lock_guard<std::mutex> lock(jobs_m_);
+    jobs_.erase(key);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(j->m);
+    j->result = std::move(result);
+    j->finished = true;
+  }
+  j->cv.notify_all();
+
+  // so a client reading the snapshot next sees what its scan found
+  snapshot(true);
+
+  return(j);
+
+}
+
+void bnjr_daemon::snapshot(bool force) {
+
+  if (spec_.snapshot_path.empty()) return;
+
+  std::lock_guard<std::mutex> lock(snapshot_m_);
+
+  int64_t now = bnjr_cache::now_ms();
+  if (!force && (now - snapshot_ms_ < BNJR_DAEMON_SNAPSHOT_MS)) return;
+  snapshot_ms_ = now;
+
+  bnjr_cache& cache = *spec_.scan.cache;
+  cache.expire(now);
+
+  uint64_t generation = cache.generation();
+  if (generation == snapshot_gen_) return;
+
+  std::string err;
+  bool ok = cache.save(spec_.snapshot_path, err);
+  if (ok) snapshot_gen_ = generation;
+
+  std::lock_guard<std::mutex> stats_lock(stats_m_);
+  ++(ok ? stats_.snapshots : stats_.errors);
+
+}
+
+#endif
+
+bool bnjr_daemon_request(const std::string& socket_path, const std::string& request,
+                         int timeout_ms, std::string& body, std::string& err) {
+
+#ifdef _WIN32
+
+  (void)socket_path; (void)request; (void)timeout_ms; (void)body;
+  err = "the discovery daemon needs Unix domain sockets";
+  return(false);
+
+#else
+
+  struct sockaddr_un addr;
+  if (!unix_address(socket_path, addr, err)) return(false);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    err = std::string("Failed to open socket: ") + strerror(errno);
+    return(false);
+  }
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    err = "no daemon listening on '" + socket_path + "'";
+    return(false);
+  }
+
+  if (!same_user(fd)) {
+    close(fd);
+    err = "the daemon on '" + socket_path + "' belongs to another user";
+    return(false);
+  }
+
+  stream_options(fd, timeout_ms);
+
+  std::string reply;
+  bool ok = send_all(fd, request + "\n");
+
+  char buf[65536];
+  while (ok) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if ((n < 0) && (errno == EINTR)) continue;
+    if (n < 0) {
+      err = "timed out waiting for the daemon";
+      ok = false;
+    }
+    if (n <= 0) break;
+    reply.append(buf, (size_t)n);
+  }
+
+  close(fd);
+
+  if (!ok) {
+    if (err.empty()) err = "lost the connection to the daemon";
+    return(false);
+  }
+
+  size_t eol = reply.find('\n');
+  if (eol == std::string::npos) {
+    err = "the daemon closed the connection without answering";
+    return(false);
+  }
+
+  if (!reply.compare(0, 3, "OK ")) {
+    body.assign(reply, eol + 1, std::string::npos);
+    return(true);
+  }
+
+  err = reply.compare(0, 4, "ERR ") ? "unexpected reply from the daemon" :
+    reply.substr(4, eol - 4);
+
+  return(false);
+
+#endif
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "bonjour-scan.h"
+
+// Local discovery daemon: one process owns the mDNS sockets and the record
+// cache and runs scans for other processes on the same host, which ask over
+// a Unix domain socket instead of each scanning the network themselves.
+//
+// A request is one line, answered by a status line and the body, after which
+// the daemon closes the connection:
+//
+//   discover <seconds> <format>
+//   query <seconds> <format> <name>
+//   records <format>                 (what the cache holds, no scan)
+//
+//   -> "OK <records>\n" body    or    "ERR <message>\n"
+//
+// The body is NDJSON for format "json" (so `nc -U` or any language can use
+// it) or a cache file image for "cache" (bnjr_cache_decode()). Requests for
+// the same scan while one is already running share it: ten workers asking for
+// _http._tcp at once put one query on the wire and all get its answer. Every
+// scan goes through the daemon's cache, so known-answer suppression keeps
+// repeated scans quiet too.
+//
+// The cache is also published as a snapshot file in the usual cache format,
+// rewritten (write and rename) after each scan and whenever the cache has
+// changed or expired entries, at most once a second. Readers map it with no
+// round trip at all; TTLs are recomputed from the stored receive times, so a
+// snapshot never hands out a stale record.
+typedef struct {
+  std::string socket_path;
+  std::string snapshot_path;    // "" for none
+  bnjr_scan_spec scan;          // interfaces, sockets and cache for every scan
+} bnjr_daemon_spec;
+
+typedef struct {
+  uint64_t clients;             // connections accepted
+  uint64_t requests;            // well-formed requests
+  uint64_t scans;               // scans actually run
+  uint64_t shared;              // requests answered by joining a running scan
+  uint64_t snapshots;           // snapshot files written
+  uint64_t errors;              // bad requests, failed scans, refused clients
+} bnjr_daemon_stats;
+
+class bnjr_daemon {
+
+public:
+
+  bnjr_daemon();
+  ~bnjr_daemon();
+
+  // Fails if something is already listening on the socket path; a stale
+  // socket file left by a daemon that died is replaced. Records in an
+  // existing snapshot are loaded into the cache first.
+  bool start(const bnjr_daemon_spec& spec, std::string& err);
+
+  // Waits for requests in progress (at most their scan time) and removes the
+  // socket file; the snapshot is left for readers.
+  void stop();
+
+  bool running() const { return(listener_ >= 0); }
+
+  bnjr_daemon_stats stats() const;
+
+private:
+
+  // one scan and everyone waiting on it
+  struct job {
+    job() : finished(false) { }
+    std::mutex m;
+    std::condition_variable cv;
+    bool finished;
+    bnjr_scan_result result;
+  };
+
+  struct client {
+    int fd;
+    std::atomic<bool> done;
+    std::thread thread;
+  };
+
+  bnjr_daemon(const bnjr_daemon&);
+  bnjr_daemon& operator=(const bnjr_daemon&);
+
+  void serve();
+  void handle(client* c);
+  bool answer(int fd, const std::string& request, std::string& err);
+  std::shared_ptr<job> scan(bnjr_scan_mode mode, const std::string& query, int scan_time);
+  void snapshot(bool force);
+
+  bnjr_daemon_spec spec_;
+  int listener_;
+  std::thread thread_;
+  std::atomic<bool> stop_;
+
+  std::list<std::unique_ptr<client>> clients_;   // only touched by serve()
+
+  std::mutex jobs_m_;
+  std::unordered_map<std::string, std::shared_ptr<job>> jobs_;
+
+  std::mutex snapshot_m_;
+  uint64_t snapshot_gen_;       // cache generation the snapshot was written at
+  int64_t snapshot_ms_;
+
+  mutable std::mutex stats_m_;
+  bnjr_daemon_stats stats_;
+
+};
+
+// Send one request line to a daemon and read its reply body. Returns false
+// with err set if the daemon can't be reached, times out (timeout_ms) or
+// answers with an error.
+bool bnjr_daemon_request(const std::string& socket_path, const std::string& request,
+                         int timeout_ms, std::string& body, std::string& err);
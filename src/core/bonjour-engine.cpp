@@ -0,0 +1,169 @@
+#include "bonjour-engine.h"
+#include "bonjour-iface.h"
+#include "bonjour-visit.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#ifndef _WIN32
+#  include <sys/select.h>
+#endif
+
+// how often workers look at the stop flag, when there is one
+#define BNJR_ENGINE_STOP_MS 100
+
+bnjr_engine::bnjr_engine(const int* sockets, const int* query_ids, int num_sockets,
+                         bnjr_scan_mode mode, const bnjr_filter* filter) :
+  sockets_(sockets, sockets + num_sockets), query_ids_(num_sockets, 0),
+  iface_ids_(num_sockets, 0), mode_(mode), filter_((filter && !filter->empty()) ? filter : 0),
+  cache_(0), hosts_(0), recorder_(0), netns_(0), traffic_(0), stop_(0), active_(0),
+  datagrams_(0) {
+
+  if (query_ids) query_ids_.assign(query_ids, query_ids + num_sockets);
+
+}
+
+void bnjr_engine::set_recorder(bnjr_recorder* recorder, const int* iface_ids) {
+  recorder_ = recorder;
+  if (iface_ids) iface_ids_.assign(iface_ids, iface_ids + sockets_.size());
+}
+
+void bnjr_engine::queue_sink::operator()(bnjr_record& rec) {
+  rec.ifindex = ctx->ifindex;
+  rec.received_ns = ctx->received_ns;
+  rec.netns = ctx->engine->netns_;
+  ctx->engine->queue_.push(std::move(rec));
+}
+
+void bnjr_engine::worker(worker_ctx* ctx, int scan_time) {
+
+  size_t capacity = 2048;
+  std::unique_ptr<char[]> buffer(new char[capacity]);
+
+  // rejected records never get decoded; the walk moves on by offset
+  queue_sink sink = { ctx };
+  bnjr_record_builder<queue_sink> builder(ctx->decoder, sink, filter_);
+
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::seconds(scan_time);
+
+  for (;;) {
+
+    if (stop_ && stop_->load(std::memory_order_relaxed)) break;
+
+    int64_t left = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline - std::chrono::steady_clock::now()).count();
+    if (left <= 0) break;
+
+    // with a stop flag to watch, wake up now and then to look at it
+    if (stop_) left = std::min(left, (int64_t)BNJR_ENGINE_STOP_MS * 1000);
+
+    struct timeval timeout;
+    timeout.tv_sec = (long)(left / 1000000);
+    timeout.tv_usec = (long)(left % 1000000);
+
+    fd_set readfs;
+    FD_ZERO(&readfs);
+    FD_SET(ctx->sock, &readfs);
+
+    int res = select(ctx->sock + 1, &readfs, 0, 0, &timeout);
+    if (res < 0 && errno == EINTR) continue;
+    if (res < 0) break;
+    if (res == 0) continue;
+
+    // a quiet socket ends the scan, a busy one keeps it going; listening
+    // always ends on time
+    if (mode_ != BNJR_SCAN_LISTEN)
+      deadline = std::chrono::steady_clock::now() + std::chrono::seconds(scan_time);
+
+    // receive here rather than in mdns_*_recv() so the recorder sees the
+    // datagram exactly as it arrived, before any parsing
+    struct sockaddr_storage from;
+    socklen_t addrlen = sizeof(from);
+    bnjr_recv_info info;
+    memset(&from, 0, sizeof(from));
+    int ret = bnjr_recv_datagram(ctx->sock, buffer.get(), capacity, &from, &addrlen, &info);
+    if (ret <= 0) continue;
+
+    ctx->ifindex = info.ifindex;
+    ctx->received_ns = info.received_ns ? info.received_ns : bnjr_wall_ns();
+
+    datagrams_.fetch_add(1, std::memory_order_relaxed);
+
+    if (recorder_) {
+      recorder_->record(ctx->iface_id, (const struct sockaddr*)&from, addrlen,
+                        buffer.get(), (size_t)ret);
+    }
+
+    if (traffic_) {
+      traffic_->observe((const struct sockaddr*)&from, addrlen, buffer.get(), (size_t)ret,
+                        ctx->received_ns);
+    }
+
+    builder.source((const struct sockaddr*)&from, addrlen);
+
+    if (mode_ == BNJR_SCAN_LISTEN) {
+      continue;
+    } else if (mode_ == BNJR_SCAN_DISCOVER) {
+      bnjr_visit_discovery(builder, buffer.get(), (size_t)ret);
+    } else {
+      bnjr_visit_message(builder, buffer.get(), (size_t)ret, ctx->query_id, 1);
+    }
+
+  }
+
+  active_.fetch_sub(1, std::memory_order_release);
+
+}
+
+std::vector<bnjr_record> bnjr_engine::run(int scan_time) {
+
+  std::vector<bnjr_record> out;
+
+  int num_sockets = (int)sockets_.size();
+
+  std::vector<std::unique_ptr<worker_ctx>> ctxs;
+  std::vector<std::thread> workers;
+
+  active_.store(num_sockets);
+
+  for (int isock = 0; isock < num_sockets; ++isock) {
+    ctxs.emplace_back(new worker_ctx());
+    ctxs.back()->engine = this;
+    ctxs.back()->sock = sockets_[isock];
+    ctxs.back()->query_id = query_ids_[isock];
+    ctxs.back()->iface_id = iface_ids_[isock];
+    workers.emplace_back(&bnjr_engine::worker, this, ctxs.back().get(), scan_time);
+  }
+
+  // aggregator: drain until every worker has exited and the queue is empty
+
+  bnjr_record rec;
+
+  for (;;) {
+    bool done = (active_.load(std::memory_order_acquire) == 0);
+    bool got = false;
+    while (queue_.pop(rec)) {
+      if (cache_) cache_->insert(rec, bnjr_cache::now_ms());
+      if (hosts_) {
+        hosts_->add(rec);
+      } else if (sink_) {
+        sink_(rec);
+      } else {
+        out.push_back(std::move(rec));
+      }
+      got = true;
+    }
+    if (done && queue_.empty()) break;
+    if (!got) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+  return(out);
+
+}
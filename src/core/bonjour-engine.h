@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "bonjour-cache.h"
+#include "bonjour-filter.h"
+#include "bonjour-hosts.h"
+#include "bonjour-queue.h"
+#include "bonjour-record.h"
+#include "bonjour-recorder.h"
+#include "bonjour-traffic.h"
+
+typedef enum {
+  BNJR_SCAN_DISCOVER = 0,
+  BNJR_SCAN_QUERY = 1,
+  BNJR_SCAN_LISTEN = 2      // ask nothing, decode nothing: traffic analytics only
+} bnjr_scan_mode;
+
+// Threaded receive engine. One worker thread per socket (i.e. per interface
+// address, or per family with family sockets) blocks on its own descriptor,
+// notes the ingress interface, decodes whatever arrives and pushes
+// finished records onto a lock-free queue. The thread that calls run() is the
+// only consumer and is the only one that touches the result vector, so callers
+// on the R main thread never race the workers.
+//
+// A worker stops once its socket has been quiet for scan_time seconds, which
+// matches the old single select() loop that restarted its timeout after every
+// datagram. Listening workers stop scan_time seconds after the start however
+// busy the network is. Either kind stops early once a stop flag is set.
+class bnjr_engine {
+
+public:
+
+  // sockets/query_ids are borrowed; the caller still owns and closes them.
+  // query_ids may be null (discovery) or hold one id per socket. filter may be
+  // null; otherwise it must outlive run().
+  bnjr_engine(const int* sockets, const int* query_ids, int num_sockets, bnjr_scan_mode mode,
+              const bnjr_filter* filter = 0);
+
+  // Optional cache the aggregator updates as records arrive (borrowed).
+  void set_cache(bnjr_cache* cache) { cache_ = cache; }
+
+  // Optional per-host aggregation (borrowed). Records go into the table
+  // instead of the result, so run() returns nothing when it's set.
+  void set_hosts(bnjr_host_table* hosts) { hosts_ = hosts; }
+
+  // Network namespace the sockets live in (0 = ours), stamped on every
+  // record before the cache or host table sees it.
+  void set_netns(const bnjr_netns* netns) { netns_ = netns; }
+
+  // Optional traffic analytics (borrowed), fed every datagram before it is
+  // parsed.
+  void set_traffic(bnjr_traffic* traffic) { traffic_ = traffic; }
+
+  // Optional raw datagram recorder (borrowed) and its interface id for each
+  // socket.
+  void set_recorder(bnjr_recorder* recorder, const int* iface_ids);
+
+  // Optional stop flag (borrowed): once it is set the workers give up within
+  // BNJR_ENGINE_STOP_MS and run() returns what came in so far.
+  void set_stop(const std::atomic<bool>* stop) { stop_ = stop; }
+
+  // Optional consumer for records as they arrive, called on the thread that
+  // runs run(). Records go to it instead of the result (a host table still
+  // comes first).
+  void set_sink(const std::function<void(bnjr_record&)>& sink) { sink_ = sink; }
+
+  // Blocks until every worker has gone quiet, then returns the records in
+  // arrival order.
+  std::vector<bnjr_record> run(int scan_time);
+
+  int datagrams() const { return(datagrams_.load()); }
+
+private:
+
+  struct worker_ctx {
+    bnjr_engine* engine;
+    int sock;
+    int query_id;
+    int iface_id;
+    unsigned int ifindex;   // ingress interface of the datagram being parsed
+    int64_t received_ns;    // and its receive timestamp
+    bnjr_decoder decoder;
+  };
+
+  // where the worker's record builder puts finished records
+  struct queue_sink {
+    worker_ctx* ctx;
+    void operator()(bnjr_record& rec);
+  };
+
+  void worker(worker_ctx* ctx, int scan_time);
+
+  std::vector<int> sockets_;
+  std::vector<int> query_ids_;
+  std::vector<int> iface_ids_;
+  bnjr_scan_mode mode_;
+  const bnjr_filter* filter_;
+  bnjr_cache* cache_;
+  bnjr_host_table* hosts_;
+  bnjr_recorder* recorder_;
+  const bnjr_netns* netns_;
+  bnjr_traffic* traffic_;
+  const std::atomic<bool>* stop_;
+  std::function<void(bnjr_record&)> sink_;
+
+  bnjr_mpsc_queue<bnjr_record> queue_;
+  std::atomic<int> active_;
+  std::atomic<int> datagrams_;
+
+};
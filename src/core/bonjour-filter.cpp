@@ -0,0 +1,251 @@
+#include "bonjour-filter.h"
+
+#include <cctype>
+#include <cstring>
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#endif
+
+bnjr_filter::bnjr_filter() : has_rtypes_(false), has_sections_(false), sections_(0) { }
+
+void bnjr_filter::add_rtype(uint16_t rtype) {
+  has_rtypes_ = true;
+  rtypes_.set(rtype);
+}
+
+void bnjr_filter::add_section(mdns_entry_type_t entry) {
+  has_sections_ = true;
+  sections_ |= (1U << (unsigned)entry);
+}
+
+bool bnjr_filter::add_name(const std::string& pattern, std::string& err) {
+
+  if (pattern.empty()) {
+    err = "empty name pattern";
+    return(false);
+  }
+
+  name_pattern p;
+  p.glob = (pattern.find_first_of("*?") != std::string::npos);
+
+  for (size_t i = 0; i < pattern.size(); ++i) p.text += (char)tolower((unsigned char)pattern[i]);
+
+  if (p.glob) {
+    if ((p.text[p.text.size() - 1] != '.') && (p.text[p.text.size() - 1] != '*')) p.text += '.';
+  } else {
+    size_t start = 0;
+    while (start <= p.text.size()) {
+      size_t dot = p.text.find('.', start);
+      if (dot == std::string::npos) dot = p.text.size();
+      if (dot > start) p.labels.push_back(p.text.substr(start, dot - start));
+      start = dot + 1;
+    }
+    if (p.labels.empty()) {
+      err = "name pattern '" + pattern + "' has no labels";
+      return(false);
+    }
+  }
+
+  names_.push_back(p);
+
+  return(true);
+
+}
+
+bool bnjr_filter::add_source(const std::string& cidr, std::string& err) {
+  bnjr_cidr net;
+  if (!bnjr_parse_cidr(cidr, net)) {
+    err = "invalid address or CIDR '" + cidr + "'";
+    return(false);
+  }
+  sources_.push_back(net);
+  return(true);
+}
+
+bool bnjr_filter::accept_source(const struct sockaddr* from) const {
+  if (sources_.empty()) return(true);
+  for (size_t i = 0; i < sources_.size(); ++i) {
+    if (bnjr_cidr_contains(sources_[i], from)) return(true);
+  }
+  return(false);
+}
+
+bool bnjr_filter::accept(const struct sockaddr* from, mdns_entry_type_t entry, uint16_t rtype,
+                         const void* data, size_t size, size_t name_offset) const {
+
+  if (has_sections_ && !(sections_ & (1U << (unsigned)entry))) return(false);
+  if (has_rtypes_ && !rtypes_.test(rtype)) return(false);
+  if (!accept_source(from)) return(false);
+  if (!names_.empty() && !accept_name(data, size, name_offset)) return(false);
+
+  return(true);
+
+}
+
+// Collect (offset, length) of each label of the name at ofs, following
+// compression pointers. Returns the label count or -1 on malformed names.
+static int wire_labels(const uint8_t* buf, size_t size, size_t ofs,
+                       size_t* lofs, uint8_t* llen, int max_labels) {
+
+  int n = 0;
+  int hops = 0;
+
+  while (ofs < size) {
+    uint8_t len = buf[ofs];
+    if (!len) return(n);
+    if ((len & 0xC0) == 0xC0) {
+      if ((ofs + 1 >= size) || (++hops > MDNS_MAX_NAME_HOPS)) return(-1);
+      ofs = ((size_t)(len & 0x3F) << 8) | buf[ofs + 1];
+      continue;
+    }
+    if ((len & 0xC0) || (ofs + 1 + len > size) || (n == max_labels)) return(-1);
+    lofs[n] = ofs + 1;
+    llen[n] = len;
+    ++n;
+    ofs += 1 + (size_t)len;
+  }
+
+  return(-1);
+
+}
+
+static bool label_equal(const uint8_t* wire, size_t len, const std::string& lower) {
+  if (len != lower.size()) return(false);
+  for (size_t i = 0; i < len; ++i) {
+    if (tolower(wire[i]) != (unsigned char)lower[i]) return(false);
+  }
+  return(true);
+}
+
+bool bnjr_glob_match(const char* pat, const char* str) {
+  const char* star = 0;
+  const char* resume = 0;
+  while (*str) {
+    if ((*pat == '?') || (*pat == *str)) {
+      ++pat;
+      ++str;
+    } else if (*pat == '*') {
+      star = pat++;
+      resume = str;
+    } else if (star) {
+      pat = star + 1;
+      str = ++resume;
+    } else {
+      return(false);
+    }
+  }
+  while (*pat == '*') ++pat;
+  return(*pat == 0);
+}
+
+bool bnjr_filter::accept_name(const void* data, size_t size, size_t name_offset) const {
+
+  const uint8_t* buf = (const uint8_t*)data;
+
+  size_t lofs[MDNS_MAX_LABELS];
+  uint8_t llen[MDNS_MAX_LABELS];
+
+  int n = wire_labels(buf, size, name_offset, lofs, llen, MDNS_MAX_LABELS);
+  if (n < 0) return(false);
+
+  char text[MDNS_MAX_LABELS * 64 + 1];
+  bool have_text = false;
+
+  for (size_t ip = 0; ip < names_.size(); ++ip) {
+
+    const name_pattern& p = names_[ip];
+
+    if (!p.glob) {
+
+      int k = (int)p.labels.size();
+      if (k > n) continue;
+      bool ok = true;
+      for (int i = 0; ok && (i < k); ++i) {
+        ok = label_equal(buf + lofs[n - k + i], llen[n - k + i], p.labels[i]);
+      }
+      if (ok) return(true);
+
+    } else {
+
+      if (!have_text) {
+        char* dst = text;
+        for (int i = 0; i < n; ++i) {
+          for (size_t c = 0; c < llen[i]; ++c) *dst++ = (char)tolower(buf[lofs[i] + c]);
+          *dst++ = '.';
+        }
+        *dst = 0;
+        have_text = true;
+      }
+      if (bnjr_glob_match(p.text.c_str(), text)) return(true);
+
+    }
+
+  }
+
+  return(false);
+
+}
+
+bool bnjr_parse_cidr(const std::string& spec, bnjr_cidr& out) {
+
+  memset(&out, 0, sizeof(out));
+
+  std::string addr = spec;
+  int prefix = -1;
+
+  size_t slash = spec.find('/');
+  if (slash != std::string::npos) {
+    addr = spec.substr(0, slash);
+    std::string bits = spec.substr(slash + 1);
+    if (bits.empty() || (bits.find_first_not_of("0123456789") != std::string::npos)) return(false);
+    prefix = atoi(bits.c_str());
+  }
+
+  if (inet_pton(AF_INET, addr.c_str(), out.addr) == 1) {
+    out.family = AF_INET;
+    if (prefix < 0) prefix = 32;
+    if (prefix > 32) return(false);
+  } else if (inet_pton(AF_INET6, addr.c_str(), out.addr) == 1) {
+    out.family = AF_INET6;
+    if (prefix < 0) prefix = 128;
+    if (prefix > 128) return(false);
+  } else {
+    return(false);
+  }
+
+  out.prefix = prefix;
+
+  return(true);
+
+}
+
+static bool prefix_equal(const uint8_t* a, const uint8_t* b, int prefix) {
+  int bytes = prefix / 8;
+  int bits = prefix % 8;
+  if (memcmp(a, b, (size_t)bytes)) return(false);
+  if (!bits) return(true);
+  uint8_t mask = (uint8_t)(0xFF << (8 - bits));
+  return((a[bytes] & mask) == (b[bytes] & mask));
+}
+
+bool bnjr_cidr_contains(const bnjr_cidr& net, const struct sockaddr* addr) {
+
+  if (addr->sa_family == AF_INET) {
+    const struct sockaddr_in* sin = (const struct sockaddr_in*)addr;
+    if (net.family != AF_INET) return(false);
+    return(prefix_equal(net.addr, (const uint8_t*)&sin->sin_addr, net.prefix));
+  }
+
+  if (addr->sa_family == AF_INET6) {
+    const struct sockaddr_in6* sin6 = (const struct sockaddr_in6*)addr;
+    const uint8_t* a6 = (const uint8_t*)&sin6->sin6_addr;
+    if (net.family == AF_INET6) return(prefix_equal(net.addr, a6, net.prefix));
+    // v4-mapped sources still match v4 networks
+    static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF};
+    if (!memcmp(a6, mapped, 12)) return(prefix_equal(net.addr, a6 + 12, net.prefix));
+  }
+
+  return(false);
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+#include <vector>
+
+#include "mdns.h"
+
+// Record predicates pushed down into the receive workers. Everything here is
+// evaluated on the raw wire data (header fields and name offsets handed over
+// by mdns_records_parse) so a rejected record is skipped before any string
+// extraction, address formatting or allocation happens.
+//
+// Built once per scan and then only read, so workers share a single instance.
+
+typedef struct {
+  int family;       // AF_INET / AF_INET6
+  uint8_t addr[16];
+  int prefix;
+} bnjr_cidr;
+
+class bnjr_filter {
+
+public:
+
+  bnjr_filter();
+
+  // add_name()/add_source() return false (and set err) on a malformed spec.
+  void add_rtype(uint16_t rtype);
+  void add_section(mdns_entry_type_t entry);
+  bool add_name(const std::string& pattern, std::string& err);
+  bool add_source(const std::string& cidr, std::string& err);
+
+  bool empty() const { return(!has_rtypes_ && !has_sections_ && names_.empty() && sources_.empty()); }
+
+  // Cheapest checks first: header fields, then source address, then a walk
+  // over the owner name labels.
+  bool accept(const struct sockaddr* from, mdns_entry_type_t entry, uint16_t rtype,
+              const void* data, size_t size, size_t name_offset) const;
+
+  bool accept_source(const struct sockaddr* from) const;
+
+private:
+
+  typedef struct {
+    bool glob;
+    std::vector<std::string> labels;   // lower-cased, for suffix matches
+    std::string text;                  // lower-cased, for glob matches
+  } name_pattern;
+
+  bool accept_name(const void* data, size_t size, size_t name_offset) const;
+
+  bool has_rtypes_;
+  bool has_sections_;
+  std::bitset<65536> rtypes_;
+  unsigned sections_;
+  std::vector<name_pattern> names_;
+  std::vector<bnjr_cidr> sources_;
+
+};
+
+// Parse "a.b.c.d[/n]" or "v6addr[/n]".
+bool bnjr_parse_cidr(const std::string& spec, bnjr_cidr& out);
+
+bool bnjr_cidr_contains(const bnjr_cidr& net, const struct sockaddr* addr);
+
+// Shell-style '*' / '?' match (case-sensitive; callers lower-case both sides
+// when they need otherwise).
+bool bnjr_glob_match(const char* pat, const char* str);
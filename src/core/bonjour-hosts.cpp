@@ -0,0 +1,192 @@
+#include "bonjour-hosts.h"
+#include "bonjour-iface.h"
+
+#include <algorithm>
+
+static const char services_key[] = "_services._dns-sd._udp.local";
+
+template <class T>
+static void add_unique(std::vector<T>& v, const T& x) {
+  if (std::find(v.begin(), v.end(), x) == v.end()) v.push_back(x);
+}
+
+// Key prefix keeping each namespace's names and addresses apart.
+static std::string scope(const bnjr_netns* netns) {
+  return(netns ? netns->name() + '\0' : std::string());
+}
+
+size_t bnjr_host_table::address_node(const std::string& address, const bnjr_netns* netns) {
+  std::string label = address.substr(0, address.find('%'));
+  auto ins = keys_.insert(std::make_pair(scope(netns) + "a:" + label, nodes_.size()));
+  if (ins.second) {
+    node n = { nodes_.size(), false, label, netns, {}, { {}, 0, 0, 0 } };
+    nodes_.push_back(n);
+  }
+  return(ins.first->second);
+}
+
+size_t bnjr_host_table::name_node(const std::string& name, const bnjr_netns* netns) {
+  auto ins = keys_.insert(std::make_pair(scope(netns) + "n:" + bnjr_name_key(name), nodes_.size()));
+  if (ins.second) {
+    node n = { nodes_.size(), true, name, netns, {}, { {}, 0, 0, 0 } };
+    nodes_.push_back(n);
+  }
+  return(ins.first->second);
+}
+
+size_t bnjr_host_table::find(size_t n) {
+  while (nodes_[n].parent != n) {
+    nodes_[n].parent = nodes_[nodes_[n].parent].parent;  // path halving
+    n = nodes_[n].parent;
+  }
+  return(n);
+}
+
+void bnjr_host_table::unite(size_t a, size_t b) {
+  a = find(a);
+  b = find(b);
+  if (a != b) nodes_[std::max(a, b)].parent = std::min(a, b);  // oldest node stays the root
+}
+
+void bnjr_host_table::credit(tally& t, const bnjr_record& rec) {
+  ++t.records;
+  if (rec.ifindex) add_unique(t.ifindexes, rec.ifindex);
+  if (rec.received_ns) {
+    if (!t.first_ns || (rec.received_ns < t.first_ns)) t.first_ns = rec.received_ns;
+    if (rec.received_ns > t.last_ns) t.last_ns = rec.received_ns;
+  }
+}
+
+void bnjr_host_table::merge(bnjr_host& h, const tally& t) {
+  for (size_t i = 0; i < t.ifindexes.size(); ++i) add_unique(h.ifindexes, t.ifindexes[i]);
+  h.records += t.records;
+  if (t.first_ns && (!h.first_ns || (t.first_ns < h.first_ns))) h.first_ns = t.first_ns;
+  if (t.last_ns > h.last_ns) h.last_ns = t.last_ns;
+}
+
+bnjr_host_table::service& bnjr_host_table::service_for(const std::string& instance,
+                                                       size_t sender,
+                                                       const bnjr_netns* netns) {
+  auto ins = service_keys_.insert(std::make_pair(scope(netns) + bnjr_name_key(instance),
+                                                 services_.size()));
+  if (ins.second) {
+    service s;
+    s.svc.name = instance;
+    s.svc.port = s.svc.priority = s.svc.weight = 0;
+    s.owner = sender;
+    s.seen.records = 0;
+    s.seen.first_ns = s.seen.last_ns = 0;
+    services_.push_back(s);
+  }
+  return(services_[ins.first->second]);
+}
+
+void bnjr_host_table::add(const bnjr_record& rec) {
+
+  if (!rec.ttl) return;
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  ++records_;
+
+  std::string from = bnjr_address_key((const struct sockaddr*)&rec.from, rec.addrlen);
+  size_t sender = address_node(from, rec.netns);
+
+  switch (rec.rtype) {
+
+  case MDNS_RECORDTYPE_A:
+  case MDNS_RECORDTYPE_AAAA: {
+    size_t host = name_node(rec.name, rec.netns);
+    unite(host, address_node(rec.target, rec.netns));
+    credit(nodes_[host].seen, rec);
+    return;
+  }
+
+  case MDNS_RECORDTYPE_SRV: {
+    service& s = service_for(rec.name, sender, rec.netns);
+    s.svc.target = rec.target;
+    s.svc.port = rec.srv_port;
+    s.svc.priority = rec.srv_priority;
+    s.svc.weight = rec.srv_weight;
+    s.owner = name_node(rec.target, rec.netns);
+    credit(s.seen, rec);
+    return;
+  }
+
+  case MDNS_RECORDTYPE_TXT: {
+    service& s = service_for(rec.name, sender, rec.netns);
+    s.svc.txt = rec.txt;
+    credit(s.seen, rec);
+    return;
+  }
+
+  case MDNS_RECORDTYPE_PTR: {
+    if (bnjr_name_key(rec.name) == services_key) {
+      add_unique(nodes_[sender].types, rec.target);
+      credit(nodes_[sender].seen, rec);
+      return;
+    }
+    service& s = service_for(rec.target, sender, rec.netns);
+    s.svc.type = rec.name;
+    credit(s.seen, rec);
+    return;
+  }
+
+  }
+
+  credit(nodes_[sender].seen, rec);
+
+}
+
+void bnjr_host_table::add(const std::vector<bnjr_record>& records) {
+  for (size_t i = 0; i < records.size(); ++i) add(records[i]);
+}
+
+std::vector<bnjr_host> bnjr_host_table::hosts() {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  // every root gets a slot; only the ones with records are kept at the end
+  std::vector<size_t> slot(nodes_.size(), (size_t)-1);
+  std::vector<bnjr_host> out;
+
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    size_t root = find(i);
+    if (slot[root] == (size_t)-1) {
+      slot[root] = out.size();
+      bnjr_host h;
+      h.records = 0;
+      h.first_ns = h.last_ns = 0;
+      h.netns = nodes_[root].netns;
+      out.push_back(h);
+    }
+    bnjr_host& h = out[slot[root]];
+    const node& nd = nodes_[i];
+    if (nd.is_name) {
+      h.hostnames.push_back(nd.label);
+    } else {
+      h.addresses.push_back(nd.label);
+    }
+    for (size_t t = 0; t < nd.types.size(); ++t) add_unique(h.types, nd.types[t]);
+    merge(h, nd.seen);
+  }
+
+  for (size_t i = 0; i < services_.size(); ++i) {
+    bnjr_host& h = out[slot[find(services_[i].owner)]];
+    h.services.push_back(services_[i].svc);
+    merge(h, services_[i].seen);
+  }
+
+  std::vector<bnjr_host> kept;
+  kept.reserve(out.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    if (out[i].records) kept.push_back(std::move(out[i]));
+  }
+
+  std::stable_sort(kept.begin(), kept.end(), [](const bnjr_host& a, const bnjr_host& b) {
+    return(a.records > b.records);
+  });
+
+  return(kept);
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bonjour-record.h"
+
+// Device-level view of a record stream: one entry per responding host with
+// its addresses, hostnames, service instances and TXT data, built as records
+// arrive instead of pivoting the flat result afterwards.
+//
+// Hosts are the connected groups of two kinds of key, joined as records
+// link them:
+//
+//   A / AAAA   hostname  <->  address
+//   SRV        instance   ->  target hostname
+//   PTR, TXT   instance   ->  the host its SRV names, or else whoever sent it
+//
+// so a host answering over IPv4 and IPv6, under several names, comes out as
+// one entry, while a sleep proxy answering for others doesn't swallow them
+// (records are credited to the name they are about, not to the sender).
+// Records nothing ties to a name stay with the responder's address.
+// Keys are per network namespace: the same address or hostname heard in two
+// namespaces belongs to two different hosts.
+
+typedef struct {
+  std::string name;              // instance, e.g. "Office._ipp._tcp.local."
+  std::string type;              // "_ipp._tcp.local.", when a PTR named it
+  std::string target;            // SRV target host
+  uint16_t port;
+  uint16_t priority;
+  uint16_t weight;
+  std::vector<bnjr_txt> txt;     // latest TXT record
+} bnjr_host_service;
+
+typedef struct {
+  std::vector<std::string> hostnames;
+  std::vector<std::string> addresses;
+  std::vector<bnjr_host_service> services;
+  std::vector<std::string> types;       // from service type enumeration
+  std::vector<unsigned int> ifindexes;  // interfaces its records came in on
+  size_t records;
+  int64_t first_ns;                     // receive times, 0 = unknown
+  int64_t last_ns;
+  const bnjr_netns* netns;              // namespace it was heard in, 0 = ours
+} bnjr_host;
+
+// Safe to feed from several threads (parallel scans share one table).
+class bnjr_host_table {
+
+public:
+
+  bnjr_host_table() : records_(0) {}
+
+  // Goodbye records (TTL 0) are ignored.
+  void add(const bnjr_record& rec);
+  void add(const std::vector<bnjr_record>& records);
+
+  // Hosts with at least one record credited to them, most records first.
+  std::vector<bnjr_host> hosts();
+
+  size_t records() const { return(records_); }
+
+private:
+
+  // records credited to a node or service
+  struct tally {
+    std::vector<unsigned int> ifindexes;
+    size_t records;
+    int64_t first_ns;
+    int64_t last_ns;
+  };
+
+  struct node {
+    size_t parent;
+    bool is_name;
+    std::string label;                  // hostname or address as first seen
+    const bnjr_netns* netns;
+    std::vector<std::string> types;
+    tally seen;
+  };
+
+  // A service's records count for whichever host owns it once the scan is
+  // over, so a PTR arriving ahead of its SRV isn't left with the sender.
+  struct service {
+    bnjr_host_service svc;
+    size_t owner;                       // SRV target's node, else the first sender's
+    tally seen;
+  };
+
+  size_t address_node(const std::string& address, const bnjr_netns* netns);
+  size_t name_node(const std::string& name, const bnjr_netns* netns);
+  size_t find(size_t n);
+  void unite(size_t a, size_t b);
+  static void credit(tally& t, const bnjr_record& rec);
+  static void merge(bnjr_host& h, const tally& t);
+  service& service_for(const std::string& instance, size_t sender, const bnjr_netns* netns);
+
+  std::mutex m_;
+  std::unordered_map<std::string, size_t> keys_;      // "a:" address / "n:" name key, after the scope
+  std::vector<node> nodes_;
+  std::unordered_map<std::string, size_t> service_keys_;
+  std::vector<service> services_;
+  size_t records_;
+
+};
@@ -0,0 +1,855 @@
+// IPV6_RECVPKTINFO on macOS
+#define __APPLE_USE_RFC_3542
+
+#include "bonjour-iface.h"
+#include "bonjour-record.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#  include <iphlpapi.h>
+#else
+#  include <netdb.h>
+#  include <ifaddrs.h>
+#  include <net/if.h>
+#  include <fcntl.h>
+#  include <cerrno>
+#  ifdef IP_RECVIF
+#    include <net/if_dl.h>
+#  endif
+#endif
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+bool bnjr_iface_select::add(match_set& set, const std::string& spec, std::string& err) {
+
+  if (spec.empty()) {
+    err = "empty interface specification";
+    return(false);
+  }
+
+  if (spec.find_first_not_of("0123456789") == std::string::npos) {
+    set.indexes.push_back((unsigned int)strtoul(spec.c_str(), 0, 10));
+    return(true);
+  }
+
+  bnjr_cidr net;
+  if (bnjr_parse_cidr(spec, net)) {
+    set.nets.push_back(net);
+    return(true);
+  }
+
+  if (spec.find('/') != std::string::npos) {
+    err = "invalid CIDR block '" + spec + "'";
+    return(false);
+  }
+
+  set.names.push_back(spec);
+
+  return(true);
+
+}
+
+bool bnjr_iface_select::matches(const match_set& set, const char* ifname, unsigned int ifindex,
+                                const struct sockaddr* addr) {
+
+  for (size_t i = 0; i < set.indexes.size(); ++i) {
+    if (set.indexes[i] == ifindex) return(true);
+  }
+
+  if (ifname) {
+    for (size_t i = 0; i < set.names.size(); ++i) {
+      if (bnjr_glob_match(set.names[i].c_str(), ifname)) return(true);
+    }
+  }
+
+  for (size_t i = 0; i < set.nets.size(); ++i) {
+    if (bnjr_cidr_contains(set.nets[i], addr)) return(true);
+  }
+
+  return(false);
+
+}
+
+bool bnjr_iface_select::accept(const char* ifname, unsigned int ifindex,
+                               const struct sockaddr* addr) const {
+
+  if ((addr->sa_family == AF_INET) && !(family & BNJR_FAMILY_IPV4)) return(false);
+  if ((addr->sa_family == AF_INET6) && !(family & BNJR_FAMILY_IPV6)) return(false);
+
+  bool any_allow = !allow_.names.empty() || !allow_.indexes.empty() || !allow_.nets.empty();
+
+  if (any_allow && !matches(allow_, ifname, ifindex, addr)) return(false);
+  if (matches(deny_, ifname, ifindex, addr)) return(false);
+
+  return(true);
+
+}
+
+int open_client_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                        std::vector<std::string>* names) {
+  // When sending, each socket can only send to one network interface
+  // Thus we need to open one socket for each interface and address family
+  int num_sockets = 0;
+
+#ifdef _WIN32
+
+  IP_ADAPTER_ADDRESSES* adapter_address = 0;
+  ULONG address_size = 8000;
+  unsigned int ret;
+  unsigned int num_retries = 4;
+  do {
+    adapter_address = malloc(address_size);
+    ret = GetAdaptersAddresses(AF_UNSPEC, GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_ANYCAST, 0,
+                               adapter_address, &address_size);
+    if (ret == ERROR_BUFFER_OVERFLOW) {
+      free(adapter_address);
+      adapter_address = 0;
+    } else {
+      break;
+    }
+  } while (num_retries-- > 0);
+
+  if (!adapter_address || (ret != NO_ERROR)) {
+    free(adapter_address);
+    return num_sockets;
+  }
+
+  for (PIP_ADAPTER_ADDRESSES adapter = adapter_address; adapter; adapter = adapter->Next) {
+    if (adapter->TunnelType == TUNNEL_TYPE_TEREDO)
+      continue;
+    if (adapter->OperStatus != IfOperStatusUp)
+      continue;
+
+    int opened_ipv6 = 0;
+
+    for (IP_ADAPTER_UNICAST_ADDRESS* unicast = adapter->FirstUnicastAddress; unicast;
+    unicast = unicast->Next) {
+      if (!select.accept(adapter->AdapterName,
+                         (unicast->Address.lpSockaddr->sa_family == AF_INET6) ?
+                           adapter->Ipv6IfIndex : adapter->IfIndex,
+                         unicast->Address.lpSockaddr))
+        continue;
+      if (unicast->Address.lpSockaddr->sa_family == AF_INET) {
+        struct sockaddr_in* saddr = (struct sockaddr_in*)unicast->Address.lpSockaddr;
+        if ((saddr->sin_addr.S_un.S_un_b.s_b1 != 127) ||
+            (saddr->sin_addr.S_un.S_un_b.s_b2 != 0) ||
+            (saddr->sin_addr.S_un.S_un_b.s_b3 != 0) ||
+            (saddr->sin_addr.S_un.S_un_b.s_b4 != 1)) {
+          if (num_sockets < max_sockets) {
+            saddr->sin_port = htons((unsigned short)port);
+            int sock = mdns_socket_open_ipv4(saddr);
+            if (sock >= 0) {
+              sockets[num_sockets++] = sock;
+              if (names) names->push_back(adapter->AdapterName);
+            }
+          }
+        }
+      } else if (unicast->Address.lpSockaddr->sa_family == AF_INET6) {
+        struct sockaddr_in6* saddr = (struct sockaddr_in6*)unicast->Address.lpSockaddr;
+        static const unsigned char localhost[] = {0, 0, 0, 0, 0, 0, 0, 0,
+                                                  0, 0, 0, 0, 0, 0, 0, 1};
+        static const unsigned char localhost_mapped[] = {0, 0, 0,    0,    0,    0, 0, 0,
+                                                         0, 0, 0xff, 0xff, 0x7f, 0, 0, 1};
+        if ((unicast->DadState == NldsPreferred) && !opened_ipv6 &&
+            memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
+            memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16)) {
+          if (num_sockets < max_sockets) {
+            saddr->sin6_port = htons((unsigned short)port);
+            saddr->sin6_scope_id = adapter->Ipv6IfIndex;
+            int sock = mdns_socket_open_ipv6(saddr);
+            if (sock >= 0) {
+              sockets[num_sockets++] = sock;
+              if (names) names->push_back(adapter->AdapterName);
+              opened_ipv6 = 1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  free(adapter_address);
+
+#else
+
+  struct ifaddrs* ifaddr = 0;
+  struct ifaddrs* ifa = 0;
+
+  if (getifaddrs(&ifaddr) < 0)
+    return num_sockets;
+
+  // interfaces that already have their IPv6 socket (one is enough: the
+  // socket is bound to the interface index, not to a particular address)
+  std::vector<unsigned int> ipv6_ifindex;
+
+  for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr)
+      continue;
+    if (!(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_MULTICAST))
+      continue;
+
+    unsigned int ifindex = if_nametoindex(ifa->ifa_name);
+    if (!select.accept(ifa->ifa_name, ifindex, ifa->ifa_addr))
+      continue;
+
+    if (ifa->ifa_addr->sa_family == AF_INET) {
+      struct sockaddr_in* saddr = (struct sockaddr_in*)ifa->ifa_addr;
+      if (saddr->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+        if (num_sockets < max_sockets) {
+          saddr->sin_port = htons(port);
+          int sock = mdns_socket_open_ipv4(saddr);
+          if (sock >= 0) {
+            bnjr_want_pktinfo(sock, AF_INET);
+            bnjr_want_timestamps(sock);
+            sockets[num_sockets++] = sock;
+            if (names) names->push_back(ifa->ifa_name);
+          }
+        }
+      }
+    } else if (ifa->ifa_addr->sa_family == AF_INET6) {
+      struct sockaddr_in6* saddr = (struct sockaddr_in6*)ifa->ifa_addr;
+      static const unsigned char localhost[] = {0, 0, 0, 0, 0, 0, 0, 0,
+                                                0, 0, 0, 0, 0, 0, 0, 1};
+      static const unsigned char localhost_mapped[] = {0, 0, 0,    0,    0,    0, 0, 0,
+                                                       0, 0, 0xff, 0xff, 0x7f, 0, 0, 1};
+      if (memcmp(saddr->sin6_addr.s6_addr, localhost, 16) &&
+          memcmp(saddr->sin6_addr.s6_addr, localhost_mapped, 16) &&
+          (std::find(ipv6_ifindex.begin(), ipv6_ifindex.end(), ifindex) == ipv6_ifindex.end())) {
+        if (num_sockets < max_sockets) {
+          saddr->sin6_port = htons(port);
+          saddr->sin6_scope_id = ifindex;
+          int sock = mdns_socket_open_ipv6(saddr);
+          if (sock >= 0) {
+            bnjr_want_pktinfo(sock, AF_INET6);
+            bnjr_want_timestamps(sock);
+            sockets[num_sockets++] = sock;
+            if (names) names->push_back(ifa->ifa_name);
+            ipv6_ifindex.push_back(ifindex);
+          }
+        }
+      }
+    }
+  }
+
+  freeifaddrs(ifaddr);
+
+#endif
+
+  return num_sockets;
+}
+
+static bool is_loopback(const struct sockaddr* addr) {
+  static const unsigned char localhost[] = {0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 0, 0, 0, 0, 0, 0, 1};
+  if (addr->sa_family == AF_INET)
+    return((ntohl(((const struct sockaddr_in*)addr)->sin_addr.s_addr) >> 24) == 127);
+  return(!memcmp(((const struct sockaddr_in6*)addr)->sin6_addr.s6_addr, localhost, 16));
+}
+
+#ifndef _WIN32
+
+// Wildcard socket for one family: multicast TTL/hop limit 1 with loopback
+// on, like mdns_socket_setup_ipv4/6(), but no group joined yet.
+static int open_family_socket(int family, int port) {
+
+  int sock = (int)socket(family, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) return(-1);
+
+  int on = 1;
+  unsigned char ttl = 1;
+  unsigned char loop = 1;
+  unsigned int hops = 1;
+  unsigned int loop6 = 1;
+  int ok;
+
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+#ifdef SO_REUSEPORT
+  setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&on, sizeof(on));
+#endif
+
+  if (family == AF_INET) {
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+    struct sockaddr_in saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_addr.s_addr = INADDR_ANY;
+    saddr.sin_port = htons((unsigned short)port);
+#ifdef __APPLE__
+    saddr.sin_len = sizeof(saddr);
+#endif
+    ok = !bind(sock, (struct sockaddr*)&saddr, sizeof(saddr));
+  } else {
+    setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&on, sizeof(on));
+    setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char*)&hops, sizeof(hops));
+    setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (const char*)&loop6, sizeof(loop6));
+    struct sockaddr_in6 saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin6_family = AF_INET6;
+    saddr.sin6_addr = in6addr_any;
+    saddr.sin6_port = htons((unsigned short)port);
+#ifdef __APPLE__
+    saddr.sin6_len = sizeof(saddr);
+#endif
+    ok = !bind(sock, (struct sockaddr*)&saddr, sizeof(saddr));
+  }
+
+  if (!ok || !bnjr_want_pktinfo(sock, family)) {
+    mdns_socket_close(sock);
+    return(-1);
+  }
+
+  bnjr_want_timestamps(sock);
+
+  const int flags = fcntl(sock, F_GETFL, 0);
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+  return(sock);
+
+}
+
+static bool join_group(int sock, int family, unsigned int ifindex, struct in_addr addr) {
+
+  if (family == AF_INET) {
+#ifdef __linux__
+    struct ip_mreqn req;
+    memset(&req, 0, sizeof(req));
+    req.imr_multiaddr.s_addr = htonl((((uint32_t)224U) << 24U) | ((uint32_t)251U));
+    req.imr_ifindex = (int)ifindex;
+#else
+    struct ip_mreq req;
+    memset(&req, 0, sizeof(req));
+    req.imr_multiaddr.s_addr = htonl((((uint32_t)224U) << 24U) | ((uint32_t)251U));
+    req.imr_interface = addr;
+#endif
+    return(!setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&req, sizeof(req)) ||
+           (errno == EADDRINUSE));
+  }
+
+  struct ipv6_mreq req;
+  memset(&req, 0, sizeof(req));
+  req.ipv6mr_multiaddr.s6_addr[0] = 0xFF;
+  req.ipv6mr_multiaddr.s6_addr[1] = 0x02;
+  req.ipv6mr_multiaddr.s6_addr[15] = 0xFB;
+  req.ipv6mr_interface = ifindex;
+  return(!setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, (const char*)&req, sizeof(req)) ||
+         (errno == EADDRINUSE));
+
+}
+
+#endif
+
+int open_family_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                        std::vector<bnjr_egress>& egress, std::vector<std::string>* names) {
+
+  egress.clear();
+
+#ifdef _WIN32
+
+  (void)sockets;
+  (void)max_sockets;
+  (void)port;
+  (void)select;
+  (void)names;
+  return(0);
+
+#else
+
+  struct ifaddrs* ifaddr = 0;
+
+  if (getifaddrs(&ifaddr) < 0) return(0);
+
+  // one entry per interface and family (an IPv4 interface with several
+  // addresses is joined and sent through once)
+  std::vector<bnjr_egress> found[2];
+
+  for (struct ifaddrs* ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+
+    if (!ifa->ifa_addr) continue;
+    if (!(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_MULTICAST)) continue;
+
+    int family = ifa->ifa_addr->sa_family;
+    if (((family != AF_INET) && (family != AF_INET6)) || is_loopback(ifa->ifa_addr))
+      continue;
+
+    unsigned int ifindex = if_nametoindex(ifa->ifa_name);
+    if (!ifindex || !select.accept(ifa->ifa_name, ifindex, ifa->ifa_addr)) continue;
+
+    std::vector<bnjr_egress>& list = found[(family == AF_INET6) ? 1 : 0];
+    bool seen = false;
+    for (size_t i = 0; !seen && (i < list.size()); ++i) seen = (list[i].ifindex == ifindex);
+    if (seen) continue;
+
+    bnjr_egress e;
+    e.sock = -1;
+    e.family = family;
+    e.ifindex = ifindex;
+    e.shared = true;
+    e.netns = 0;
+    e.addr.s_addr = INADDR_ANY;
+    if (family == AF_INET) e.addr = ((const struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+    e.name = ifa->ifa_name;
+    list.push_back(e);
+
+  }
+
+  freeifaddrs(ifaddr);
+
+  int num_sockets = 0;
+
+  for (int f = 0; (f < 2) && (num_sockets < max_sockets); ++f) {
+
+    if (found[f].empty()) continue;
+
+    int family = f ? AF_INET6 : AF_INET;
+    int sock = open_family_socket(family, port);
+    if (sock < 0) continue;
+
+    std::string label;
+    size_t joined = 0;
+
+    for (size_t i = 0; i < found[f].size(); ++i) {
+      bnjr_egress& e = found[f][i];
+      if (!join_group(sock, family, e.ifindex, e.addr)) continue;
+      e.sock = sock;
+      egress.push_back(e);
+      label += (label.empty() ? "" : ",") + e.name;
+      ++joined;
+    }
+
+    if (!joined) {
+      mdns_socket_close(sock);
+      continue;
+    }
+
+    sockets[num_sockets++] = sock;
+    if (names) names->push_back(label);
+
+  }
+
+  return(num_sockets);
+
+#endif
+
+}
+
+int open_query_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                       bnjr_socket_model model, std::vector<bnjr_egress>& egress,
+                       std::vector<std::string>* names) {
+
+  if (model == BNJR_SOCKETS_FAMILY) {
+    int num_sockets = open_family_sockets(sockets, max_sockets, port, select, egress, names);
+    if (num_sockets > 0) return(num_sockets);
+  }
+
+  egress.clear();
+
+  std::vector<std::string> ifnames;
+  int num_sockets = open_client_sockets(sockets, max_sockets, port, select, &ifnames);
+
+  for (int isock = 0; isock < num_sockets; ++isock) {
+    struct sockaddr_storage local;
+    socklen_t len = sizeof(local);
+    memset(&local, 0, sizeof(local));
+    getsockname(sockets[isock], (struct sockaddr*)&local, &len);
+    bnjr_egress e;
+    e.sock = sockets[isock];
+    e.family = local.ss_family;
+    e.ifindex = bnjr_interface_index(ifnames[isock]);
+    e.shared = false;
+    e.netns = 0;
+    e.addr.s_addr = INADDR_ANY;
+    e.name = ifnames[isock];
+    egress.push_back(e);
+  }
+
+  if (names) names->swap(ifnames);
+
+  return(num_sockets);
+
+}
+
+int bnjr_multicast_send(const bnjr_egress& out, const void* buffer, size_t size) {
+
+  if (!out.shared || !out.ifindex) return(mdns_multicast_send(out.sock, buffer, size));
+
+#ifdef _WIN32
+  return(-1);
+#else
+
+  struct sockaddr_storage to;
+  socklen_t tolen;
+  memset(&to, 0, sizeof(to));
+
+  if (out.family == AF_INET6) {
+    struct sockaddr_in6* sa = (struct sockaddr_in6*)&to;
+    sa->sin6_family = AF_INET6;
+    sa->sin6_addr.s6_addr[0] = 0xFF;
+    sa->sin6_addr.s6_addr[1] = 0x02;
+    sa->sin6_addr.s6_addr[15] = 0xFB;
+    sa->sin6_port = htons((unsigned short)MDNS_PORT);
+    sa->sin6_scope_id = out.ifindex;
+    tolen = sizeof(*sa);
+  } else {
+    struct sockaddr_in* sa = (struct sockaddr_in*)&to;
+    sa->sin_family = AF_INET;
+    sa->sin_addr.s_addr = htonl((((uint32_t)224U) << 24U) | ((uint32_t)251U));
+    sa->sin_port = htons((unsigned short)MDNS_PORT);
+    tolen = sizeof(*sa);
+  }
+#ifdef __APPLE__
+  ((struct sockaddr*)&to)->sa_len = (uint8_t)tolen;
+#endif
+
+  struct iovec iov;
+  iov.iov_base = (void*)buffer;
+  iov.iov_len = size;
+
+  union {
+    struct cmsghdr align;
+    char buf[64];
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &to;
+  msg.msg_namelen = tolen;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (out.family == AF_INET6) {
+    struct in6_pktinfo info;
+    memset(&info, 0, sizeof(info));
+    info.ipi6_ifindex = out.ifindex;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(info));
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = IPPROTO_IPV6;
+    c->cmsg_type = IPV6_PKTINFO;
+    c->cmsg_len = CMSG_LEN(sizeof(info));
+    memcpy(CMSG_DATA(c), &info, sizeof(info));
+  } else {
+#  ifdef IP_PKTINFO
+    struct in_pktinfo info;
+    memset(&info, 0, sizeof(info));
+    info.ipi_ifindex = (int)out.ifindex;
+    info.ipi_spec_dst = out.addr;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(info));
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = IPPROTO_IP;
+    c->cmsg_type = IP_PKTINFO;
+    c->cmsg_len = CMSG_LEN(sizeof(info));
+    memcpy(CMSG_DATA(c), &info, sizeof(info));
+#  else
+    // no per-datagram choice: point the socket at the interface first
+    if (setsockopt(out.sock, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&out.addr,
+                   sizeof(out.addr)))
+      return(-1);
+#  endif
+  }
+
+  return((sendmsg(out.sock, &msg, 0) < 0) ? -1 : 0);
+
+#endif
+
+}
+
+std::string bnjr_interface_name(unsigned int ifindex) {
+  if (!ifindex) return(std::string());
+#ifndef _WIN32
+  char name[IF_NAMESIZE];
+  if (if_indextoname(ifindex, name)) return(std::string(name));
+#endif
+  return(std::to_string(ifindex));
+}
+
+const bnjr_netns* bnjr_netns::get(const std::string& name) {
+
+  static std::mutex m;
+  static std::unordered_map<std::string, std::unique_ptr<bnjr_netns>> interned;
+
+  // a bare name is one `ip netns add` made
+  std::string path = (name.find('/') == std::string::npos) ? "/var/run/netns/" + name : name;
+
+  std::lock_guard<std::mutex> lock(m);
+  std::unique_ptr<bnjr_netns>& ns = interned[path];
+  if (!ns) ns.reset(new bnjr_netns(name, path));
+
+  return(ns.get());
+
+}
+
+bool bnjr_netns::enter(const std::function<void()>& fn, std::string& err) const {
+
+#ifdef __linux__
+
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    err = "cannot open network namespace '" + name_ + "': " + strerror(errno);
+    return(false);
+  }
+
+  // the thread's namespace goes away with it; ours never changes
+  int failed = 0;
+  std::thread t([&]() {
+    if (setns(fd, CLONE_NEWNET) != 0) {
+      failed = errno;
+      return;
+    }
+    fn();
+  });
+  t.join();
+
+  close(fd);
+
+  if (failed) {
+    err = "cannot enter network namespace '" + name_ + "': " + strerror(failed);
+    return(false);
+  }
+
+  return(true);
+
+#else
+
+  (void)fn;
+  err = "network namespaces are only supported on Linux";
+  return(false);
+
+#endif
+
+}
+
+void bnjr_netns::add_interfaces(const std::vector<bnjr_egress>& egress) const {
+  std::lock_guard<std::mutex> lock(m_);
+  for (size_t i = 0; i < egress.size(); ++i) {
+    if (egress[i].ifindex) ifnames_[egress[i].ifindex] = egress[i].name;
+  }
+}
+
+std::string bnjr_netns::interface_name(unsigned int ifindex) const {
+  if (!ifindex) return(std::string());
+  std::lock_guard<std::mutex> lock(m_);
+  auto it = ifnames_.find(ifindex);
+  return((it != ifnames_.end()) ? it->second : std::to_string(ifindex));
+}
+
+std::string bnjr_interface_name(const bnjr_netns* netns, unsigned int ifindex) {
+  return(netns ? netns->interface_name(ifindex) : bnjr_interface_name(ifindex));
+}
+
+unsigned int bnjr_interface_index(const std::string& name) {
+#ifdef _WIN32
+  return(0);
+#else
+  return(if_nametoindex(name.c_str()));
+#endif
+}
+
+int64_t bnjr_wall_ns() {
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool bnjr_want_timestamps(int sock) {
+  int on = 1;
+#if defined(SO_TIMESTAMPNS)
+  return(!setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, (const char*)&on, sizeof(on)));
+#elif defined(SO_TIMESTAMP) && !defined(_WIN32)
+  return(!setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, (const char*)&on, sizeof(on)));
+#else
+  (void)sock;
+  (void)on;
+  return(false);
+#endif
+}
+
+bool bnjr_want_pktinfo(int sock, int family) {
+#if defined(IP_PKTINFO) || defined(IP_RECVDSTADDR)
+  int on = 1;
+  if (family == AF_INET) {
+#  ifdef IP_PKTINFO
+    return(!setsockopt(sock, IPPROTO_IP, IP_PKTINFO, (const char*)&on, sizeof(on)));
+#  else
+    bool ok = !setsockopt(sock, IPPROTO_IP, IP_RECVDSTADDR, (const char*)&on, sizeof(on));
+#    ifdef IP_RECVIF
+    setsockopt(sock, IPPROTO_IP, IP_RECVIF, (const char*)&on, sizeof(on));
+#    endif
+    return(ok);
+#  endif
+  }
+#  ifdef IPV6_RECVPKTINFO
+  return(!setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, (const char*)&on, sizeof(on)));
+#  endif
+#endif
+  (void)sock;
+  (void)family;
+  return(false);
+}
+
+int bnjr_recv_datagram(int sock, void* buffer, size_t capacity, struct sockaddr_storage* from,
+                       socklen_t* addrlen, bnjr_recv_info* info) {
+
+  info->multicast = true;
+  info->ifindex = 0;
+  info->received_ns = 0;
+
+#ifdef _WIN32
+  return(recvfrom(sock, (char*)buffer, (int)capacity, 0, (struct sockaddr*)from, addrlen));
+#else
+  struct iovec iov;
+  iov.iov_base = buffer;
+  iov.iov_len = capacity;
+
+  union {
+    struct cmsghdr align;
+    char buf[256];
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = from;
+  msg.msg_namelen = *addrlen;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  int ret = (int)recvmsg(sock, &msg, 0);
+  if (ret <= 0) return(ret);
+
+  *addrlen = msg.msg_namelen;
+
+  for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+#  if defined(SCM_TIMESTAMPNS)
+    if ((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+      info->received_ns = (int64_t)ts.tv_sec * 1000000000 + (int64_t)ts.tv_nsec;
+    }
+#  elif defined(SCM_TIMESTAMP)
+    if ((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMP)) {
+      struct timeval tv;
+      memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+      info->received_ns = (int64_t)tv.tv_sec * 1000000000 + (int64_t)tv.tv_usec * 1000;
+    }
+#  endif
+#  ifdef IP_PKTINFO
+    if ((c->cmsg_level == IPPROTO_IP) && (c->cmsg_type == IP_PKTINFO)) {
+      struct in_pktinfo pi;
+      memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+      info->multicast = IN_MULTICAST(ntohl(pi.ipi_addr.s_addr));
+      info->ifindex = (unsigned int)pi.ipi_ifindex;
+    }
+#  elif defined(IP_RECVDSTADDR)
+    if ((c->cmsg_level == IPPROTO_IP) && (c->cmsg_type == IP_RECVDSTADDR)) {
+      struct in_addr dst;
+      memcpy(&dst, CMSG_DATA(c), sizeof(dst));
+      info->multicast = IN_MULTICAST(ntohl(dst.s_addr));
+    }
+#    ifdef IP_RECVIF
+    if ((c->cmsg_level == IPPROTO_IP) && (c->cmsg_type == IP_RECVIF)) {
+      struct sockaddr_dl sdl;
+      memcpy(&sdl, CMSG_DATA(c), std::min(sizeof(sdl), (size_t)(c->cmsg_len - CMSG_LEN(0))));
+      info->ifindex = sdl.sdl_index;
+    }
+#    endif
+#  endif
+#  ifdef IPV6_RECVPKTINFO
+    if ((c->cmsg_level == IPPROTO_IPV6) && (c->cmsg_type == IPV6_PKTINFO)) {
+      struct in6_pktinfo pi;
+      memcpy(&pi, CMSG_DATA(c), sizeof(pi));
+      info->multicast = IN6_IS_ADDR_MULTICAST(&pi.ipi6_addr);
+      info->ifindex = pi.ipi6_ifindex;
+    }
+#  endif
+  }
+
+  return(ret);
+#endif
+
+}
+
+static void add_local(std::vector<struct sockaddr_storage>& out, const struct sockaddr* addr,
+                      const bnjr_iface_select& select) {
+  if ((addr->sa_family == AF_INET) && !(select.family & BNJR_FAMILY_IPV4)) return;
+  if ((addr->sa_family == AF_INET6) && !(select.family & BNJR_FAMILY_IPV6)) return;
+  if (((addr->sa_family != AF_INET) && (addr->sa_family != AF_INET6)) || is_loopback(addr))
+    return;
+  struct sockaddr_storage ss;
+  memset(&ss, 0, sizeof(ss));
+  memcpy(&ss, addr, (addr->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) :
+                                                    sizeof(struct sockaddr_in));
+  out.push_back(ss);
+}
+
+int local_addresses(const bnjr_iface_select& select, std::vector<struct sockaddr_storage>& out) {
+
+  out.clear();
+
+#ifdef _WIN32
+
+  IP_ADAPTER_ADDRESSES* adapter_address = 0;
+  ULONG address_size = 8000;
+  unsigned int ret;
+  unsigned int num_retries = 4;
+  do {
+    adapter_address = (IP_ADAPTER_ADDRESSES*)malloc(address_size);
+    ret = GetAdaptersAddresses(AF_UNSPEC, GAA_FLAG_SKIP_MULTICAST | GAA_FLAG_SKIP_ANYCAST, 0,
+                               adapter_address, &address_size);
+    if (ret == ERROR_BUFFER_OVERFLOW) {
+      free(adapter_address);
+      adapter_address = 0;
+    } else {
+      break;
+    }
+  } while (num_retries-- > 0);
+
+  if (adapter_address && (ret == NO_ERROR)) {
+    for (PIP_ADAPTER_ADDRESSES adapter = adapter_address; adapter; adapter = adapter->Next) {
+      if ((adapter->TunnelType == TUNNEL_TYPE_TEREDO) || (adapter->OperStatus != IfOperStatusUp))
+        continue;
+      for (IP_ADAPTER_UNICAST_ADDRESS* unicast = adapter->FirstUnicastAddress; unicast;
+           unicast = unicast->Next) {
+        const struct sockaddr* addr = unicast->Address.lpSockaddr;
+        if (select.accept(adapter->AdapterName,
+                          (addr->sa_family == AF_INET6) ? adapter->Ipv6IfIndex : adapter->IfIndex,
+                          addr))
+          add_local(out, addr, select);
+      }
+    }
+  }
+
+  free(adapter_address);
+
+#else
+
+  struct ifaddrs* ifaddr = 0;
+
+  if (getifaddrs(&ifaddr) < 0) return(0);
+
+  for (struct ifaddrs* ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+    if (!ifa->ifa_addr)
+      continue;
+    if (!(ifa->ifa_flags & IFF_UP) || !(ifa->ifa_flags & IFF_MULTICAST))
+      continue;
+    if (select.accept(ifa->ifa_name, if_nametoindex(ifa->ifa_name), ifa->ifa_addr))
+      add_local(out, ifa->ifa_addr, select);
+  }
+
+  freeifaddrs(ifaddr);
+
+#endif
+
+  return((int)out.size());
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bonjour-filter.h"
+
+typedef enum {
+  BNJR_FAMILY_IPV4 = 1,
+  BNJR_FAMILY_IPV6 = 2,
+  BNJR_FAMILY_BOTH = 3
+} bnjr_family;
+
+// Which local interface addresses get a socket. Allow/deny entries can be an
+// interface name (globs allowed, e.g. "docker*"), a numeric interface index
+// or an address/CIDR block the interface address must fall in. An empty allow
+// list means "every interface"; deny always wins.
+class bnjr_iface_select {
+
+public:
+
+  bnjr_iface_select() : family(BNJR_FAMILY_BOTH) { }
+
+  bool allow(const std::string& spec, std::string& err) { return(add(allow_, spec, err)); }
+  bool deny(const std::string& spec, std::string& err) { return(add(deny_, spec, err)); }
+
+  bool accept(const char* ifname, unsigned int ifindex, const struct sockaddr* addr) const;
+
+  bnjr_family family;
+
+private:
+
+  typedef struct {
+    std::vector<std::string> names;
+    std::vector<unsigned int> indexes;
+    std::vector<bnjr_cidr> nets;
+  } match_set;
+
+  static bool add(match_set& set, const std::string& spec, std::string& err);
+  static bool matches(const match_set& set, const char* ifname, unsigned int ifindex,
+                      const struct sockaddr* addr);
+
+  match_set allow_;
+  match_set deny_;
+
+};
+
+// One socket per selected interface address (IPv4) or interface (IPv6),
+// with ingress interfaces and receive timestamps turned on. Returns the
+// number of sockets opened; names, if given, gets the interface name of
+// each one.
+int open_client_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                        std::vector<std::string>* names = 0);
+
+typedef enum {
+  BNJR_SOCKETS_INTERFACE = 0,   // one socket per interface address
+  BNJR_SOCKETS_FAMILY = 1       // one socket per address family
+} bnjr_socket_model;
+
+class bnjr_netns;
+
+// Where a multicast goes out: a socket and the interface it leaves by. A
+// socket shared by several interfaces picks that interface per datagram.
+typedef struct {
+  int sock;
+  int family;                 // AF_INET or AF_INET6
+  unsigned int ifindex;       // 0 = not known (the socket's default)
+  bool shared;                // socket serves several interfaces
+  struct in_addr addr;        // IPv4 source address on that interface
+  std::string name;           // interface name
+  const bnjr_netns* netns;    // namespace the socket lives in, 0 = ours
+} bnjr_egress;
+
+// The other socket model: one socket per address family, bound to the
+// wildcard address and joined to the mDNS group on every selected interface.
+// egress gets one entry per (socket, interface) to send through with
+// bnjr_multicast_send(); names, if given, gets a label for each socket.
+// Returns the number of sockets opened, 0 where the platform can't pick the
+// egress interface per datagram (Windows).
+int open_family_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                        std::vector<bnjr_egress>& egress, std::vector<std::string>* names = 0);
+
+// Sockets for a querier in either model, with one egress per place to send
+// the query. The family model falls back to per-interface sockets where it
+// isn't available.
+int open_query_sockets(int* sockets, int max_sockets, int port, const bnjr_iface_select& select,
+                       bnjr_socket_model model, std::vector<bnjr_egress>& egress,
+                       std::vector<std::string>* names = 0);
+
+// Multicast to the mDNS group through out: plain mdns_multicast_send() for a
+// per-interface socket, IP_PKTINFO/IPV6_PKTINFO (or IP_MULTICAST_IF where
+// there is no IP_PKTINFO) for a shared one. Returns 0 on success.
+int bnjr_multicast_send(const bnjr_egress& out, const void* buffer, size_t size);
+
+// Name of an interface by index ("" for 0; the number if it has gone away).
+std::string bnjr_interface_name(unsigned int ifindex);
+
+// A Linux network namespace scans can open their sockets in: a path such as
+// /var/run/netns/NAME or /proc/PID/ns/net, or a bare name as `ip netns`
+// knows it. Interned, one object per path for the life of the process, so
+// records can point at the one they were heard in.
+//
+// Only a short-lived thread ever joins the namespace, long enough to open
+// sockets; sockets stay in the namespace they were created in, so everything
+// after that runs on ordinary threads. Interface indexes only mean something
+// inside their namespace, so each one remembers the names of the interfaces
+// its scans used.
+class bnjr_netns {
+
+public:
+
+  static const bnjr_netns* get(const std::string& name);
+
+  const std::string& name() const { return(name_); }   // as first given
+
+  // Run fn on a new thread that has joined the namespace and wait for it.
+  // False (with err set, fn not run) if the namespace can't be entered:
+  // it doesn't exist, we lack CAP_SYS_ADMIN, or this isn't Linux.
+  bool enter(const std::function<void()>& fn, std::string& err) const;
+
+  void add_interfaces(const std::vector<bnjr_egress>& egress) const;
+  std::string interface_name(unsigned int ifindex) const;
+
+private:
+
+  bnjr_netns(const std::string& name, const std::string& path) : name_(name), path_(path) { }
+
+  std::string name_;
+  std::string path_;
+  mutable std::mutex m_;
+  mutable std::unordered_map<unsigned int, std::string> ifnames_;
+
+};
+
+// Interface name for an index seen in netns (0 = ours).
+std::string bnjr_interface_name(const bnjr_netns* netns, unsigned int ifindex);
+
+// Index of an interface by name (0 if there is no such interface).
+unsigned int bnjr_interface_index(const std::string& name);
+
+// Wall clock in nanoseconds since the epoch: the clock receive timestamps use.
+int64_t bnjr_wall_ns();
+
+// Ask the kernel to timestamp each datagram on arrival (SO_TIMESTAMPNS, or
+// SO_TIMESTAMP with microseconds). Returns false where it can't.
+bool bnjr_want_timestamps(int sock);
+
+// Ask the kernel to attach each datagram's destination address and ingress
+// interface (IP_PKTINFO and friends). Returns false where it can't.
+bool bnjr_want_pktinfo(int sock, int family);
+
+typedef struct {
+  bool multicast;             // sent to a multicast address (assumed when unknown)
+  unsigned int ifindex;       // interface it arrived on, 0 = unknown
+  int64_t received_ns;        // kernel receive timestamp, 0 = none
+} bnjr_recv_info;
+
+// recvfrom() that also reads what bnjr_want_pktinfo() and
+// bnjr_want_timestamps() asked for.
+int bnjr_recv_datagram(int sock, void* buffer, size_t capacity, struct sockaddr_storage* from,
+                       socklen_t* addrlen, bnjr_recv_info* info);
+
+// Non-loopback addresses of the selected interfaces (e.g. to publish as our
+// own A/AAAA records). Returns the number found.
+int local_addresses(const bnjr_iface_select& select, std::vector<struct sockaddr_storage>& out);
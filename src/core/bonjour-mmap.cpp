@@ -0,0 +1,88 @@
+#include "bonjour-mmap.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+bnjr_mapped_file::bnjr_mapped_file() : data_(0), size_(0) { }
+
+bnjr_mapped_file::~bnjr_mapped_file() {
+  close();
+}
+
+bool bnjr_mapped_file::open(const std::string& path, std::string& err) {
+
+  close();
+
+#ifndef _WIN32
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    err = "cannot open '" + path + "'";
+    return(false);
+  }
+
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+    ::close(fd);
+    err = "cannot read '" + path + "'";
+    return(false);
+  }
+
+  void* map = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    err = "cannot map '" + path + "'";
+    return(false);
+  }
+
+  // captures and cache files are walked front to back exactly once
+  madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  data_ = (const uint8_t*)map;
+  size_ = (size_t)st.st_size;
+
+#else
+
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    err = "cannot open '" + path + "'";
+    return(false);
+  }
+  char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) copy_.append(chunk, n);
+  fclose(f);
+
+  if (copy_.empty()) {
+    err = "cannot read '" + path + "'";
+    return(false);
+  }
+
+  data_ = (const uint8_t*)copy_.data();
+  size_ = copy_.size();
+
+#endif
+
+  return(true);
+
+}
+
+void bnjr_mapped_file::close() {
+
+#ifndef _WIN32
+  if (data_) munmap((void*)data_, size_);
+#else
+  std::string().swap(copy_);
+#endif
+
+  data_ = 0;
+  size_ = 0;
+
+}
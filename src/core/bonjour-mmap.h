@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of a whole file: mmap() where we have it, a plain read into
+// memory on Windows. The view stays valid until the object is destroyed.
+class bnjr_mapped_file {
+
+public:
+
+  bnjr_mapped_file();
+  ~bnjr_mapped_file();
+
+  bool open(const std::string& path, std::string& err);
+  void close();
+
+  const uint8_t* data() const { return(data_); }
+  size_t size() const { return(size_); }
+
+private:
+
+  bnjr_mapped_file(const bnjr_mapped_file&);
+  bnjr_mapped_file& operator=(const bnjr_mapped_file&);
+
+  const uint8_t* data_;
+  size_t size_;
+  std::string copy_;   // Windows fallback storage
+
+};
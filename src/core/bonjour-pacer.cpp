@@ -0,0 +1,163 @@
+#include "bonjour-pacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// the largest mDNS message (RFC 6762 17): a byte bucket must fit one
+#define BNJR_PACER_MAX_PACKET 9000
+
+// Out of the box each interface gets 100 queries (and 100 KB) a second with
+// a quarter second of burst, which a single scan never gets near; bulk
+// lookups are spread out instead of hitting a slow Wi-Fi link all at once.
+bnjr_pacer::bnjr_pacer() {
+
+  global_rate_.packets_per_sec = 0;
+  global_rate_.bytes_per_sec = 0;
+  global_rate_.burst = 0.25;
+
+  iface_rate_.packets_per_sec = 100;
+  iface_rate_.bytes_per_sec = 100000;
+  iface_rate_.burst = 0.25;
+
+  global_.packets = 0;
+  global_.bytes = 0;
+  global_.updated_ns = 0;
+
+  waiting_[0] = waiting_[1] = 0;
+  memset(stats_, 0, sizeof(stats_));
+
+}
+
+bnjr_pacer& bnjr_pacer::shared() {
+  static bnjr_pacer pacer;
+  return(pacer);
+}
+
+int64_t bnjr_pacer::now_ns() {
+  return(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void bnjr_pacer::set_limits(const bnjr_rate& global, const bnjr_rate& per_interface) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    global_rate_ = global;
+    iface_rate_ = per_interface;
+    global_.updated_ns = 0;
+    ifaces_.clear();
+  }
+  ready_.notify_all();
+}
+
+void bnjr_pacer::limits(bnjr_rate& global, bnjr_rate& per_interface) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  global = global_rate_;
+  per_interface = iface_rate_;
+}
+
+void bnjr_pacer::stats(bnjr_pacer_stats out[2]) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  out[0] = stats_[0];
+  out[1] = stats_[1];
+}
+
+void bnjr_pacer::reset_stats() {
+  std::lock_guard<std::mutex> guard(lock_);
+  memset(stats_, 0, sizeof(stats_));
+}
+
+// Top a bucket up for the time since it was last touched; a new bucket
+// (updated_ns 0) starts full.
+void bnjr_pacer::fill(bucket& b, const bnjr_rate& rate, int64_t now) {
+
+  double max_packets = std::max(1.0, rate.packets_per_sec * rate.burst);
+  double max_bytes = std::max((double)BNJR_PACER_MAX_PACKET, rate.bytes_per_sec * rate.burst);
+
+  if (!b.updated_ns) {
+    b.packets = max_packets;
+    b.bytes = max_bytes;
+  } else {
+    double elapsed = (double)(now - b.updated_ns) / 1e9;
+    b.packets = std::min(max_packets, b.packets + elapsed * rate.packets_per_sec);
+    b.bytes = std::min(max_bytes, b.bytes + elapsed * rate.bytes_per_sec);
+  }
+
+  b.updated_ns = now;
+
+}
+
+// How long until the bucket has room for a packet of size bytes (0 = now).
+int64_t bnjr_pacer::wait_ns(const bucket& b, const bnjr_rate& rate, size_t size) {
+
+  double wait = 0;
+
+  if ((rate.packets_per_sec > 0) && (b.packets < 1))
+    wait = std::max(wait, (1 - b.packets) / rate.packets_per_sec);
+
+  double need = (double)std::min(size, (size_t)BNJR_PACER_MAX_PACKET);
+  if ((rate.bytes_per_sec > 0) && (b.bytes < need))
+    wait = std::max(wait, (need - b.bytes) / rate.bytes_per_sec);
+
+  // round up so the wakeup doesn't land a hair short of the budget
+  return(wait > 0 ? (int64_t)(wait * 1e9) + 1000 : 0);
+
+}
+
+void bnjr_pacer::take(bucket& b, const bnjr_rate& rate, size_t size) {
+  if (rate.packets_per_sec > 0) b.packets -= 1;
+  if (rate.bytes_per_sec > 0) b.bytes -= (double)std::min(size, (size_t)BNJR_PACER_MAX_PACKET);
+}
+
+int bnjr_pacer::send(const bnjr_egress& out, const void* buffer, size_t size,
+                     bnjr_priority priority) {
+
+  int64_t start = now_ns();
+
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+
+    ++waiting_[priority];
+
+    for (;;) {
+
+      int64_t now = now_ns();
+
+      // looked up every time round: set_limits() may have dropped it
+      bucket& iface = ifaces_[std::make_pair(out.netns, out.ifindex)];
+
+      fill(global_, global_rate_, now);
+      fill(iface, iface_rate_, now);
+
+      int64_t wait;
+      if ((priority == BNJR_PRIORITY_BACKGROUND) && waiting_[BNJR_PRIORITY_INTERACTIVE]) {
+        wait = 10000000;  // until an interactive sender is done (it notifies)
+      } else {
+        wait = std::max(wait_ns(global_, global_rate_, size), wait_ns(iface, iface_rate_, size));
+        if (!wait) {
+          take(global_, global_rate_, size);
+          take(iface, iface_rate_, size);
+          break;
+        }
+      }
+
+      ready_.wait_for(guard, std::chrono::nanoseconds(wait));
+
+    }
+
+    --waiting_[priority];
+
+    int64_t waited = now_ns() - start;
+    bnjr_pacer_stats& s = stats_[priority];
+    ++s.packets;
+    s.bytes += size;
+    s.wait_ns += waited;
+    s.max_wait_ns = std::max(s.max_wait_ns, waited);
+    if (waited > 100000) ++s.delayed;  // more than lock and clock overhead
+  }
+
+  ready_.notify_all();
+
+  return(bnjr_multicast_send(out, buffer, size));
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "bonjour-iface.h"
+
+typedef enum {
+  BNJR_PRIORITY_INTERACTIVE = 0,  // a caller is blocked waiting on the answers
+  BNJR_PRIORITY_BACKGROUND = 1    // async scans and other traffic nobody waits on
+} bnjr_priority;
+
+// A sending budget; 0 leaves that dimension unlimited. The bucket holds
+// burst seconds' worth of the rate (but always at least one packet).
+typedef struct {
+  double packets_per_sec;
+  double bytes_per_sec;
+  double burst;
+} bnjr_rate;
+
+typedef struct {
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t delayed;      // packets that had to wait for budget
+  int64_t wait_ns;       // total time from send() to the packet going out
+  int64_t max_wait_ns;
+} bnjr_pacer_stats;
+
+// Token-bucket pacing of outgoing queries, with one bucket for all traffic
+// and one per egress interface; a packet goes out once both have room for
+// it. While an interactive packet is waiting, background packets hold back
+// so bulk scans in the background don't delay the ones somebody is waiting
+// on. Senders block in send() (never longer than the budget requires), and
+// how long they waited is kept per priority.
+//
+// Every querier sends through bnjr_pacer::shared(); responses from the
+// responder are not paced (RFC 6762 sets their timing).
+class bnjr_pacer {
+
+public:
+
+  bnjr_pacer();
+
+  static bnjr_pacer& shared();
+
+  // New limits apply from the next packet; the buckets start full.
+  void set_limits(const bnjr_rate& global, const bnjr_rate& per_interface);
+  void limits(bnjr_rate& global, bnjr_rate& per_interface) const;
+
+  // Wait for budget on out's interface and overall, then multicast the
+  // packet. Returns what bnjr_multicast_send() does.
+  int send(const bnjr_egress& out, const void* buffer, size_t size, bnjr_priority priority);
+
+  // stats[BNJR_PRIORITY_INTERACTIVE] and stats[BNJR_PRIORITY_BACKGROUND]
+  void stats(bnjr_pacer_stats out[2]) const;
+  void reset_stats();
+
+private:
+
+  struct bucket {
+    double packets;
+    double bytes;
+    int64_t updated_ns;
+  };
+
+  static int64_t now_ns();
+  static void fill(bucket& b, const bnjr_rate& rate, int64_t now);
+  static int64_t wait_ns(const bucket& b, const bnjr_rate& rate, size_t size);
+  static void take(bucket& b, const bnjr_rate& rate, size_t size);
+
+  mutable std::mutex lock_;
+  std::condition_variable ready_;
+  bnjr_rate global_rate_;
+  bnjr_rate iface_rate_;
+  bucket global_;
+  // by namespace and interface index (indexes repeat across namespaces)
+  std::map<std::pair<const bnjr_netns*, unsigned int>, bucket> ifaces_;
+  int waiting_[2];
+  bnjr_pacer_stats stats_[2];
+
+  bnjr_pacer(const bnjr_pacer&);
+  bnjr_pacer& operator=(const bnjr_pacer&);
+
+};
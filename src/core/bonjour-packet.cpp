@@ -0,0 +1,190 @@
+#include "bonjour-packet.h"
+
+#include <cstring>
+
+#include "bonjour-record.h"
+
+bnjr_packet_writer::bnjr_packet_writer(void* buffer, size_t capacity, uint16_t query_id) :
+  buffer_((uint8_t*)buffer), capacity_(capacity), size_(12), questions_(0), answers_(0),
+  additional_(0) {
+
+  memset(buffer_, 0, (capacity < 12) ? capacity : 12);
+  if (capacity >= 12) put16(0, query_id);
+
+}
+
+void bnjr_packet_writer::put16(size_t ofs, uint16_t v) {
+  buffer_[ofs] = (uint8_t)(v >> 8);
+  buffer_[ofs + 1] = (uint8_t)(v & 0xFF);
+}
+
+// Returns the offset just past the name or 0 if it didn't fit. The longest
+// suffix already in the packet ("local", "_tcp.local", the whole name, ...)
+// becomes a pointer; only the labels in front of it are written out.
+size_t bnjr_packet_writer::put_name(const std::string& name, size_t ofs) {
+
+  size_t len = name.size();
+  if (len && (name[len - 1] == '.')) --len;
+
+  // start offset of every label
+  std::vector<size_t> labels;
+  for (size_t i = 0; i < len; ) {
+    labels.push_back(i);
+    size_t dot = name.find('.', i);
+    if ((dot == std::string::npos) || (dot >= len)) break;
+    i = dot + 1;
+  }
+
+  size_t pointer = 0, nlabels = labels.size();
+  std::vector<std::string> suffixes(nlabels);
+
+  for (size_t k = 0; k < labels.size(); ++k) {
+    suffixes[k] = bnjr_name_key(name.data() + labels[k], len - labels[k]);
+    for (size_t i = 0; i < names_.size(); ++i) {
+      if (names_[i].first == suffixes[k]) {
+        pointer = 0xC000 | names_[i].second;
+        break;
+      }
+    }
+    if (pointer) {
+      nlabels = k;
+      break;
+    }
+  }
+
+  size_t pos = ofs;
+
+  for (size_t k = 0; k < nlabels; ++k) {
+    size_t end = (k + 1 < labels.size()) ? labels[k + 1] - 1 : len;
+    size_t n = end - labels[k];
+    if ((n == 0) || (n > 63) || (pos + 1 + n > capacity_)) return(0);
+    // only offsets a pointer can reach
+    if (pos < 0x3FFF) names_.push_back(std::make_pair(suffixes[k], pos));
+    buffer_[pos++] = (uint8_t)n;
+    memcpy(buffer_ + pos, name.data() + labels[k], n);
+    pos += n;
+  }
+
+  if (pointer) {
+    if (pos + 2 > capacity_) return(0);
+    put16(pos, (uint16_t)pointer);
+    return(pos + 2);
+  }
+
+  if (pos + 1 > capacity_) return(0);
+  buffer_[pos++] = 0;
+
+  return(pos);
+
+}
+
+bool bnjr_packet_writer::add_question(const std::string& name, uint16_t rtype,
+                                      bool unicast_response) {
+
+  if ((capacity_ < 12) || answers_ || additional_) return(false);
+
+  size_t names = names_.size();
+  size_t ofs = put_name(name, size_);
+  if (!ofs || (ofs + 4 > capacity_)) {
+    names_.resize(names);
+    return(false);
+  }
+
+  put16(ofs, rtype);
+  put16(ofs + 2, (uint16_t)(MDNS_CLASS_IN | (unicast_response ? MDNS_UNICAST_RESPONSE : 0)));
+
+  size_ = ofs + 4;
+  put16(4, (uint16_t)++questions_);
+
+  return(true);
+
+}
+
+bool bnjr_packet_writer::add_answer_ptr(const std::string& name, uint32_t ttl,
+                                        const std::string& target) {
+
+  uint8_t rdata[256];
+  void* end = mdns_string_make(rdata, sizeof(rdata), target.c_str(), target.length());
+  if (!end) return(false);
+
+  return(add_record(MDNS_ENTRYTYPE_ANSWER, name, MDNS_RECORDTYPE_PTR, MDNS_CLASS_IN, ttl,
+                    rdata, MDNS_POINTER_DIFF(end, rdata)));
+
+}
+
+bool bnjr_packet_writer::add_record(mdns_entry_type_t section, const std::string& name,
+                                    uint16_t rtype, uint16_t rclass, uint32_t ttl,
+                                    const void* rdata, size_t rdlen) {
+
+  if (capacity_ < 12) return(false);
+  if ((section == MDNS_ENTRYTYPE_ANSWER) && additional_) return(false);
+  if ((section != MDNS_ENTRYTYPE_ANSWER) && (section != MDNS_ENTRYTYPE_ADDITIONAL)) return(false);
+
+  size_t names = names_.size();
+  size_t ofs = put_name(name, size_);
+  if (!ofs || (ofs + 10 + rdlen > capacity_) || (rdlen > 0xFFFF)) {
+    names_.resize(names);
+    return(false);
+  }
+
+  put16(ofs, rtype);
+  put16(ofs + 2, rclass);
+  put16(ofs + 4, (uint16_t)(ttl >> 16));
+  put16(ofs + 6, (uint16_t)(ttl & 0xFFFF));
+  put16(ofs + 8, (uint16_t)rdlen);
+  memcpy(buffer_ + ofs + 10, rdata, rdlen);
+
+  size_ = ofs + 10 + rdlen;
+
+  if (section == MDNS_ENTRYTYPE_ANSWER) {
+    put16(6, (uint16_t)++answers_);
+  } else {
+    put16(10, (uint16_t)++additional_);
+  }
+
+  return(true);
+
+}
+
+void bnjr_packet_writer::rewind(size_t size, int questions) {
+
+  if ((size > size_) || answers_ || additional_) return;
+
+  while (names_.size() && (names_.back().second >= size)) names_.pop_back();
+
+  size_ = size;
+  questions_ = questions;
+  put16(4, (uint16_t)questions_);
+
+}
+
+void bnjr_packet_writer::set_flags(uint16_t flags) {
+  if (capacity_ >= 12) put16(2, flags);
+}
+
+void bnjr_packet_writer::set_truncated() {
+  if (capacity_ >= 12) buffer_[2] |= 0x02;
+}
+
+int bnjr_packet_writer::send_multicast(int sock) const {
+  return(mdns_multicast_send(sock, buffer_, size_));
+}
+
+bool bnjr_socket_wants_unicast(int sock) {
+
+  struct sockaddr_storage addr_storage;
+  struct sockaddr* saddr = (struct sockaddr*)&addr_storage;
+  socklen_t saddrlen = sizeof(addr_storage);
+
+  if (getsockname(sock, saddr, &saddrlen) == 0) {
+    if ((saddr->sa_family == AF_INET) &&
+        (ntohs(((struct sockaddr_in*)saddr)->sin_port) == MDNS_PORT))
+      return(false);
+    if ((saddr->sa_family == AF_INET6) &&
+        (ntohs(((struct sockaddr_in6*)saddr)->sin6_port) == MDNS_PORT))
+      return(false);
+  }
+
+  return(true);
+
+}
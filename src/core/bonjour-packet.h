@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mdns.h"
+
+// Builds outgoing mDNS messages that mdns_query_send()/mdns_query_answer()
+// can't express: several questions in one packet, known-answer records and
+// aggregated multi-record responses. Sections must be filled in order
+// (questions, answers, additional). Owner names are compressed against the
+// ones written before them: the longest suffix already in the packet (often
+// just "local.") becomes a pointer, so a packet full of questions about
+// *.local hosts spends a few bytes per extra name.
+class bnjr_packet_writer {
+
+public:
+
+  bnjr_packet_writer(void* buffer, size_t capacity, uint16_t query_id = 0);
+
+  // Each returns false, leaving the packet unchanged, if it would not fit.
+  bool add_question(const std::string& name, uint16_t rtype, bool unicast_response);
+  bool add_answer_ptr(const std::string& name, uint32_t ttl, const std::string& target);
+
+  // rdata is already in wire format (names uncompressed). rclass may carry
+  // the cache-flush bit.
+  bool add_record(mdns_entry_type_t section, const std::string& name, uint16_t rtype,
+                  uint16_t rclass, uint32_t ttl, const void* rdata, size_t rdlen);
+
+  // Header flags, e.g. 0x8400 for an authoritative response
+  void set_flags(uint16_t flags);
+
+  size_t size() const { return(size_); }
+  size_t remaining() const { return(capacity_ - size_); }
+  int questions() const { return(questions_); }
+  int answers() const { return(answers_); }
+  int additional() const { return(additional_); }
+
+  // Drop the questions added after size()/questions() returned these values
+  // (e.g. a group of questions that only partly fit).
+  void rewind(size_t size, int questions);
+
+  // Set the TC bit: more known answers follow in another packet (RFC 6762 7.2)
+  void set_truncated();
+
+  // Multicast the packet out of sock (to 224.0.0.251/ff02::fb port 5353
+  // depending on the socket family). Returns 0 on success.
+  int send_multicast(int sock) const;
+
+private:
+
+  void put16(size_t ofs, uint16_t v);
+  size_t put_name(const std::string& name, size_t ofs);
+
+  uint8_t* buffer_;
+  size_t capacity_;
+  size_t size_;
+  int questions_;
+  int answers_;
+  int additional_;
+  std::vector<std::pair<std::string, size_t>> names_;  // name suffixes written so far
+
+};
+
+// Query class for a question sent on sock: QU (unicast response) unless the
+// socket is bound to port 5353, same rule as mdns_query_send().
+bool bnjr_socket_wants_unicast(int sock);
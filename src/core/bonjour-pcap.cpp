@@ -0,0 +1,499 @@
+#include "bonjour-pcap.h"
+#include "bonjour-mmap.h"
+#include "bonjour-visit.h"
+
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#define PCAP_MAGIC_US 0xA1B2C3D4U
+#define PCAP_MAGIC_NS 0xA1B23C4DU
+#define PCAPNG_SHB 0x0A0D0D0AU
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4DU
+#define PCAPNG_IDB 0x00000001U
+#define PCAPNG_PB 0x00000002U   // obsolete Packet Block
+#define PCAPNG_SPB 0x00000003U
+#define PCAPNG_EPB 0x00000006U
+
+// link types (https://www.tcpdump.org/linktypes.html)
+#define LINK_NULL 0
+#define LINK_ETHERNET 1
+#define LINK_RAW_BSD1 12
+#define LINK_RAW_BSD2 14
+#define LINK_RAW 101
+#define LINK_LOOP 108
+#define LINK_SLL 113
+#define LINK_IPV4 228
+#define LINK_IPV6 229
+#define LINK_SLL2 276
+
+// fewer datagrams than this per thread isn't worth a thread
+#define BNJR_PCAP_MIN_PER_THREAD 256
+
+static inline uint16_t be16(const uint8_t* p) {
+  return((uint16_t)((p[0] << 8) | p[1]));
+}
+
+static inline uint32_t rd32(const uint8_t* p, bool swap) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  if (swap) v = (v >> 24) | ((v >> 8) & 0xFF00U) | ((v << 8) & 0xFF0000U) | (v << 24);
+  return(v);
+}
+
+static inline uint16_t rd16(const uint8_t* p, bool swap) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  if (swap) v = (uint16_t)((v >> 8) | (v << 8));
+  return(v);
+}
+
+// UDP header at p (len bytes available). Returns false if this isn't mDNS.
+static bool slice_udp(const uint8_t* p, size_t len, bnjr_pcap_datagram& d,
+                      bnjr_pcap_stats& stats) {
+
+  if (len < 8) return(false);
+
+  uint16_t sport = be16(p);
+  uint16_t dport = be16(p + 2);
+  if ((sport != MDNS_PORT) && (dport != MDNS_PORT)) return(false);
+
+  uint16_t ulen = be16(p + 4);
+  if ((ulen < 8) || (ulen > len)) {
+    ++stats.skipped;  // snapped short
+    return(false);
+  }
+
+  d.payload = p + 8;
+  d.length = (size_t)ulen - 8;
+
+  if (d.from.ss_family == AF_INET) {
+    ((struct sockaddr_in*)&d.from)->sin_port = htons(sport);
+  } else {
+    ((struct sockaddr_in6*)&d.from)->sin6_port = htons(sport);
+  }
+
+  return(true);
+
+}
+
+static bool slice_ipv4(const uint8_t* p, size_t len, bnjr_pcap_datagram& d,
+                       bnjr_pcap_stats& stats) {
+
+  if (len < 20) return(false);
+
+  size_t ihl = (size_t)(p[0] & 0x0F) * 4;
+  size_t total = be16(p + 2);
+  if (ihl < 20) return(false);
+  if (p[9] != 17) return(false);  // not UDP
+
+  // more-fragments flag or a non-zero offset: not a whole datagram
+  if (be16(p + 6) & 0x3FFF) {
+    ++stats.skipped;
+    return(false);
+  }
+
+  // slice_udp() notices if the cut took some of the payload; a cut into the
+  // header itself (or a header longer than the packet) leaves nothing to read
+  if (total > len) total = len;
+  if ((ihl > len) || (total < ihl)) {
+    ++stats.skipped;
+    return(false);
+  }
+
+  memset(&d.from, 0, sizeof(d.from));
+  struct sockaddr_in* sin = (struct sockaddr_in*)&d.from;
+  sin->sin_family = AF_INET;
+  memcpy(&sin->sin_addr, p + 12, 4);
+  d.addrlen = sizeof(struct sockaddr_in);
+
+  return(slice_udp(p + ihl, total - ihl, d, stats));
+
+}
+
+static bool slice_ipv6(const uint8_t* p, size_t len, bnjr_pcap_datagram& d,
+                       bnjr_pcap_stats& stats) {
+
+  if (len < 40) return(false);
+
+  size_t end = 40 + (size_t)be16(p + 4);
+  if (end > len) end = len;
+
+  uint8_t next = p[6];
+  size_t ofs = 40;
+
+  // walk extension headers until we hit the transport
+  for (;;) {
+    if ((next == 0) || (next == 43) || (next == 60)) {  // hop-by-hop, routing, dest opts
+      if (ofs + 2 > end) return(false);
+      next = p[ofs];
+      ofs += ((size_t)p[ofs + 1] + 1) * 8;
+    } else if (next == 51) {                              // AH
+      if (ofs + 2 > end) return(false);
+      next = p[ofs];
+      ofs += ((size_t)p[ofs + 1] + 2) * 4;
+    } else if (next == 44) {                              // fragment
+      ++stats.skipped;
+      return(false);
+    } else {
+      break;
+    }
+    if (ofs > end) return(false);
+  }
+
+  if (next != 17) return(false);
+
+  memset(&d.from, 0, sizeof(d.from));
+  struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&d.from;
+  sin6->sin6_family = AF_INET6;
+  memcpy(&sin6->sin6_addr, p + 8, 16);
+  d.addrlen = sizeof(struct sockaddr_in6);
+
+  return(slice_udp(p + ofs, end - ofs, d, stats));
+
+}
+
+static bool slice_ip(const uint8_t* p, size_t len, bnjr_pcap_datagram& d,
+                     bnjr_pcap_stats& stats) {
+  if (len < 1) return(false);
+  switch (p[0] >> 4) {
+    case 4: return(slice_ipv4(p, len, d, stats));
+    case 6: return(slice_ipv6(p, len, d, stats));
+  }
+  return(false);
+}
+
+static bool slice_ethertype(uint16_t ethertype, const uint8_t* p, size_t len,
+                            bnjr_pcap_datagram& d, bnjr_pcap_stats& stats) {
+  if (ethertype == 0x0800) return(slice_ipv4(p, len, d, stats));
+  if (ethertype == 0x86DD) return(slice_ipv6(p, len, d, stats));
+  return(false);
+}
+
+static bool slice_frame(uint32_t linktype, const uint8_t* p, size_t len,
+                        bnjr_pcap_datagram& d, bnjr_pcap_stats& stats) {
+
+  switch (linktype & 0xFFFF) {
+
+    case LINK_ETHERNET: {
+      if (len < 14) return(false);
+      size_t ofs = 12;
+      uint16_t ethertype = be16(p + ofs);
+      // 802.1Q / 802.1ad tags, possibly stacked
+      while ((ethertype == 0x8100) || (ethertype == 0x88A8) || (ethertype == 0x9100)) {
+        ofs += 4;
+        if (ofs + 2 > len) return(false);
+        ethertype = be16(p + ofs);
+      }
+      ofs += 2;
+      return(slice_ethertype(ethertype, p + ofs, len - ofs, d, stats));
+    }
+
+    case LINK_NULL:
+    case LINK_LOOP:
+      // 4-byte address family in whichever byte order the capturing host
+      // used; the IP version nibble is less ambiguous
+      if (len < 4) return(false);
+      return(slice_ip(p + 4, len - 4, d, stats));
+
+    case LINK_RAW:
+    case LINK_RAW_BSD1:
+    case LINK_RAW_BSD2:
+    case LINK_IPV4:
+    case LINK_IPV6:
+      return(slice_ip(p, len, d, stats));
+
+    case LINK_SLL:
+      if (len < 16) return(false);
+      return(slice_ethertype(be16(p + 14), p + 16, len - 16, d, stats));
+
+    case LINK_SLL2:
+      if (len < 20) return(false);
+      return(slice_ethertype(be16(p), p + 20, len - 20, d, stats));
+
+  }
+
+  return(false);
+
+}
+
+static void add_frame(uint32_t linktype, const uint8_t* p, size_t len, int64_t captured_ns,
+                      std::vector<bnjr_pcap_datagram>& out, bnjr_pcap_stats& stats) {
+
+  ++stats.frames;
+
+  bnjr_pcap_datagram d;
+  d.captured_ns = captured_ns;
+  if (slice_frame(linktype, p, len, d, stats)) {
+    ++stats.datagrams;
+    out.push_back(d);
+  }
+
+}
+
+static bool classic_datagrams(const uint8_t* data, size_t size, bool swap, bool nanos,
+                              std::vector<bnjr_pcap_datagram>& out, bnjr_pcap_stats& stats,
+                              std::string& err) {
+
+  if (size < 24) {
+    err = "truncated pcap header";
+    return(false);
+  }
+
+  uint32_t linktype = rd32(data + 20, swap);
+
+  size_t ofs = 24;
+
+  while (ofs + 16 <= size) {
+    size_t incl = rd32(data + ofs + 8, swap);
+    int64_t ts = (int64_t)rd32(data + ofs, swap) * 1000000000LL +
+      (int64_t)rd32(data + ofs + 4, swap) * (nanos ? 1 : 1000);
+    ofs += 16;
+    if (incl > size - ofs) break;  // capture cut off mid-record
+    add_frame(linktype, data + ofs, incl, ts, out, stats);
+    ofs += incl;
+  }
+
+  return(true);
+
+}
+
+// An interface's timestamp resolution (if_tsresol option): 10^-n seconds, or
+// 2^-n with the top bit set. Microseconds unless it says otherwise.
+static uint8_t idb_tsresol(const uint8_t* body, size_t len, bool swap) {
+  size_t ofs = 8;  // link type, reserved, snap length
+  while (ofs + 4 <= len) {
+    uint16_t code = rd16(body + ofs, swap);
+    size_t olen = rd16(body + ofs + 2, swap);
+    if ((code == 0) || (ofs + 4 + olen > len)) break;  // opt_endofopt
+    if ((code == 9) && (olen >= 1)) return(body[ofs + 4]);
+    ofs += 4 + ((olen + 3) & ~(size_t)3);
+  }
+  return(6);
+}
+
+static int64_t ts_ns(uint64_t ts, uint8_t resol) {
+  if (resol & 0x80) {
+    int shift = resol & 0x7F;
+    if (shift > 62) return(0);
+    uint64_t secs = ts >> shift;
+    uint64_t frac = ts - (secs << shift);
+    return((int64_t)(secs * 1000000000ULL) +
+           (int64_t)((double)frac * 1e9 / (double)(1ULL << shift)));
+  }
+  int64_t v = (int64_t)ts;
+  for (int i = resol; i < 9; ++i) v *= 10;
+  for (int i = 9; i < resol; ++i) v /= 10;
+  return(v);
+}
+
+static bool pcapng_datagrams(const uint8_t* data, size_t size,
+                             std::vector<bnjr_pcap_datagram>& out, bnjr_pcap_stats& stats,
+                             std::string& err) {
+
+  std::vector<uint32_t> linktypes;  // per interface of the current section
+  std::vector<uint8_t> tsresols;    // and its if_tsresol
+  bool swap = false;
+  size_t ofs = 0;
+
+  while (ofs + 12 <= size) {
+
+    uint32_t type = rd32(data + ofs, false);
+
+    if (type == PCAPNG_SHB) {
+      if (ofs + 28 > size) break;
+      uint32_t bom = rd32(data + ofs + 8, false);
+      if (bom == PCAPNG_BYTE_ORDER) {
+        swap = false;
+      } else if (rd32(data + ofs + 8, true) == PCAPNG_BYTE_ORDER) {
+        swap = true;
+      } else {
+        err = "bad pcapng byte-order magic";
+        return(false);
+      }
+      linktypes.clear();  // interface ids are per section
+      tsresols.clear();
+    } else {
+      type = rd32(data + ofs, swap);
+    }
+
+    size_t blen = rd32(data + ofs + 4, swap);
+    if ((blen < 12) || (blen % 4) || (blen > size - ofs)) break;
+
+    const uint8_t* body = data + ofs + 8;
+    size_t body_len = blen - 12;
+
+    if (type == PCAPNG_IDB) {
+
+      if (body_len >= 2) {
+        linktypes.push_back(rd16(body, swap));
+        tsresols.push_back(idb_tsresol(body, body_len, swap));
+      }
+
+    } else if ((type == PCAPNG_EPB) || (type == PCAPNG_PB)) {
+
+      if (body_len >= 20) {
+        uint32_t iface = (type == PCAPNG_EPB) ? rd32(body, swap) : rd16(body, swap);
+        size_t caplen = rd32(body + 12, swap);
+        if ((iface < linktypes.size()) && (caplen <= body_len - 20)) {
+          uint64_t ts = ((uint64_t)rd32(body + 4, swap) << 32) | rd32(body + 8, swap);
+          add_frame(linktypes[iface], body + 20, caplen, ts_ns(ts, tsresols[iface]), out, stats);
+        }
+      }
+
+    } else if (type == PCAPNG_SPB) {
+
+      if ((body_len >= 4) && !linktypes.empty()) {
+        size_t caplen = rd32(body, swap);
+        if (caplen > body_len - 4) caplen = body_len - 4;
+        add_frame(linktypes[0], body + 4, caplen, 0, out, stats);  // SPBs have no time
+      }
+
+    }
+
+    ofs += blen;
+
+  }
+
+  return(true);
+
+}
+
+bool bnjr_pcap_datagrams(const uint8_t* data, size_t size,
+                         std::vector<bnjr_pcap_datagram>& out, bnjr_pcap_stats& stats,
+                         std::string& err) {
+
+  memset(&stats, 0, sizeof(stats));
+
+  if (size < 4) {
+    err = "file is too short to be a capture";
+    return(false);
+  }
+
+  uint32_t magic = rd32(data, false);
+
+  if ((magic == PCAP_MAGIC_US) || (magic == PCAP_MAGIC_NS))
+    return(classic_datagrams(data, size, false, magic == PCAP_MAGIC_NS, out, stats, err));
+
+  magic = rd32(data, true);
+
+  if ((magic == PCAP_MAGIC_US) || (magic == PCAP_MAGIC_NS))
+    return(classic_datagrams(data, size, true, magic == PCAP_MAGIC_NS, out, stats, err));
+
+  if (magic == PCAPNG_SHB)  // same either way round
+    return(pcapng_datagrams(data, size, out, stats, err));
+
+  err = "not a pcap or pcapng capture";
+
+  return(false);
+
+}
+
+struct decode_ctx {
+  const bnjr_filter* filter;
+  bnjr_decoder decoder;
+  std::vector<bnjr_record> out;
+};
+
+struct append_sink {
+  std::vector<bnjr_record>* out;
+  void operator()(bnjr_record& rec) { out->push_back(std::move(rec)); }
+};
+
+static void decode_range(const bnjr_pcap_datagram* first, const bnjr_pcap_datagram* last,
+                         decode_ctx* ctx) {
+
+  // payloads sit at arbitrary offsets in the map, which the decoder's
+  // byte-wise loads don't mind: decode them where they are
+  append_sink sink = { &ctx->out };
+  bnjr_record_builder<append_sink> builder(ctx->decoder, sink, ctx->filter);
+
+  for (const bnjr_pcap_datagram* d = first; d != last; ++d) {
+    builder.source((const struct sockaddr*)&d->from, d->addrlen);
+    bnjr_visit_message(builder, d->payload, d->length, 0, -1);
+  }
+
+}
+
+std::vector<bnjr_record> bnjr_pcap_decode(const std::vector<bnjr_pcap_datagram>& dgrams,
+                                          const bnjr_filter* filter, int threads) {
+
+  if (filter && filter->empty()) filter = 0;
+
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+
+  size_t n = dgrams.size();
+  size_t max_threads = (n / BNJR_PCAP_MIN_PER_THREAD) + 1;
+  if ((size_t)threads > max_threads) threads = (int)max_threads;
+
+  std::vector<std::unique_ptr<decode_ctx>> ctxs;
+  std::vector<std::thread> workers;
+
+  size_t per = n / (size_t)threads;
+  size_t extra = n % (size_t)threads;
+  size_t start = 0;
+
+  const bnjr_pcap_datagram* base = dgrams.data();
+
+  for (int i = 0; i < threads; ++i) {
+    size_t count = per + (((size_t)i < extra) ? 1 : 0);
+    ctxs.emplace_back(new decode_ctx());
+    ctxs.back()->filter = filter;
+    if (i == threads - 1) {
+      decode_range(base + start, base + start + count, ctxs.back().get());  // this thread
+    } else {
+      workers.emplace_back(decode_range, base + start, base + start + count, ctxs.back().get());
+    }
+    start += count;
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+  size_t total = 0;
+  for (size_t i = 0; i < ctxs.size(); ++i) total += ctxs[i]->out.size();
+
+  std::vector<bnjr_record> out;
+  out.reserve(total);
+
+  for (size_t i = 0; i < ctxs.size(); ++i) {
+    for (size_t j = 0; j < ctxs[i]->out.size(); ++j) out.push_back(std::move(ctxs[i]->out[j]));
+  }
+
+  return(out);
+
+}
+
+bool bnjr_read_pcap(const std::string& path, const bnjr_filter* filter, int threads,
+                    std::vector<bnjr_record>& out, bnjr_pcap_stats& stats, std::string& err) {
+
+  bnjr_mapped_file file;
+  if (!file.open(path, err)) return(false);
+
+  std::vector<bnjr_pcap_datagram> dgrams;
+  if (!bnjr_pcap_datagrams(file.data(), file.size(), dgrams, stats, err)) return(false);
+
+  out = bnjr_pcap_decode(dgrams, filter, threads);
+
+  return(true);
+
+}
+
+bool bnjr_pcap_traffic(const std::string& path, bnjr_traffic& traffic, bnjr_pcap_stats& stats,
+                       std::string& err) {
+
+  bnjr_mapped_file file;
+  if (!file.open(path, err)) return(false);
+
+  std::vector<bnjr_pcap_datagram> dgrams;
+  if (!bnjr_pcap_datagrams(file.data(), file.size(), dgrams, stats, err)) return(false);
+
+  for (size_t i = 0; i < dgrams.size(); ++i) {
+    const bnjr_pcap_datagram& d = dgrams[i];
+    traffic.observe((const struct sockaddr*)&d.from, d.addrlen, d.payload, d.length,
+                    d.captured_ns);
+  }
+
+  return(true);
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "bonjour-filter.h"
+#include "bonjour-record.h"
+#include "bonjour-traffic.h"
+
+// Offline decoding of captured mDNS traffic.
+//
+// Captures are read straight out of a memory map: a single pass walks the
+// pcap/pcapng framing and the link/IP/UDP headers and collects pointers to
+// every UDP port 5353 payload; the payloads are then split into contiguous
+// runs and decoded on worker threads with the same parser and bnjr_decoder the
+// live engine uses. Nothing from libpcap is needed.
+
+typedef struct {
+  const uint8_t* payload;   // points into the mapped capture
+  size_t length;
+  struct sockaddr_storage from;
+  size_t addrlen;
+  int64_t captured_ns;      // capture timestamp (ns since the epoch), 0 = none
+} bnjr_pcap_datagram;
+
+typedef struct {
+  size_t frames;     // captured frames looked at
+  size_t datagrams;  // UDP/5353 payloads found
+  size_t skipped;    // 5353 traffic we couldn't use (snapped short, IP fragments)
+} bnjr_pcap_stats;
+
+// Collect the UDP/5353 payloads of a capture held in memory. Frames on link
+// types we don't understand are ignored. Returns false (with err set) only if
+// the data isn't a pcap/pcapng capture at all.
+bool bnjr_pcap_datagrams(const uint8_t* data, size_t size,
+                         std::vector<bnjr_pcap_datagram>& out, bnjr_pcap_stats& stats,
+                         std::string& err);
+
+// Decode datagrams on up to `threads` threads (<= 0 means one per core).
+// Records come back in capture order. filter may be null.
+std::vector<bnjr_record> bnjr_pcap_decode(const std::vector<bnjr_pcap_datagram>& dgrams,
+                                          const bnjr_filter* filter, int threads);
+
+// Replay a capture's datagrams, in capture order and at their capture
+// times, into traffic analytics.
+bool bnjr_pcap_traffic(const std::string& path, bnjr_traffic& traffic, bnjr_pcap_stats& stats,
+                       std::string& err);
+
+// Map, slice and decode a capture file in one go.
+bool bnjr_read_pcap(const std::string& path, const bnjr_filter* filter, int threads,
+                    std::vector<bnjr_record>& out, bnjr_pcap_stats& stats, std::string& err);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded multi-producer / single-consumer queue (Vyukov's intrusive node
+// design). Producers never block or take a lock: a push is one allocation plus
+// one atomic exchange. Only the single consumer may call pop().
+
+template <typename T>
+class bnjr_mpsc_queue {
+
+public:
+
+  bnjr_mpsc_queue() : head_(new node()), tail_(head_.load(std::memory_order_relaxed)) { }
+
+  ~bnjr_mpsc_queue() {
+    T discard;
+    while (pop(discard)) { }
+    delete tail_;
+  }
+
+  bnjr_mpsc_queue(const bnjr_mpsc_queue&) = delete;
+  bnjr_mpsc_queue& operator=(const bnjr_mpsc_queue&) = delete;
+
+  void push(T&& value) {
+    node* n = new node(std::move(value));
+    node* prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  // Returns false when the queue is empty (or a producer is mid-push; the
+  // item becomes visible on a later call).
+  bool pop(T& value) {
+    node* next = tail_->next.load(std::memory_order_acquire);
+    if (!next) return(false);
+    value = std::move(next->value);
+    delete tail_;
+    tail_ = next;
+    return(true);
+  }
+
+  bool empty() const {
+    return(tail_->next.load(std::memory_order_acquire) == nullptr);
+  }
+
+private:
+
+  struct node {
+    node() : next(nullptr) { }
+    explicit node(T&& v) : next(nullptr), value(std::move(v)) { }
+    std::atomic<node*> next;
+    T value;
+  };
+
+  std::atomic<node*> head_;
+  node* tail_;
+
+};
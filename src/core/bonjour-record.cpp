@@ -0,0 +1,380 @@
+#include "bonjour-record.h"
+#include "b64.h"
+#include "bonjour-iface.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+mdns_string_t
+  ipv4_address_to_string(char* buffer, size_t capacity, const struct sockaddr_in* addr,
+                         size_t addrlen) {
+    char host[NI_MAXHOST] = {0};
+    char service[NI_MAXSERV] = {0};
+    int ret = getnameinfo((const struct sockaddr*)addr, (socklen_t)addrlen, host, NI_MAXHOST,
+                          service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
+    int len = 0;
+    if (ret == 0) {
+      if (addr->sin_port != 0)
+        len = snprintf(buffer, capacity, "%s:%s", host, service);
+      else
+        len = snprintf(buffer, capacity, "%s", host);
+    }
+    if (len >= (int)capacity)
+      len = (int)capacity - 1;
+    mdns_string_t str;
+    str.str = buffer;
+    str.length = len;
+    return str;
+  }
+
+mdns_string_t
+  ipv6_address_to_string(char* buffer, size_t capacity, const struct sockaddr_in6* addr,
+                         size_t addrlen) {
+    char host[NI_MAXHOST] = {0};
+    char service[NI_MAXSERV] = {0};
+    int ret = getnameinfo((const struct sockaddr*)addr, (socklen_t)addrlen, host, NI_MAXHOST,
+                          service, NI_MAXSERV, NI_NUMERICSERV | NI_NUMERICHOST);
+    int len = 0;
+    if (ret == 0) {
+      if (addr->sin6_port != 0)
+        len = snprintf(buffer, capacity, "[%s]:%s", host, service);
+      else
+        len = snprintf(buffer, capacity, "%s", host);
+    }
+    if (len >= (int)capacity)
+      len = (int)capacity - 1;
+    mdns_string_t str;
+    str.str = buffer;
+    str.length = len;
+    return str;
+  }
+
+mdns_string_t
+  ip_address_to_string(char* buffer, size_t capacity, const struct sockaddr* addr, size_t addrlen) {
+    if (addr->sa_family == AF_INET6)
+      return ipv6_address_to_string(buffer, capacity, (const struct sockaddr_in6*)addr, addrlen);
+    return ipv4_address_to_string(buffer, capacity, (const struct sockaddr_in*)addr, addrlen);
+  }
+
+mdns_string_t bnjr_record_from(char* buffer, size_t capacity, const bnjr_record& rec) {
+  if (rec.netns && (rec.from.ss_family == AF_INET6)) {
+    struct sockaddr_in6 sa;
+    memcpy(&sa, &rec.from, sizeof(sa));
+    sa.sin6_scope_id = 0;
+    return(ipv6_address_to_string(buffer, capacity, &sa, sizeof(sa)));
+  }
+  return(ip_address_to_string(buffer, capacity, (const struct sockaddr*)&rec.from, rec.addrlen));
+}
+
+std::string bnjr_address_key(const struct sockaddr* addr, size_t addrlen) {
+
+  struct sockaddr_storage ss;
+  memset(&ss, 0, sizeof(ss));
+  memcpy(&ss, addr, std::min(addrlen, sizeof(ss)));
+
+  if (ss.ss_family == AF_INET6) {
+    ((struct sockaddr_in6*)&ss)->sin6_port = 0;
+    ((struct sockaddr_in6*)&ss)->sin6_scope_id = 0;
+    addrlen = sizeof(struct sockaddr_in6);
+  } else {
+    ((struct sockaddr_in*)&ss)->sin_port = 0;
+    addrlen = sizeof(struct sockaddr_in);
+  }
+
+  char buf[NI_MAXHOST];
+  mdns_string_t str = ip_address_to_string(buf, sizeof(buf), (const struct sockaddr*)&ss, addrlen);
+  return(std::string(str.str, str.length));
+
+}
+
+std::string bnjr_reverse_name(const struct sockaddr* addr) {
+
+  std::string out;
+  char buf[8];
+
+  if (addr->sa_family == AF_INET6) {
+    const uint8_t* a = (const uint8_t*)&((const struct sockaddr_in6*)addr)->sin6_addr;
+    static const char hex[] = "0123456789abcdef";
+    out.reserve(73);
+    for (int i = 15; i >= 0; --i) {
+      out += hex[a[i] & 0x0F];
+      out += '.';
+      out += hex[a[i] >> 4];
+      out += '.';
+    }
+    out += "ip6.arpa.";
+  } else {
+    const uint8_t* a = (const uint8_t*)&((const struct sockaddr_in*)addr)->sin_addr;
+    for (int i = 3; i >= 0; --i) {
+      snprintf(buf, sizeof(buf), "%u.", (unsigned)a[i]);
+      out += buf;
+    }
+    out += "in-addr.arpa.";
+  }
+
+  return(out);
+
+}
+
+std::string bnjr_name_key(const char* name, size_t length) {
+  if (length && (name[length - 1] == '.')) --length;
+  std::string key(name, length);
+  for (size_t i = 0; i < length; ++i) key[i] = (char)tolower((unsigned char)key[i]);
+  return(key);
+}
+
+void bnjr_decoder::decode(const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+                          uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
+                          size_t size, size_t name_offset, size_t offset, size_t length,
+                          bnjr_record& rec) {
+
+  begin(from, addrlen, entry, rtype, rclass, ttl, data, size, name_offset, length, rec);
+
+  switch (rtype) {
+  case MDNS_RECORDTYPE_PTR: ptr(data, size, offset, length, rec); break;
+  case MDNS_RECORDTYPE_SRV: srv(data, size, offset, length, rec); break;
+  case MDNS_RECORDTYPE_A: a(data, size, offset, length, rec); break;
+  case MDNS_RECORDTYPE_AAAA: aaaa(data, size, offset, length, rec); break;
+  case MDNS_RECORDTYPE_TXT: txt(data, size, offset, length, rec); break;
+  }
+
+}
+
+void bnjr_decoder::begin(const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+                         uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
+                         size_t size, size_t name_offset, size_t length, bnjr_record& rec) {
+
+  memset(&rec.from, 0, sizeof(rec.from));
+  memcpy(&rec.from, from, (addrlen < sizeof(rec.from)) ? addrlen : sizeof(rec.from));
+  rec.addrlen = addrlen;
+  rec.entry = entry;
+  rec.rtype = rtype;
+  rec.rclass = rclass;
+  rec.ttl = ttl;
+  rec.length = length;
+  rec.srv_priority = rec.srv_weight = rec.srv_port = 0;
+  rec.ifindex = 0;
+  rec.netns = 0;
+  rec.received_ns = rec.sent_ns = 0;
+  rec.target.clear();
+  rec.txt.clear();
+
+  mdns_string_t entrystr =
+    mdns_string_extract(data, size, &name_offset, entrybuffer, sizeof(entrybuffer));
+  rec.name.assign(entrystr.str, entrystr.length);
+
+}
+
+void bnjr_decoder::ptr(const void* data, size_t size, size_t offset, size_t length,
+                       bnjr_record& rec) {
+  mdns_string_t namestr = mdns_record_parse_ptr(data, size, offset, length,
+                                                namebuffer, sizeof(namebuffer));
+  rec.target.assign(namestr.str ? namestr.str : "", namestr.length);
+}
+
+void bnjr_decoder::srv(const void* data, size_t size, size_t offset, size_t length,
+                       bnjr_record& rec) {
+  mdns_record_srv_t srv = mdns_record_parse_srv(data, size, offset, length,
+                                                namebuffer, sizeof(namebuffer));
+  rec.target.assign(srv.name.str ? srv.name.str : "", srv.name.length);
+  rec.srv_priority = srv.priority;
+  rec.srv_weight = srv.weight;
+  rec.srv_port = srv.port;
+}
+
+void bnjr_decoder::a(const void* data, size_t size, size_t offset, size_t length,
+                     bnjr_record& rec) {
+  struct sockaddr_in addr;
+  mdns_record_parse_a(data, size, offset, length, &addr);
+  mdns_string_t addrstr = ipv4_address_to_string(namebuffer, sizeof(namebuffer), &addr, sizeof(addr));
+  rec.target.assign(addrstr.str, addrstr.length);
+}
+
+void bnjr_decoder::aaaa(const void* data, size_t size, size_t offset, size_t length,
+                        bnjr_record& rec) {
+  struct sockaddr_in6 addr;
+  mdns_record_parse_aaaa(data, size, offset, length, &addr);
+  mdns_string_t addrstr = ipv6_address_to_string(namebuffer, sizeof(namebuffer), &addr, sizeof(addr));
+  rec.target.assign(addrstr.str, addrstr.length);
+}
+
+void bnjr_decoder::txt(const void* data, size_t size, size_t offset, size_t length,
+                       bnjr_record& rec) {
+
+  size_t parsed = mdns_record_parse_txt(data, size, offset, length,
+                                        txtbuffer, sizeof(txtbuffer) / sizeof(mdns_record_txt_t));
+
+  rec.txt.resize(parsed);
+
+  for (size_t itxt = 0; itxt < parsed; ++itxt) {
+    if (txtbuffer[itxt].value.length) {
+      rec.txt[itxt].key.assign(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length);
+      rec.txt[itxt].value.assign(txtbuffer[itxt].value.str, txtbuffer[itxt].value.length);
+    } else {
+      rec.txt[itxt].value.assign(txtbuffer[itxt].key.str, txtbuffer[itxt].key.length);
+    }
+  }
+
+}
+
+// Length of the valid UTF-8 sequence starting at s (0 if there isn't one,
+// or it is a NUL). Overlong forms, surrogates and code points past U+10FFFF
+// don't count.
+static size_t utf8_sequence(const unsigned char* s, size_t n) {
+
+  unsigned char c = s[0];
+  if (c < 0x80) return(c ? 1 : 0);
+
+  size_t len;
+  uint32_t cp, min;
+  if ((c & 0xE0) == 0xC0) {
+    len = 2; cp = c & 0x1F; min = 0x80;
+  } else if ((c & 0xF0) == 0xE0) {
+    len = 3; cp = c & 0x0F; min = 0x800;
+  } else if ((c & 0xF8) == 0xF0) {
+    len = 4; cp = c & 0x07; min = 0x10000;
+  } else {
+    return(0);
+  }
+
+  if (len > n) return(0);
+  for (size_t i = 1; i < len; ++i) {
+    if ((s[i] & 0xC0) != 0x80) return(0);
+    cp = (cp << 6) | (s[i] & 0x3F);
+  }
+
+  if ((cp < min) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF))) return(0);
+
+  return(len);
+
+}
+
+bool bnjr_text_escape(const char* s, size_t n, std::string& out) {
+
+  const unsigned char* u = (const unsigned char*)s;
+
+  size_t i = 0;
+  while ((i < n) && (u[i] >= 0x01) && (u[i] < 0x80)) ++i;  // plain ASCII, the usual case
+  while (i < n) {
+    size_t len = utf8_sequence(u + i, n - i);
+    if (!len) break;
+    i += len;
+  }
+  if (i == n) return(false);
+
+  out.clear();
+  out.reserve(n + 8);
+
+  for (i = 0; i < n; ) {
+    size_t len = utf8_sequence(u + i, n - i);
+    if (len) {
+      if (u[i] == '\\') out += '\\';
+      out.append(s + i, len);
+      i += len;
+    } else {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\%03u", (unsigned)u[i]);
+      out += esc;
+      ++i;
+    }
+  }
+
+  return(true);
+
+}
+
+void bnjr_json_string(std::string& out, const std::string& s) {
+  out += '"';
+  for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+    unsigned char c = (unsigned char)*it;
+    if ((c == '"') || (c == '\\')) {
+      out += '\\';
+      out += (char)c;
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out += esc;
+    } else {
+      out += (char)c;
+    }
+  }
+  out += '"';
+}
+
+void bnjr_record_to_json(const bnjr_record& rec, std::string& out, const char* prefix) {
+
+  char addrbuffer[64];
+
+  mdns_string_t fromaddrstr = bnjr_record_from(addrbuffer, sizeof(addrbuffer), rec);
+
+  const char* entrytype = (rec.entry == MDNS_ENTRYTYPE_ANSWER) ? "answer" :
+    ((rec.entry == MDNS_ENTRYTYPE_AUTHORITY) ? "authority" : "additional");
+
+  out += "{ ";
+  if (prefix) out += prefix;
+  out += "\"from\" : \"";
+  out.append(fromaddrstr.str, fromaddrstr.length);
+  out += "\", \"entry_type\": \"";
+  out += entrytype;
+  out += "\"";
+  if (rec.netns) {
+    out += ", \"netns\": ";
+    bnjr_json_string(out, rec.netns->name());
+  }
+
+  if (rec.rtype == MDNS_RECORDTYPE_PTR) {
+
+    out += ", \"type\": \"PTR\", \"name\": ";
+    bnjr_json_string(out, rec.target);
+    out += ", \"rclass\": " + std::to_string(rec.rclass);
+    out += ", \"ttl\": " + std::to_string(rec.ttl);
+    out += ", \"length\": " + std::to_string(rec.length);
+
+  } else if (rec.rtype == MDNS_RECORDTYPE_SRV) {
+
+    out += ", \"type\": \"SRV\", \"srv_name\": ";
+    bnjr_json_string(out, rec.target);
+    out += ", \"srv_priority\": " + std::to_string(rec.srv_priority);
+    out += ", \"srv_weight\": " + std::to_string(rec.srv_weight);
+    out += ", \"srv_port\": " + std::to_string(rec.srv_port);
+
+  } else if ((rec.rtype == MDNS_RECORDTYPE_A) || (rec.rtype == MDNS_RECORDTYPE_AAAA)) {
+
+    out += (rec.rtype == MDNS_RECORDTYPE_A) ? ", \"type\": \"A\"" : ", \"type\": \"AAAA\"";
+    out += ", \"addr\": ";
+    bnjr_json_string(out, rec.target);
+
+  } else if (rec.rtype == MDNS_RECORDTYPE_TXT) {
+
+    out += ", \"type\": \"TXT\", \"info\": [ ";
+
+    for (size_t itxt = 0; itxt < rec.txt.size(); ++itxt) {
+      if (itxt > 0) out += ", ";
+      if (rec.txt[itxt].key.size()) {
+        out += "{ \"key\":";
+        bnjr_json_string(out, rec.txt[itxt].key);
+        out += ", \"value\":";
+        out += "\"" + macaron::Base64::Encode(rec.txt[itxt].value) + "\"";
+        out += " }";
+      } else {
+        out += "{ \"value\": \"" + macaron::Base64::Encode(rec.txt[itxt].value) + "\" }";
+      }
+    }
+
+    out += " ]";
+
+  } else {
+
+    out += ", \"type\": \"" + std::to_string(rec.rtype) + "\"";
+    out += ", \"rclass\": " + std::to_string(rec.rclass);
+    out += ", \"rtype\": " + std::to_string(rec.rtype);
+    out += ", \"ttl\": " + std::to_string(rec.ttl);
+    out += ", \"length\": " + std::to_string(rec.length);
+
+  }
+
+  out += " }\n";
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mdns.h"
+
+#ifndef _WIN32
+#  include <netdb.h>
+#endif
+
+class bnjr_netns;
+
+// A single decoded resource record. Workers fill these in off the R thread
+// so everything here owns its storage (nothing points back into a receive
+// buffer that is about to be reused).
+
+typedef struct {
+  std::string key;
+  std::string value;
+} bnjr_txt;
+
+typedef struct {
+  struct sockaddr_storage from;
+  size_t addrlen;
+  mdns_entry_type_t entry;
+  uint16_t rtype;
+  uint16_t rclass;
+  uint32_t ttl;
+  size_t length;
+  std::string name;      // owner name
+  std::string target;    // PTR/SRV target name or formatted A/AAAA address
+  uint16_t srv_priority;
+  uint16_t srv_weight;
+  uint16_t srv_port;
+  std::vector<bnjr_txt> txt;
+  unsigned int ifindex;  // interface it was received on, 0 = unknown
+  int64_t received_ns;   // receive time (ns since the epoch), 0 = unknown
+  int64_t sent_ns;       // when the query it answers went out there, 0 = unknown
+  const bnjr_netns* netns;  // network namespace it was heard in, 0 = ours
+} bnjr_record;
+
+mdns_string_t ipv4_address_to_string(char* buffer, size_t capacity,
+                                     const struct sockaddr_in* addr, size_t addrlen);
+
+mdns_string_t ipv6_address_to_string(char* buffer, size_t capacity,
+                                     const struct sockaddr_in6* addr, size_t addrlen);
+
+mdns_string_t ip_address_to_string(char* buffer, size_t capacity,
+                                   const struct sockaddr* addr, size_t addrlen);
+
+// A record's sender as ip_address_to_string() formats it. The zone of a
+// link-local sender is an interface index of the namespace it was heard in,
+// which our interface names don't describe, so it is left off for records
+// from other namespaces (their interface column names it).
+mdns_string_t bnjr_record_from(char* buffer, size_t capacity, const bnjr_record& rec);
+
+// An address without port or scope, formatted like A/AAAA targets: the key
+// a sender is grouped and counted under.
+std::string bnjr_address_key(const struct sockaddr* addr, size_t addrlen);
+
+// Reverse-mapping name for an address: "4.3.2.1.in-addr.arpa." for IPv4,
+// the nibble form under "ip6.arpa." for IPv6.
+std::string bnjr_reverse_name(const struct sockaddr* addr);
+
+// A DNS name lower-cased (ASCII) and without its trailing dot, for hashing
+// and comparing names the way DNS does.
+std::string bnjr_name_key(const char* name, size_t length);
+
+inline std::string bnjr_name_key(const std::string& name) {
+  return(bnjr_name_key(name.data(), name.size()));
+}
+
+// Scratch space for turning wire data into a bnjr_record. One per receive
+// worker; never shared between threads.
+//
+// decode() does the whole record, switching on rtype. Visitors that already
+// know the rtype (bonjour-visit.h) call begin() for the fields every record
+// has and then the one rdata decoder that applies.
+class bnjr_decoder {
+
+public:
+
+  void decode(const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+              uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+              size_t name_offset, size_t offset, size_t length, bnjr_record& rec);
+
+  void begin(const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
+             uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+             size_t name_offset, size_t length, bnjr_record& rec);
+
+  void ptr(const void* data, size_t size, size_t offset, size_t length, bnjr_record& rec);
+  void srv(const void* data, size_t size, size_t offset, size_t length, bnjr_record& rec);
+  void a(const void* data, size_t size, size_t offset, size_t length, bnjr_record& rec);
+  void aaaa(const void* data, size_t size, size_t offset, size_t length, bnjr_record& rec);
+  void txt(const void* data, size_t size, size_t offset, size_t length, bnjr_record& rec);
+
+private:
+
+  char namebuffer[256];
+  char entrybuffer[256];
+  mdns_record_txt_t txtbuffer[128];
+
+};
+
+// Names and TXT keys are whatever bytes a packet carried. For consumers that
+// need UTF-8 text, NULs and bytes that aren't part of a valid UTF-8 sequence
+// become \DDD escapes (DNS presentation format, RFC 1035 5.1) and backslashes
+// are doubled. Returns false, leaving out alone, when s is valid as it is.
+bool bnjr_text_escape(const char* s, size_t n, std::string& out);
+
+// Append s to out as a JSON string literal (quoted and escaped).
+void bnjr_json_string(std::string& out, const std::string& s);
+
+// Append the NDJSON line for a record to out (one JSON object per record,
+// TXT values base64 encoded). prefix, if given, holds extra `"key": value, `
+// fields to put in front of the record's own.
+void bnjr_record_to_json(const bnjr_record& rec, std::string& out, const char* prefix = 0);
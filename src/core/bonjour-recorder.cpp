@@ -0,0 +1,300 @@
+#include "bonjour-recorder.h"
+
+#include <chrono>
+#include <cstring>
+
+#define PCAPNG_SHB 0x0A0D0D0AU
+#define PCAPNG_IDB 0x00000001U
+#define PCAPNG_EPB 0x00000006U
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4DU
+#define LINK_RAW 101
+
+// how long the writer sleeps when the ring is empty
+#define BNJR_RECORDER_IDLE_MS 20
+
+bnjr_recorder::bnjr_recorder(size_t slots) :
+  mask_(0), enqueue_pos_(0), dequeue_pos_(0), ifaces_written_(0), file_(0), stop_(false),
+  recorded_(0), dropped_(0) {
+
+  size_t n = 2;
+  while ((n < slots) && (n < BNJR_RECORDER_MAX_SLOTS)) n <<= 1;
+
+  ring_.reset(new slot[n]);
+  mask_ = n - 1;
+
+  for (size_t i = 0; i < n; ++i) ring_[i].seq.store(i, std::memory_order_relaxed);
+
+}
+
+bnjr_recorder::~bnjr_recorder() {
+  close();
+}
+
+static void put_block(FILE* f, uint32_t type, const std::string& body) {
+  static const char pad[4] = {0, 0, 0, 0};
+  size_t padding = (4 - (body.size() % 4)) % 4;
+  uint32_t total = (uint32_t)(12 + body.size() + padding);
+  fwrite(&type, 4, 1, f);
+  fwrite(&total, 4, 1, f);
+  fwrite(body.data(), 1, body.size(), f);
+  fwrite(pad, 1, padding, f);
+  fwrite(&total, 4, 1, f);
+}
+
+static void put_u16(std::string& out, uint16_t v) {
+  out.append((const char*)&v, 2);
+}
+
+static void put_u32(std::string& out, uint32_t v) {
+  out.append((const char*)&v, 4);
+}
+
+static void put_option(std::string& out, uint16_t code, const void* value, size_t len) {
+  put_u16(out, code);
+  put_u16(out, (uint16_t)len);
+  out.append((const char*)value, len);
+  out.append((4 - (len % 4)) % 4, '\0');
+}
+
+bool bnjr_recorder::open(const std::string& path, std::string& err) {
+
+  close();
+
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    err = "cannot create '" + path + "'";
+    return(false);
+  }
+
+  setvbuf(file_, 0, _IOFBF, 1 << 20);
+
+  // section header in our own byte order; readers swap as needed
+  std::string shb;
+  put_u32(shb, PCAPNG_BYTE_ORDER);
+  put_u16(shb, 1);
+  put_u16(shb, 0);
+  int64_t section_length = -1;
+  shb.append((const char*)&section_length, 8);
+  put_block(file_, PCAPNG_SHB, shb);
+
+  stop_.store(false);
+  thread_ = std::thread(&bnjr_recorder::writer, this);
+
+  return(true);
+
+}
+
+void bnjr_recorder::close() {
+
+  if (!file_) return;
+
+  stop_.store(true);
+  if (thread_.joinable()) thread_.join();
+
+  fclose(file_);
+  file_ = 0;
+
+}
+
+int bnjr_recorder::add_interface(const std::string& name, const struct sockaddr* local) {
+
+  iface_info info;
+  info.name = name;
+  memset(&info.local, 0, sizeof(info.local));
+  if (local) {
+    memcpy(&info.local, local,
+           (local->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+  }
+
+  std::lock_guard<std::mutex> lock(iface_m_);
+  ifaces_.push_back(info);
+
+  return((int)ifaces_.size() - 1);
+
+}
+
+void bnjr_recorder::record(int iface, const struct sockaddr* from, size_t addrlen,
+                           const void* data, size_t size) {
+
+  slot* s;
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+  for (;;) {
+    s = &ring_[pos & mask_];
+    size_t seq = s->seq.load(std::memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);  // writer can't keep up
+      return;
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  s->ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  s->iface = iface;
+  if (addrlen > sizeof(s->from)) addrlen = sizeof(s->from);
+  memcpy(&s->from, from, addrlen);
+  s->orig_length = (uint32_t)size;
+  s->length = (uint32_t)((size > BNJR_RECORDER_SNAPLEN) ? BNJR_RECORDER_SNAPLEN : size);
+  memcpy(s->data, data, s->length);
+
+  s->seq.store(pos + 1, std::memory_order_release);
+
+  recorded_.fetch_add(1, std::memory_order_relaxed);
+
+}
+
+void bnjr_recorder::write_interfaces() {
+
+  std::lock_guard<std::mutex> lock(iface_m_);
+
+  for (; ifaces_written_ < ifaces_.size(); ++ifaces_written_) {
+    const std::string& name = ifaces_[ifaces_written_].name;
+    std::string idb;
+    put_u16(idb, LINK_RAW);
+    put_u16(idb, 0);
+    put_u32(idb, BNJR_RECORDER_SNAPLEN + 48);  // room for the IP/UDP headers we add
+    put_option(idb, 2, name.data(), name.size());   // if_name
+    uint8_t tsresol = 9;                            // nanoseconds
+    put_option(idb, 9, &tsresol, 1);
+    put_option(idb, 0, 0, 0);
+    put_block(file_, PCAPNG_IDB, idb);
+  }
+
+}
+
+static uint16_t ip_checksum(const uint8_t* p, size_t len) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i + 1 < len; i += 2) sum += (uint32_t)((p[i] << 8) | p[i + 1]);
+  while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+  return((uint16_t)~sum);
+}
+
+// The ring holds bare UDP payloads; wrap them in IP/UDP headers from the
+// sender and the receiving socket's address so the capture is self-describing.
+void bnjr_recorder::write_packet(const slot& s) {
+
+  if ((size_t)s.iface >= ifaces_written_) write_interfaces();
+  if ((size_t)s.iface >= ifaces_written_) return;
+
+  struct sockaddr_storage local;
+  {
+    std::lock_guard<std::mutex> lock(iface_m_);
+    local = ifaces_[s.iface].local;
+  }
+
+  uint8_t hdr[48];
+  size_t hlen;
+  uint16_t udp_len = (uint16_t)(8 + s.orig_length);
+  uint16_t sport = 0, dport = 0;
+
+  memset(hdr, 0, sizeof(hdr));
+
+  if (s.from.ss_family == AF_INET6) {
+    const struct sockaddr_in6* src = (const struct sockaddr_in6*)&s.from;
+    hdr[0] = 0x60;
+    hdr[4] = (uint8_t)(udp_len >> 8);
+    hdr[5] = (uint8_t)(udp_len & 0xFF);
+    hdr[6] = 17;
+    hdr[7] = 255;
+    memcpy(hdr + 8, &src->sin6_addr, 16);
+    if (local.ss_family == AF_INET6) {
+      const struct sockaddr_in6* dst = (const struct sockaddr_in6*)&local;
+      memcpy(hdr + 24, &dst->sin6_addr, 16);
+      dport = ntohs(dst->sin6_port);
+    }
+    sport = ntohs(src->sin6_port);
+    hlen = 40;
+  } else {
+    const struct sockaddr_in* src = (const struct sockaddr_in*)&s.from;
+    uint16_t total = (uint16_t)(20 + udp_len);
+    hdr[0] = 0x45;
+    hdr[2] = (uint8_t)(total >> 8);
+    hdr[3] = (uint8_t)(total & 0xFF);
+    hdr[8] = 255;
+    hdr[9] = 17;
+    memcpy(hdr + 12, &src->sin_addr, 4);
+    if (local.ss_family == AF_INET) {
+      const struct sockaddr_in* dst = (const struct sockaddr_in*)&local;
+      memcpy(hdr + 16, &dst->sin_addr, 4);
+      dport = ntohs(dst->sin_port);
+    }
+    uint16_t sum = ip_checksum(hdr, 20);
+    hdr[10] = (uint8_t)(sum >> 8);
+    hdr[11] = (uint8_t)(sum & 0xFF);
+    sport = ntohs(src->sin_port);
+    hlen = 20;
+  }
+
+  uint8_t* udp = hdr + hlen;
+  udp[0] = (uint8_t)(sport >> 8);
+  udp[1] = (uint8_t)(sport & 0xFF);
+  udp[2] = (uint8_t)(dport >> 8);
+  udp[3] = (uint8_t)(dport & 0xFF);
+  udp[4] = (uint8_t)(udp_len >> 8);
+  udp[5] = (uint8_t)(udp_len & 0xFF);
+  hlen += 8;
+
+  uint32_t caplen = (uint32_t)(hlen + s.length);
+  uint32_t origlen = (uint32_t)(hlen + s.orig_length);
+  size_t padding = (4 - (caplen % 4)) % 4;
+  uint32_t total = (uint32_t)(32 + caplen + padding);
+  uint32_t type = PCAPNG_EPB;
+  uint32_t iface = (uint32_t)s.iface;
+  uint32_t ts_high = (uint32_t)((uint64_t)s.ts_ns >> 32);
+  uint32_t ts_low = (uint32_t)((uint64_t)s.ts_ns & 0xFFFFFFFFU);
+  static const char pad[4] = {0, 0, 0, 0};
+
+  fwrite(&type, 4, 1, file_);
+  fwrite(&total, 4, 1, file_);
+  fwrite(&iface, 4, 1, file_);
+  fwrite(&ts_high, 4, 1, file_);
+  fwrite(&ts_low, 4, 1, file_);
+  fwrite(&caplen, 4, 1, file_);
+  fwrite(&origlen, 4, 1, file_);
+  fwrite(hdr, 1, hlen, file_);
+  fwrite(s.data, 1, s.length, file_);
+  fwrite(pad, 1, padding, file_);
+  fwrite(&total, 4, 1, file_);
+
+}
+
+// Write out everything currently in the ring; false if it was empty.
+bool bnjr_recorder::drain() {
+
+  bool any = false;
+
+  for (;;) {
+    slot& s = ring_[dequeue_pos_ & mask_];
+    if (s.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) break;
+    write_packet(s);
+    s.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_pos_;
+    any = true;
+  }
+
+  return(any);
+
+}
+
+void bnjr_recorder::writer() {
+
+  for (;;) {
+    bool stopping = stop_.load();
+    write_interfaces();
+    bool any = drain();
+    if (stopping) break;
+    if (!any) {
+      fflush(file_);
+      std::this_thread::sleep_for(std::chrono::milliseconds(BNJR_RECORDER_IDLE_MS));
+    }
+  }
+
+  fflush(file_);
+
+}
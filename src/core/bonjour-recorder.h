@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mdns.h"
+
+// Largest datagram kept per packet; matches the engine's receive buffer.
+#define BNJR_RECORDER_SNAPLEN 2048
+
+// Largest ring a recorder gets (a little over 2 GB of slots).
+#define BNJR_RECORDER_MAX_SLOTS ((size_t)1 << 20)
+
+// Raw datagram recorder.
+//
+// Receive workers hand every datagram to record() before parsing it. That
+// claims a slot in a bounded lock-free ring (Vyukov's MPMC array queue, used
+// here with a single consumer), takes a timestamp and copies the bytes; it
+// never blocks or allocates, and if the ring is full the datagram is counted
+// as dropped instead. A background thread drains the ring and appends the
+// packets to a pcapng file (one interface block per receiving socket, raw IP
+// link type, nanosecond timestamps) that bnjr_read_pcap() or Wireshark can
+// read back.
+class bnjr_recorder {
+
+public:
+
+  // slots is rounded up to a power of two, at most BNJR_RECORDER_MAX_SLOTS
+  explicit bnjr_recorder(size_t slots = 1024);
+  ~bnjr_recorder();
+
+  bool open(const std::string& path, std::string& err);
+
+  // Drain whatever is still queued, stop the writer and close the file.
+  void close();
+
+  bool is_open() const { return(file_ != 0); }
+
+  // Describe a receiving socket; returns the interface id to record with.
+  // local is the socket's own address (used as the packets' destination).
+  int add_interface(const std::string& name, const struct sockaddr* local);
+
+  // Hot path, safe from any number of threads.
+  void record(int iface, const struct sockaddr* from, size_t addrlen,
+              const void* data, size_t size);
+
+  uint64_t recorded() const { return(recorded_.load()); }
+  uint64_t dropped() const { return(dropped_.load()); }
+
+private:
+
+  struct slot {
+    std::atomic<size_t> seq;
+    int64_t ts_ns;
+    int iface;
+    struct sockaddr_storage from;
+    uint32_t length;       // bytes in data
+    uint32_t orig_length;  // datagram size before any snapping
+    uint8_t data[BNJR_RECORDER_SNAPLEN];
+  };
+
+  struct iface_info {
+    std::string name;
+    struct sockaddr_storage local;
+  };
+
+  bnjr_recorder(const bnjr_recorder&);
+  bnjr_recorder& operator=(const bnjr_recorder&);
+
+  bool drain();
+  void write_interfaces();
+  void write_packet(const slot& s);
+  void writer();
+
+  std::unique_ptr<slot[]> ring_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_pos_;
+  size_t dequeue_pos_;             // writer thread only
+
+  std::mutex iface_m_;
+  std::vector<iface_info> ifaces_;
+  size_t ifaces_written_;          // writer thread only
+
+  FILE* file_;
+  std::thread thread_;
+  std::atomic<bool> stop_;
+
+  std::atomic<uint64_t> recorded_;
+  std::atomic<uint64_t> dropped_;
+
+};
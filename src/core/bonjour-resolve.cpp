@@ -0,0 +1,295 @@
+#include "bonjour-resolve.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "bonjour-packet.h"
+#include "bonjour-visit.h"
+
+#ifndef _WIN32
+#  include <sys/select.h>
+#endif
+
+// keep query packets clear of IP fragmentation on a 1500 byte link
+#define BNJR_RESOLVE_PACKET 1400
+
+// how long to keep listening once every name has an answer
+#define BNJR_RESOLVE_GRACE_MS 100
+
+typedef std::chrono::steady_clock resolve_clock;
+
+typedef struct {
+  const bnjr_resolve_spec* spec;
+  std::unordered_map<std::string, size_t> pending;   // name key -> index in spec->names
+  std::vector<bool> answered;
+  size_t unanswered;
+  std::unordered_set<std::string> seen;               // record keys already in the result
+  bnjr_resolve_result* result;
+  bnjr_decoder decoder;
+  unsigned int ifindex;                               // of the datagram being parsed
+  int64_t received_ns;                                // and when it arrived
+  size_t match;                                       // name the record being decoded answers
+  std::vector<unsigned int> egress;                   // interface of each egress
+  std::vector<int64_t> sent;                          // latest round: names x egress
+  char namebuffer[256];
+} resolve_ctx;
+
+static bool wanted_type(const bnjr_resolve_spec& spec, uint16_t rtype) {
+  return(std::find(spec.rtypes.begin(), spec.rtypes.end(), rtype) != spec.rtypes.end());
+}
+
+static void add_answer(resolve_ctx& ctx, size_t index, const bnjr_record& rec) {
+
+  if (!ctx.seen.insert(bnjr_record_key(rec)).second) return;
+
+  ctx.result->records.push_back(rec);
+  ctx.result->index.push_back(index);
+
+  if (!ctx.answered[index]) {
+    ctx.answered[index] = true;
+    --ctx.unanswered;
+  }
+
+}
+
+// Only records of a wanted type owned by a name we asked about get decoded.
+struct resolve_match {
+  resolve_ctx* ctx;
+  bool accept(const struct sockaddr* from, mdns_entry_type_t entry, uint16_t rtype,
+              const void* data, size_t size, size_t name_offset) const {
+    if (!wanted_type(*ctx->spec, rtype)) return(false);
+    mdns_string_t name = mdns_string_extract(data, size, &name_offset, ctx->namebuffer,
+                                             sizeof(ctx->namebuffer));
+    auto it = ctx->pending.find(bnjr_name_key(name.str, name.length));
+    if (it == ctx->pending.end()) return(false);
+    ctx->match = it->second;
+    return(true);
+  }
+};
+
+struct resolve_sink {
+  resolve_ctx* ctx;
+  void operator()(bnjr_record& rec) {
+    rec.ifindex = ctx->ifindex;
+    rec.received_ns = ctx->received_ns;
+    const int64_t* sent = ctx->sent.data() + ctx->match * ctx->egress.size();
+    for (size_t i = 0; i < ctx->egress.size(); ++i) {
+      if (!i || (ctx->egress[i] == rec.ifindex)) rec.sent_ns = sent[i];
+    }
+    if (ctx->spec->cache) ctx->spec->cache->insert(rec, bnjr_cache::now_ms());
+    add_answer(*ctx, ctx->match, rec);
+  }
+};
+
+// One round of questions for every name still unanswered, packed into as
+// few packets as possible. Each name is stamped with when its packet left
+// each interface, after the pacer let it go. Returns the number of packets
+// built.
+static int send_round(const std::vector<bnjr_egress>& egress, resolve_ctx& ctx,
+                      std::vector<std::string>& warnings) {
+
+  const bnjr_resolve_spec& spec = *ctx.spec;
+  bool unicast = bnjr_socket_wants_unicast(egress[0].sock);
+
+  char buffer[BNJR_RESOLVE_PACKET];
+  int packets = 0;
+  bool failed = false;
+
+  size_t next = 0;
+
+  while (next < spec.names.size()) {
+
+    bnjr_packet_writer pkt(buffer, sizeof(buffer));
+    size_t first = next;
+
+    for (; next < spec.names.size(); ++next) {
+      if (ctx.answered[next]) continue;
+      // all of a name's questions go in the same packet
+      size_t size = pkt.size();
+      int questions = pkt.questions();
+      bool fit = true;
+      for (size_t t = 0; fit && (t < spec.rtypes.size()); ++t)
+        fit = pkt.add_question(spec.names[next], spec.rtypes[t], unicast);
+      if (!fit) {
+        if (!questions) {
+          // a name too long for a packet of its own
+          warnings.push_back("Can't ask about '" + spec.names[next] + "': name too long");
+          ++next;
+        }
+        pkt.rewind(size, questions);
+        break;
+      }
+    }
+
+    if (!pkt.questions()) continue;
+
+    for (size_t i = 0; i < egress.size(); ++i) {
+      if (bnjr_pacer::shared().send(egress[i], buffer, pkt.size(), spec.priority) &&
+          (errno != EHOSTUNREACH) && !failed) {
+        warnings.push_back(std::string("Failed to send mDNS query: ") + strerror(errno));
+        failed = true;
+      }
+      int64_t sent_ns = bnjr_wall_ns();
+      for (size_t n = first; n < next; ++n) {
+        if (!ctx.answered[n]) ctx.sent[n * egress.size() + i] = sent_ns;
+      }
+    }
+
+    ++packets;
+
+  }
+
+  return(packets);
+
+}
+
+void bnjr_resolve(const bnjr_resolve_spec& spec, bnjr_resolve_result& result) {
+
+  result.records.clear();
+  result.index.clear();
+  result.packets = 0;
+  result.cached = 0;
+
+  if (spec.names.empty() || spec.rtypes.empty()) return;
+
+  std::unique_ptr<resolve_ctx> ctx(new resolve_ctx);
+  ctx->spec = &spec;
+  ctx->result = &result;
+  ctx->answered.assign(spec.names.size(), false);
+  ctx->unanswered = spec.names.size();
+
+  // duplicates share the first occurrence's answers (and are never asked)
+  std::vector<size_t> first(spec.names.size());
+  std::unordered_set<std::string> keys;
+
+  for (size_t i = 0; i < spec.names.size(); ++i) {
+    std::string key = bnjr_name_key(spec.names[i]);
+    auto ins = ctx->pending.insert(std::make_pair(key, i));
+    first[i] = ins.first->second;
+    if (ins.second) {
+      keys.insert(key);
+    } else {
+      ctx->answered[i] = true;
+      --ctx->unanswered;
+    }
+  }
+
+  if (spec.cache) {
+    int64_t now = bnjr_cache::now_ms();
+    spec.cache->expire(now);
+    std::vector<bnjr_record> cached = spec.cache->find(keys, spec.rtypes, now);
+    for (size_t i = 0; i < cached.size(); ++i) {
+      size_t index = ctx->pending[bnjr_name_key(cached[i].name)];
+      if (!ctx->answered[index]) ++result.cached;
+      add_answer(*ctx, index, cached[i]);
+    }
+  }
+
+  if (ctx->unanswered) {
+
+    int sockets[32];
+    std::vector<bnjr_egress> egress;
+    int num_sockets = open_query_sockets(sockets, sizeof(sockets) / sizeof(sockets[0]), 0,
+                                         spec.interfaces, spec.sockets, egress);
+    if (num_sockets <= 0) {
+      result.error = "Failed to open any client sockets";
+      return;
+    }
+
+    std::vector<char> buffer(9000);  // RFC 6762 17: the largest mDNS message
+
+    for (size_t i = 0; i < egress.size(); ++i) ctx->egress.push_back(egress[i].ifindex);
+    ctx->sent.assign(spec.names.size() * egress.size(), 0);
+
+    resolve_match match = { ctx.get() };
+    resolve_sink sink = { ctx.get() };
+    bnjr_record_builder<resolve_sink, resolve_match> builder(ctx->decoder, sink, &match);
+
+    resolve_clock::time_point start = resolve_clock::now();
+    resolve_clock::time_point deadline = start + std::chrono::milliseconds(spec.timeout_ms);
+    resolve_clock::time_point next_round = start;
+    resolve_clock::time_point settle = deadline;
+    int interval_ms = 1000;
+
+    for (;;) {
+
+      resolve_clock::time_point now = resolve_clock::now();
+
+      if (!ctx->unanswered && (settle == deadline)) {
+        settle = std::min(deadline, now + std::chrono::milliseconds(BNJR_RESOLVE_GRACE_MS));
+      }
+
+      if (now >= settle) break;
+
+      if (ctx->unanswered && (now >= next_round)) {
+        result.packets += send_round(egress, *ctx, result.warnings);
+        next_round = now + std::chrono::milliseconds(interval_ms);
+        interval_ms *= 2;
+      }
+
+      resolve_clock::time_point wake = ctx->unanswered ? std::min(next_round, settle) : settle;
+      int64_t wait_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(wake - resolve_clock::now()).count();
+      if (wait_us < 0) wait_us = 0;
+
+      struct timeval timeout;
+      timeout.tv_sec = (long)(wait_us / 1000000);
+      timeout.tv_usec = (long)(wait_us % 1000000);
+
+      fd_set readfs;
+      FD_ZERO(&readfs);
+      int nfds = 0;
+      for (int isock = 0; isock < num_sockets; ++isock) {
+        FD_SET(sockets[isock], &readfs);
+        if (sockets[isock] >= nfds) nfds = sockets[isock] + 1;
+      }
+
+      int res = select(nfds, &readfs, 0, 0, &timeout);
+      if (res < 0 && errno == EINTR) continue;
+      if (res <= 0) continue;
+
+      for (int isock = 0; isock < num_sockets; ++isock) {
+
+        if (!FD_ISSET(sockets[isock], &readfs)) continue;
+
+        struct sockaddr_storage from;
+        socklen_t addrlen = sizeof(from);
+        bnjr_recv_info info;
+        memset(&from, 0, sizeof(from));
+        int ret = bnjr_recv_datagram(sockets[isock], buffer.data(), buffer.size(), &from, &addrlen,
+                                     &info);
+        if (ret <= 0) continue;
+
+        ctx->ifindex = info.ifindex;
+        ctx->received_ns = info.received_ns ? info.received_ns : bnjr_wall_ns();
+
+        // legacy unicast replies echo every question we asked, so no limit
+        builder.source((const struct sockaddr*)&from, addrlen);
+        bnjr_visit_message(builder, buffer.data(), (size_t)ret, 0, -1);
+
+      }
+
+    }
+
+    for (int isock = 0; isock < num_sockets; ++isock)
+      mdns_socket_close(sockets[isock]);
+
+  }
+
+  // repeated names get a copy of their first occurrence's answers
+  size_t n = result.records.size();
+  for (size_t i = 0; i < spec.names.size(); ++i) {
+    if (first[i] == i) continue;
+    for (size_t r = 0; r < n; ++r) {
+      if (result.index[r] != first[i]) continue;
+      result.records.push_back(result.records[r]);
+      result.index.push_back(i);
+    }
+  }
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bonjour-cache.h"
+#include "bonjour-iface.h"
+#include "bonjour-pacer.h"
+#include "bonjour-record.h"
+
+// A batch of lookups: every name is asked about every rtype.
+typedef struct {
+  std::vector<std::string> names;
+  std::vector<uint16_t> rtypes;
+  int timeout_ms = 3000;
+  bnjr_iface_select interfaces;
+  bnjr_socket_model sockets = BNJR_SOCKETS_INTERFACE;
+  bnjr_priority priority = BNJR_PRIORITY_INTERACTIVE;  // for the shared send pacer
+  std::shared_ptr<bnjr_cache> cache;
+} bnjr_resolve_spec;
+
+typedef struct {
+  std::vector<bnjr_record> records;
+  std::vector<size_t> index;        // records[i] answers names[index[i]]
+  int packets;                      // query packets sent (per interface)
+  int cached;                       // names answered from the cache
+  std::vector<std::string> warnings;
+  std::string error;
+} bnjr_resolve_result;
+
+// Pipelined one-shot lookups for many names at once.
+//
+// Names the cache can already answer are not asked. The rest go out as
+// multi-question packets, as many questions per packet as fit (names share
+// their "local." suffix through compression), on every selected interface.
+// Answers are matched back to names through a hash of the owner names, so a
+// response to any packet (or another querier's traffic) counts. Names still
+// unanswered are asked again after 1, 2, 4, ... seconds. Packets go out
+// through the shared pacer, so a big batch is spread out over its budget.
+//
+// Returns once every name has at least one answer (plus a short grace
+// period for records that come in a separate packet) or when timeout_ms
+// runs out. Like bnjr_scan() it never calls into R.
+void bnjr_resolve(const bnjr_resolve_spec& spec, bnjr_resolve_result& result);
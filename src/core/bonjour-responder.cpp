@@ -0,0 +1,763 @@
+#include "bonjour-responder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "bonjour-packet.h"
+
+#ifndef _WIN32
+#  include <sys/select.h>
+#endif
+
+// RFC 6762 6: minimum interval between multicasts of the same record
+#define BNJR_RATE_LIMIT_MS 1000
+// RFC 6762 6.3: random delay for responses with shared records
+#define BNJR_AGGREGATE_MIN_MS 20
+#define BNJR_AGGREGATE_MAX_MS 120
+// RFC 6762 6.7: TTL cap for legacy unicast responses
+#define BNJR_LEGACY_TTL 10
+// keep responses within a typical Ethernet MTU
+#define BNJR_RESPONSE_SIZE 1440
+// wake-up interval to notice stop() when idle
+#define BNJR_RESPONDER_IDLE_MS 100
+
+static const char services_name[] = "_services._dns-sd._udp.local.";
+
+static int64_t mono_ms() {
+  return(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static inline uint16_t be16(const uint8_t* p) {
+  return((uint16_t)((p[0] << 8) | p[1]));
+}
+
+static bool same_name(const char* a, size_t la, const std::string& b) {
+  size_t lb = b.size();
+  if (la && (a[la - 1] == '.')) --la;
+  if (lb && (b[lb - 1] == '.')) --lb;
+  if (la != lb) return(false);
+  for (size_t i = 0; i < la; ++i) {
+    if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return(false);
+  }
+  return(true);
+}
+
+static std::string wire_name(const std::string& name) {
+  char buffer[256];
+  void* end = mdns_string_make(buffer, sizeof(buffer), name.c_str(), name.length());
+  if (!end) return(std::string(1, '\0'));
+  return(std::string(buffer, MDNS_POINTER_DIFF(end, buffer)));
+}
+
+static std::string fqdn(const std::string& name) {
+  if (name.empty() || (name[name.size() - 1] == '.')) return(name);
+  return(name + ".");
+}
+
+bnjr_rr bnjr_rr_ptr(const std::string& name, const std::string& target, uint32_t ttl) {
+  bnjr_rr rr;
+  rr.name = fqdn(name);
+  rr.rtype = MDNS_RECORDTYPE_PTR;
+  rr.unique = false;
+  rr.ttl = ttl;
+  rr.target = fqdn(target);
+  rr.rdata = wire_name(rr.target);
+  return(rr);
+}
+
+bnjr_rr bnjr_rr_srv(const std::string& name, const std::string& target, uint16_t port,
+                    uint16_t priority, uint16_t weight, uint32_t ttl) {
+  bnjr_rr rr;
+  rr.name = fqdn(name);
+  rr.rtype = MDNS_RECORDTYPE_SRV;
+  rr.unique = true;
+  rr.ttl = ttl;
+  rr.target = fqdn(target);
+  uint8_t fixed[6] = {
+    (uint8_t)(priority >> 8), (uint8_t)(priority & 0xFF),
+    (uint8_t)(weight >> 8), (uint8_t)(weight & 0xFF),
+    (uint8_t)(port >> 8), (uint8_t)(port & 0xFF)
+  };
+  rr.rdata.assign((const char*)fixed, 6);
+  rr.rdata += wire_name(rr.target);
+  return(rr);
+}
+
+bnjr_rr bnjr_rr_txt(const std::string& name, const std::vector<bnjr_txt>& txt, uint32_t ttl) {
+  bnjr_rr rr;
+  rr.name = fqdn(name);
+  rr.rtype = MDNS_RECORDTYPE_TXT;
+  rr.unique = true;
+  rr.ttl = ttl;
+  for (size_t i = 0; i < txt.size(); ++i) {
+    std::string item = txt[i].key;
+    if (txt[i].value.size()) item += "=" + txt[i].value;
+    if (item.size() > 255) item.resize(255);
+    rr.rdata += (char)item.size();
+    rr.rdata += item;
+  }
+  if (rr.rdata.empty()) rr.rdata.assign(1, '\0');  // RFC 6763 6.1
+  return(rr);
+}
+
+bnjr_rr bnjr_rr_addr(const std::string& name, const struct sockaddr* addr, uint32_t ttl) {
+  bnjr_rr rr;
+  rr.name = fqdn(name);
+  rr.unique = true;
+  rr.ttl = ttl;
+  if (addr->sa_family == AF_INET6) {
+    rr.rtype = MDNS_RECORDTYPE_AAAA;
+    rr.rdata.assign((const char*)&((const struct sockaddr_in6*)addr)->sin6_addr, 16);
+  } else {
+    rr.rtype = MDNS_RECORDTYPE_A;
+    rr.rdata.assign((const char*)&((const struct sockaddr_in*)addr)->sin_addr, 4);
+  }
+  return(rr);
+}
+
+bnjr_rr bnjr_rr_reverse(const struct sockaddr* addr, const std::string& name, uint32_t ttl) {
+  bnjr_rr rr = bnjr_rr_ptr(bnjr_reverse_name(addr), name, ttl);
+  rr.unique = true;
+  return(rr);
+}
+
+bnjr_responder::bnjr_responder() : db_(std::make_shared<database>()), stop_(false) {
+  memset(&retired_, 0, sizeof(retired_));
+  std::const_pointer_cast<database>(db_)->count = 0;
+}
+
+bnjr_responder::~bnjr_responder() {
+  stop();
+}
+
+std::string bnjr_responder::key(const char* name, size_t length, uint16_t rtype) {
+  if (length && (name[length - 1] == '.')) --length;
+  std::string k(length + 3, '\0');
+  for (size_t i = 0; i < length; ++i) k[i] = (char)tolower((unsigned char)name[i]);
+  k[length + 1] = (char)(rtype >> 8);
+  k[length + 2] = (char)(rtype & 0xFF);
+  return(k);
+}
+
+const std::vector<bnjr_responder::entry_ref>*
+bnjr_responder::lookup(const database& db, const char* name, size_t length,
+                       uint16_t rtype) const {
+  std::unordered_map<std::string, std::vector<entry_ref>>::const_iterator it =
+    db.index.find(key(name, length, rtype));
+  return((it == db.index.end()) ? 0 : &it->second);
+}
+
+void bnjr_responder::add(const bnjr_rr& rr) {
+  add(std::vector<bnjr_rr>(1, rr));
+}
+
+void bnjr_responder::add(const std::vector<bnjr_rr>& rrs) {
+
+  std::lock_guard<std::mutex> lock(db_m_);
+
+  std::shared_ptr<database> db = std::make_shared<database>(*std::atomic_load(&db_));
+
+  for (size_t i = 0; i < rrs.size(); ++i) {
+
+    const bnjr_rr& rr = rrs[i];
+
+    entry_ref e = std::make_shared<entry>();
+    e->rr = rr;
+    for (int k = 0; k < 2 * links_per_family; ++k) e->last_multicast[k].store(0);
+
+    std::vector<entry_ref>& same = db->index[key(rr.name.data(), rr.name.size(), rr.rtype)];
+    std::vector<entry_ref>& any = db->index[key(rr.name.data(), rr.name.size(),
+                                                MDNS_RECORDTYPE_ANY)];
+
+    // republishing the same data only updates the TTL; entries are shared
+    // with older snapshots, so swap in a copy rather than editing in place
+    std::vector<entry_ref>::iterator old = same.begin();
+    for (; old != same.end(); ++old) if ((*old)->rr.rdata == rr.rdata) break;
+
+    if (old != same.end()) {
+      for (int k = 0; k < 2 * links_per_family; ++k)
+        e->last_multicast[k].store((*old)->last_multicast[k].load());
+      std::replace(any.begin(), any.end(), *old, e);
+      *old = e;
+    } else {
+      same.push_back(e);
+      any.push_back(e);
+      ++db->count;
+    }
+
+  }
+
+  std::atomic_store(&db_, database_ref(db));
+
+}
+
+void bnjr_responder::service_records(const std::string& instance, const std::string& service,
+                                     const std::string& hostname, uint16_t port,
+                                     const std::vector<bnjr_txt>& txt, uint32_t ttl,
+                                     std::vector<bnjr_rr>& out) {
+
+  std::string type = fqdn(service);
+  std::string full = instance + "." + type;
+
+  out.push_back(bnjr_rr_ptr(services_name, type, ttl));
+  out.push_back(bnjr_rr_ptr(type, full, ttl));
+  out.push_back(bnjr_rr_srv(full, hostname, port, 0, 0, ttl));
+  out.push_back(bnjr_rr_txt(full, txt, ttl));
+
+}
+
+void bnjr_responder::add_service(const std::string& instance, const std::string& service,
+                                 const std::string& hostname, uint16_t port,
+                                 const std::vector<bnjr_txt>& txt, uint32_t ttl) {
+  std::vector<bnjr_rr> rrs;
+  service_records(instance, service, hostname, port, txt, ttl, rrs);
+  add(rrs);
+}
+
+size_t bnjr_responder::size() const {
+  return(std::atomic_load(&db_)->count);
+}
+
+static void stats_add(bnjr_responder_stats& to, const bnjr_responder_stats& from) {
+  to.queries += from.queries;
+  to.answers += from.answers;
+  to.packets += from.packets;
+  to.known_suppressed += from.known_suppressed;
+  to.duplicate_suppressed += from.duplicate_suppressed;
+  to.rate_limited += from.rate_limited;
+}
+
+bnjr_responder_stats bnjr_responder::stats() const {
+  bnjr_responder_stats st = retired_;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i]->stats_m);
+    stats_add(st, shards_[i]->stats);
+  }
+  return(st);
+}
+
+static uint32_t source_hash(const struct sockaddr* from) {
+  const uint8_t* p;
+  size_t len;
+  if (from->sa_family == AF_INET6) {
+    p = (const uint8_t*)&((const struct sockaddr_in6*)from)->sin6_addr;
+    len = 16;
+  } else {
+    p = (const uint8_t*)&((const struct sockaddr_in*)from)->sin_addr;
+    len = 4;
+  }
+  uint32_t h = 2166136261U;
+  for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 16777619U;
+  uint16_t port = (from->sa_family == AF_INET6) ? ((const struct sockaddr_in6*)from)->sin6_port :
+    ((const struct sockaddr_in*)from)->sin_port;
+  h = (h ^ (port & 0xFF)) * 16777619U;
+  h = (h ^ (port >> 8)) * 16777619U;
+  return(h);
+}
+
+static int open_responder_socket(int family) {
+  if (family == AF_INET) {
+    struct sockaddr_in saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_addr.s_addr = INADDR_ANY;
+    saddr.sin_port = htons(MDNS_PORT);
+#ifdef __APPLE__
+    saddr.sin_len = sizeof(saddr);
+#endif
+    return(mdns_socket_open_ipv4(&saddr));
+  }
+  struct sockaddr_in6 saddr;
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sin6_family = AF_INET6;
+  saddr.sin6_addr = in6addr_any;
+  saddr.sin6_port = htons(MDNS_PORT);
+#ifdef __APPLE__
+  saddr.sin6_len = sizeof(saddr);
+#endif
+  return(mdns_socket_open_ipv6(&saddr));
+}
+
+bool bnjr_responder::start(bnjr_family family, int threads, std::string& err) {
+
+  stop();
+
+  if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+  if (threads <= 0) threads = 1;
+#ifndef SO_REUSEPORT
+  threads = 1;
+#endif
+
+  std::vector<int> families;
+  if (family & BNJR_FAMILY_IPV4) families.push_back(AF_INET);
+  if (family & BNJR_FAMILY_IPV6) families.push_back(AF_INET6);
+
+  for (int i = 0; i < threads; ++i) {
+
+    std::unique_ptr<shard> sh(new shard());
+    sh->index = i;
+    sh->rng.seed((unsigned)(mono_ms() + i));
+    memset(&sh->stats, 0, sizeof(sh->stats));
+
+    // one socket per family joined on every interface, or failing that one
+    // on the default interface
+    int socks[2];
+    std::vector<bnjr_egress> egress;
+    bnjr_iface_select select;
+    select.family = family;
+    int opened = open_family_sockets(socks, 2, MDNS_PORT, select, egress);
+
+    if (opened <= 0) {
+      for (size_t f = 0; f < families.size(); ++f) {
+        int sock = open_responder_socket(families[f]);
+        if (sock < 0) continue;
+        // a shard that can't tell multicast from unicast would drop unicast
+        // queries meant for it, so sharding needs destination addresses
+        if (!bnjr_want_pktinfo(sock, families[f]) && (threads > 1)) threads = i + 1;
+        bnjr_egress e;
+        e.sock = sock;
+        e.family = families[f];
+        e.ifindex = 0;
+        e.shared = false;
+        e.netns = 0;
+        e.addr.s_addr = INADDR_ANY;
+        egress.push_back(e);
+      }
+    }
+
+    for (size_t k = 0; k < egress.size(); ++k) {
+      if (sh->sockets.empty() || (sh->sockets.back().sock != egress[k].sock)) {
+        socket_state s;
+        s.sock = egress[k].sock;
+        s.family = (egress[k].family == AF_INET6) ? 1 : 0;
+        sh->sockets.push_back(s);
+      }
+      socket_state& s = sh->sockets.back();
+      iface_link l;
+      l.out = egress[k];
+      int last = links_per_family - 1;
+      l.slot = s.family * links_per_family + std::min((int)s.links.size(), last);
+      l.multicast.due_ms = 0;
+      s.links.push_back(l);
+    }
+
+    if (sh->sockets.empty()) break;
+
+    shards_.push_back(std::move(sh));
+    if ((int)shards_.size() >= threads) break;
+
+  }
+
+  if (shards_.empty()) {
+    err = std::string("Failed to open mDNS port 5353: ") + strerror(errno);
+    return(false);
+  }
+
+  stop_.store(false);
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shards_[i]->count = (int)shards_.size();
+    shards_[i]->thread = std::thread(&bnjr_responder::run, this, shards_[i].get());
+  }
+
+  return(true);
+
+}
+
+void bnjr_responder::stop() {
+
+  stop_.store(true);
+
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    shard& sh = *shards_[i];
+    if (sh.thread.joinable()) sh.thread.join();
+    for (size_t j = 0; j < sh.sockets.size(); ++j) mdns_socket_close(sh.sockets[j].sock);
+    stats_add(retired_, sh.stats);
+  }
+
+  shards_.clear();
+
+}
+
+void bnjr_responder::run(shard* sh) {
+
+  std::unique_ptr<uint32_t[]> aligned(new uint32_t[2048 / 4]);
+  uint8_t* buffer = (uint8_t*)aligned.get();
+
+  std::vector<socket_state>& sockets = sh->sockets;
+
+  while (!stop_.load()) {
+
+    int64_t now = mono_ms();
+    int64_t wait = BNJR_RESPONDER_IDLE_MS;
+
+    fd_set readfs;
+    FD_ZERO(&readfs);
+    int nfds = 0;
+
+    for (size_t i = 0; i < sockets.size(); ++i) {
+      FD_SET(sockets[i].sock, &readfs);
+      if (sockets[i].sock >= nfds) nfds = sockets[i].sock + 1;
+      for (size_t j = 0; j < sockets[i].links.size(); ++j) {
+        int64_t due = sockets[i].links[j].multicast.due_ms;
+        if (!due) continue;
+        int64_t left = due - now;
+        if (left < wait) wait = (left > 0) ? left : 0;
+      }
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = (long)(wait / 1000);
+    timeout.tv_usec = (long)((wait % 1000) * 1000);
+
+    int res = select(nfds, &readfs, 0, 0, &timeout);
+    if ((res < 0) && (errno != EINTR)) break;
+
+    for (size_t i = 0; (res > 0) && (i < sockets.size()); ++i) {
+      if (!FD_ISSET(sockets[i].sock, &readfs)) continue;
+      // sockets are non-blocking: drain everything that is queued
+      for (;;) {
+        struct sockaddr_storage from;
+        socklen_t addrlen = sizeof(from);
+        bnjr_recv_info info;
+        memset(&from, 0, sizeof(from));
+        int ret = bnjr_recv_datagram(sockets[i].sock, buffer, 2048, &from, &addrlen, &info);
+        if (ret <= 0) break;
+        // answer on the interface it came in on (the first one when unknown)
+        std::vector<iface_link>& links = sockets[i].links;
+        size_t l = 0;
+        while ((l < links.size()) && (links[l].out.ifindex != info.ifindex)) ++l;
+        if (l == links.size()) l = 0;
+        handle(*sh, links[l], (const struct sockaddr*)&from, addrlen, info.multicast, buffer,
+               (size_t)ret, mono_ms());
+      }
+    }
+
+    now = mono_ms();
+    for (size_t i = 0; i < sockets.size(); ++i) {
+      for (size_t j = 0; j < sockets[i].links.size(); ++j) {
+        iface_link& l = sockets[i].links[j];
+        if (l.multicast.due_ms && (l.multicast.due_ms <= now)) flush(*sh, l, now);
+      }
+    }
+
+  }
+
+}
+
+void bnjr_responder::handle(shard& sh, iface_link& l, const struct sockaddr* from, size_t addrlen,
+                            bool multicast, const uint8_t* buffer, size_t size, int64_t now) {
+
+  if (size < 12) return;
+
+  bnjr_responder_stats st;
+  memset(&st, 0, sizeof(st));
+
+  if (be16(buffer + 2) & 0x8000) {
+    handle_response(l, buffer, size, st);
+  } else {
+    // every shard gets its own copy of a multicast query; only one answers
+    if (multicast && (sh.count > 1) && ((int)(source_hash(from) % sh.count) != sh.index))
+      return;
+    database_ref db = std::atomic_load(&db_);
+    handle_query(sh, l, *db, from, addrlen, multicast, buffer, size, now, st);
+  }
+
+  std::lock_guard<std::mutex> lock(sh.stats_m);
+  stats_add(sh.stats, st);
+
+}
+
+static bool rr_matches(const bnjr_rr& rr, const uint8_t* buffer, size_t size, size_t name_offset,
+                       uint16_t rtype, size_t rdata_offset, size_t rdata_length) {
+
+  if (rr.rtype != rtype) return(false);
+
+  char name[256];
+  size_t ofs = name_offset;
+  mdns_string_t owner = mdns_string_extract(buffer, size, &ofs, name, sizeof(name));
+  if (!same_name(owner.str, owner.length, rr.name)) return(false);
+
+  if ((rtype == MDNS_RECORDTYPE_PTR) || (rtype == MDNS_RECORDTYPE_SRV)) {
+    ofs = rdata_offset;
+    if (rtype == MDNS_RECORDTYPE_SRV) {
+      if ((rdata_length < 6) || memcmp(buffer + rdata_offset, rr.rdata.data(), 6)) return(false);
+      ofs += 6;
+    }
+    mdns_string_t target = mdns_string_extract(buffer, size, &ofs, name, sizeof(name));
+    return(same_name(target.str, target.length, rr.target));
+  }
+
+  return((rdata_length == rr.rdata.size()) &&
+         !memcmp(buffer + rdata_offset, rr.rdata.data(), rdata_length));
+
+}
+
+// Drops from `rrs` whatever the records of a message say the other side
+// already has (with at least half our TTL left). T is the responder's
+// private entry_ref.
+template <class T>
+struct suppress_ctx {
+  std::vector<T>* rrs;
+  uint64_t suppressed;
+};
+
+template <class T>
+static int suppress_callback(int sock, const struct sockaddr* from, size_t addrlen,
+                             mdns_entry_type_t entry, uint16_t query_id, uint16_t rtype,
+                             uint16_t rclass, uint32_t ttl, const void* data, size_t size,
+                             size_t name_offset, size_t name_length, size_t record_offset,
+                             size_t record_length, void* user_data) {
+
+  suppress_ctx<T>* ctx = (suppress_ctx<T>*)user_data;
+  std::vector<T>& rrs = *ctx->rrs;
+
+  for (size_t i = 0; i < rrs.size(); ) {
+    const bnjr_rr& rr = rrs[i]->rr;
+    if (((uint64_t)ttl * 2 >= rr.ttl) &&
+        rr_matches(rr, (const uint8_t*)data, size, name_offset, rtype, record_offset,
+                   record_length)) {
+      rrs.erase(rrs.begin() + i);
+      ++ctx->suppressed;
+    } else {
+      ++i;
+    }
+  }
+
+  return(rrs.empty() ? 1 : 0);  // nothing left to suppress: stop parsing
+
+}
+
+void bnjr_responder::handle_query(shard& sh, iface_link& l, const database& db,
+                                  const struct sockaddr* from, size_t addrlen, bool multicast,
+                                  const uint8_t* buffer, size_t size, int64_t now,
+                                  bnjr_responder_stats& st) {
+
+  uint16_t query_id = be16(buffer);
+  uint16_t questions = be16(buffer + 4);
+  uint16_t answer_rrs = be16(buffer + 6);
+
+  uint16_t sport = (from->sa_family == AF_INET6) ?
+    ntohs(((const struct sockaddr_in6*)from)->sin6_port) :
+    ntohs(((const struct sockaddr_in*)from)->sin_port);
+  bool legacy = (sport != MDNS_PORT);
+
+  std::vector<entry_ref> answers;
+  bool unicast = !multicast;
+  std::string first_question;
+  uint16_t first_qtype = 0;
+
+  size_t ofs = 12;
+  char name[256];
+
+  for (uint16_t iq = 0; iq < questions; ++iq) {
+
+    size_t qofs = ofs;
+    mdns_string_t qname = mdns_string_extract(buffer, size, &ofs, name, sizeof(name));
+    if ((ofs == qofs) || (ofs + 4 > size)) return;  // a name we can't read
+    uint16_t qtype = be16(buffer + ofs);
+    uint16_t qclass = be16(buffer + ofs + 2);
+    ofs += 4;
+
+    ++st.queries;
+
+    if (!iq) {
+      first_question.assign(qname.str, qname.length);
+      first_qtype = qtype;
+    }
+
+    if (((qclass & 0x7FFF) != MDNS_CLASS_IN) && ((qclass & 0x7FFF) != 255)) continue;
+    if (qclass & MDNS_UNICAST_RESPONSE) unicast = true;
+
+    const std::vector<entry_ref>* found = lookup(db, qname.str, qname.length, qtype);
+    if (!found) continue;
+
+    for (size_t i = 0; i < found->size(); ++i) {
+      if (std::find(answers.begin(), answers.end(), (*found)[i]) == answers.end())
+        answers.push_back((*found)[i]);
+    }
+
+  }
+
+  if (answers.empty()) return;
+
+  // known-answer suppression (7.1)
+  if (answer_rrs) {
+    suppress_ctx<entry_ref> ctx = { &answers, 0 };
+    mdns_records_parse(l.out.sock, from, addrlen, buffer, size, &ofs, MDNS_ENTRYTYPE_ANSWER,
+                       query_id, answer_rrs, suppress_callback<entry_ref>, &ctx);
+    st.known_suppressed += ctx.suppressed;
+    if (answers.empty()) return;
+  }
+
+  if (legacy || unicast) {
+    send(db, l.out, from, addrlen, answers, legacy ? query_id : 0, first_question, first_qtype,
+         legacy, st);
+    return;
+  }
+
+  // multicast: rate limit, then merge into the pending response
+  bool shared = false;
+
+  for (size_t i = 0; i < answers.size(); ++i) {
+    const entry_ref& e = answers[i];
+    int64_t last = e->last_multicast[l.slot].load(std::memory_order_relaxed);
+    if (last && (now - last < BNJR_RATE_LIMIT_MS)) {
+      ++st.rate_limited;
+      continue;
+    }
+    if (!e->rr.unique) shared = true;
+    std::vector<entry_ref>& pend = l.multicast.rrs;
+    if (std::find(pend.begin(), pend.end(), e) == pend.end()) pend.push_back(e);
+  }
+
+  if (l.multicast.rrs.empty()) return;
+
+  int64_t due = now;
+  if (shared) {
+    std::uniform_int_distribution<int> jitter(BNJR_AGGREGATE_MIN_MS, BNJR_AGGREGATE_MAX_MS);
+    due += jitter(sh.rng);
+  }
+
+  if (!l.multicast.due_ms || (due < l.multicast.due_ms)) l.multicast.due_ms = due;
+
+}
+
+// duplicate answer suppression (7.4)
+void bnjr_responder::handle_response(iface_link& l, const uint8_t* buffer, size_t size,
+                                     bnjr_responder_stats& st) {
+
+  if (l.multicast.rrs.empty()) return;
+
+  suppress_ctx<entry_ref> ctx = { &l.multicast.rrs, 0 };
+  mdns_message_parse(l.out.sock, 0, 0, buffer, size, suppress_callback<entry_ref>, &ctx, 0, -1);
+  st.duplicate_suppressed += ctx.suppressed;
+
+  if (l.multicast.rrs.empty()) l.multicast.due_ms = 0;
+
+}
+
+void bnjr_responder::flush(shard& sh, iface_link& l, int64_t now) {
+
+  std::vector<entry_ref> rrs;
+  rrs.swap(l.multicast.rrs);
+  l.multicast.due_ms = 0;
+
+  bnjr_responder_stats st;
+  memset(&st, 0, sizeof(st));
+
+  // the rate limit is shared by all shards: claim each record's slot, and
+  // leave out anything another shard multicast in the meantime
+  for (size_t i = 0; i < rrs.size(); ) {
+    std::atomic<int64_t>& last = rrs[i]->last_multicast[l.slot];
+    int64_t seen = last.load();
+    if ((seen && (now - seen < BNJR_RATE_LIMIT_MS)) || !last.compare_exchange_strong(seen, now)) {
+      rrs.erase(rrs.begin() + i);
+      ++st.rate_limited;
+    } else {
+      ++i;
+    }
+  }
+
+  if (rrs.size()) {
+    database_ref db = std::atomic_load(&db_);
+    send(*db, l.out, 0, 0, rrs, 0, std::string(), 0, false, st);
+  }
+
+  std::lock_guard<std::mutex> lock(sh.stats_m);
+  stats_add(sh.stats, st);
+
+}
+
+// RFC 6763 12: PTR answers bring their SRV/TXT, SRV brings the host's
+// addresses.
+void bnjr_responder::additional_for(const database& db, const std::vector<entry_ref>& answers,
+                                    std::vector<entry_ref>& out) const {
+
+  std::vector<entry_ref> all(answers);
+
+  for (size_t ia = 0; ia < all.size(); ++ia) {
+
+    const bnjr_rr& a = all[ia]->rr;
+    uint16_t wanted[2];
+
+    if (a.rtype == MDNS_RECORDTYPE_PTR) {
+      wanted[0] = MDNS_RECORDTYPE_SRV;
+      wanted[1] = MDNS_RECORDTYPE_TXT;
+    } else if (a.rtype == MDNS_RECORDTYPE_SRV) {
+      wanted[0] = MDNS_RECORDTYPE_A;
+      wanted[1] = MDNS_RECORDTYPE_AAAA;
+    } else {
+      continue;
+    }
+
+    for (int w = 0; w < 2; ++w) {
+      const std::vector<entry_ref>* found = lookup(db, a.target.data(), a.target.size(), wanted[w]);
+      if (!found) continue;
+      for (size_t i = 0; i < found->size(); ++i) {
+        if (std::find(all.begin(), all.end(), (*found)[i]) != all.end()) continue;
+        all.push_back((*found)[i]);
+        out.push_back((*found)[i]);
+      }
+    }
+
+  }
+
+}
+
+void bnjr_responder::send(const database& db, const bnjr_egress& out, const struct sockaddr* to,
+                          size_t tolen, const std::vector<entry_ref>& rrs, uint16_t query_id,
+                          const std::string& question, uint16_t qtype, bool legacy,
+                          bnjr_responder_stats& st) {
+
+  uint8_t buffer[BNJR_RESPONSE_SIZE];
+
+  std::vector<entry_ref> extra;
+  additional_for(db, rrs, extra);
+
+  size_t next = 0;
+
+  while (next < rrs.size()) {
+
+    bnjr_packet_writer pkt(buffer, sizeof(buffer), query_id);
+    pkt.set_flags(0x8400);
+
+    // legacy resolvers expect their question back (6.7)
+    if (legacy && question.size()) pkt.add_question(question, qtype, false);
+
+    for (; next < rrs.size(); ++next) {
+      const bnjr_rr& rr = rrs[next]->rr;
+      uint16_t rclass = MDNS_CLASS_IN | ((rr.unique && !legacy) ? MDNS_CACHE_FLUSH : 0);
+      uint32_t ttl = (legacy && (rr.ttl > BNJR_LEGACY_TTL)) ? BNJR_LEGACY_TTL : rr.ttl;
+      if (!pkt.add_record(MDNS_ENTRYTYPE_ANSWER, rr.name, rr.rtype, rclass, ttl,
+                          rr.rdata.data(), rr.rdata.size()))
+        break;
+    }
+
+    if (!pkt.answers()) break;  // a record too big for any packet
+
+    // additional records only ride along in the last packet, as far as they fit
+    if (next == rrs.size()) {
+      for (size_t i = 0; i < extra.size(); ++i) {
+        const bnjr_rr& rr = extra[i]->rr;
+        uint16_t rclass = MDNS_CLASS_IN | ((rr.unique && !legacy) ? MDNS_CACHE_FLUSH : 0);
+        uint32_t ttl = (legacy && (rr.ttl > BNJR_LEGACY_TTL)) ? BNJR_LEGACY_TTL : rr.ttl;
+        pkt.add_record(MDNS_ENTRYTYPE_ADDITIONAL, rr.name, rr.rtype, rclass, ttl,
+                       rr.rdata.data(), rr.rdata.size());
+      }
+    }
+
+    int res = to ? mdns_unicast_send(out.sock, to, tolen, buffer, pkt.size()) :
+      bnjr_multicast_send(out, buffer, pkt.size());
+
+    if (!res) {
+      ++st.packets;
+      st.answers += (uint64_t)pkt.answers();
+    }
+
+  }
+
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bonjour-iface.h"
+#include "bonjour-record.h"
+
+// A record we publish. rdata is kept in wire format (names uncompressed) so
+// it can be copied straight into packets; target holds the PTR/SRV target
+// name for comparing against copies heard from the network.
+typedef struct {
+  std::string name;
+  uint16_t rtype;
+  bool unique;          // sent with the cache-flush bit (SRV/TXT/A/AAAA)
+  uint32_t ttl;
+  std::string rdata;
+  std::string target;
+} bnjr_rr;
+
+bnjr_rr bnjr_rr_ptr(const std::string& name, const std::string& target, uint32_t ttl);
+bnjr_rr bnjr_rr_srv(const std::string& name, const std::string& target, uint16_t port,
+                    uint16_t priority, uint16_t weight, uint32_t ttl);
+bnjr_rr bnjr_rr_txt(const std::string& name, const std::vector<bnjr_txt>& txt, uint32_t ttl);
+bnjr_rr bnjr_rr_addr(const std::string& name, const struct sockaddr* addr, uint32_t ttl);
+
+// PTR from the address's in-addr.arpa/ip6.arpa name back to name (RFC 6762
+// asks responders to answer reverse lookups for their own addresses).
+bnjr_rr bnjr_rr_reverse(const struct sockaddr* addr, const std::string& name, uint32_t ttl);
+
+typedef struct {
+  uint64_t queries;              // questions received
+  uint64_t answers;              // records sent
+  uint64_t packets;              // responses sent
+  uint64_t known_suppressed;     // listed as a known answer by the querier (7.1)
+  uint64_t duplicate_suppressed; // someone else multicast it first (7.4)
+  uint64_t rate_limited;         // multicast less than a second ago (6)
+} bnjr_responder_stats;
+
+// mDNS responder for a set of published records.
+//
+// Records live in an immutable snapshot indexed by (owner name, rtype), so
+// answering a question is a hash lookup however many services are published.
+// add() builds a new snapshot and swaps it in; receive threads never lock.
+//
+// Receiving is sharded over N threads, each with its own SO_REUSEPORT socket
+// per address family. The kernel spreads unicast datagrams over the sockets
+// but hands every multicast datagram to all of them, so each shard only
+// answers multicast queries whose sender hashes to it (which also keeps one
+// querier's queries on one shard) and every shard sees responses, for
+// duplicate suppression of its own pending answers. Without SO_REUSEPORT
+// there is a single shard.
+//
+// Each socket is joined to the group on every interface; IP_PKTINFO tells
+// which one a query came in on and multicast answers go back out of that
+// interface only. Where that isn't available (Windows) the socket joins on
+// the default interface, as before.
+//
+// Besides known-answer suppression it keeps our answers from piling onto
+// busy links the way RFC 6762 asks:
+//
+//  * a record is multicast at most once per second per interface (6);
+//  * answers containing shared records (PTR) are delayed by a random
+//    20-120 ms and answers to every query that arrives meanwhile are merged
+//    into one packet (6.3); unique-only answers go out at once;
+//  * pending answers are dropped if another responder multicasts the same
+//    record, with at least half our TTL, before we get to send (7.4).
+//
+// Questions with the unicast-response bit, and legacy one-shot queries from
+// ports other than 5353, are answered directly to the sender.
+class bnjr_responder {
+
+public:
+
+  bnjr_responder();
+  ~bnjr_responder();
+
+  // threads <= 0 uses one shard per core
+  bool start(bnjr_family family, int threads, std::string& err);
+  void stop();
+
+  bool running() const { return(!shards_.empty()); }
+  int shards() const { return((int)shards_.size()); }
+
+  // Safe to call while running; publish many records in one call where
+  // possible since each call copies the index.
+  void add(const bnjr_rr& rr);
+  void add(const std::vector<bnjr_rr>& rrs);
+  void add_service(const std::string& instance, const std::string& service,
+                   const std::string& hostname, uint16_t port,
+                   const std::vector<bnjr_txt>& txt, uint32_t ttl);
+  static void service_records(const std::string& instance, const std::string& service,
+                              const std::string& hostname, uint16_t port,
+                              const std::vector<bnjr_txt>& txt, uint32_t ttl,
+                              std::vector<bnjr_rr>& out);
+
+  size_t size() const;
+
+  bnjr_responder_stats stats() const;
+
+private:
+
+  // rate limit slots per family; interfaces past the last share it
+  static const int links_per_family = 8;
+
+  struct entry {
+    bnjr_rr rr;
+    std::atomic<int64_t> last_multicast[2 * links_per_family];  // shared by all shards
+  };
+
+  typedef std::shared_ptr<entry> entry_ref;
+
+  // key: lower-cased owner name without the trailing dot, NUL, rtype (2 bytes);
+  // every entry is also listed under MDNS_RECORDTYPE_ANY.
+  struct database {
+    size_t count;
+    std::unordered_map<std::string, std::vector<entry_ref>> index;
+  };
+
+  typedef std::shared_ptr<const database> database_ref;
+
+  struct pending {
+    int64_t due_ms;               // 0 = nothing pending
+    std::vector<entry_ref> rrs;
+  };
+
+  // an interface a socket answers on
+  struct iface_link {
+    bnjr_egress out;
+    int slot;                     // into entry::last_multicast
+    pending multicast;
+  };
+
+  struct socket_state {
+    int sock;
+    int family;                   // 0 = IPv4, 1 = IPv6
+    std::vector<iface_link> links;
+  };
+
+  struct shard {
+    int index;
+    int count;
+    std::vector<socket_state> sockets;
+    std::minstd_rand rng;
+    bnjr_responder_stats stats;
+    std::mutex stats_m;
+    std::thread thread;
+  };
+
+  bnjr_responder(const bnjr_responder&);
+  bnjr_responder& operator=(const bnjr_responder&);
+
+  static std::string key(const char* name, size_t length, uint16_t rtype);
+  const std::vector<entry_ref>* lookup(const database& db, const char* name, size_t length,
+                                       uint16_t rtype) const;
+
+  void run(shard* sh);
+  void handle(shard& sh, iface_link& l, const struct sockaddr* from, size_t addrlen, bool multicast,
+              const uint8_t* buffer, size_t size, int64_t now);
+  void handle_query(shard& sh, iface_link& l, const database& db, const struct sockaddr* from,
+                    size_t addrlen, bool multicast, const uint8_t* buffer, size_t size,
+                    int64_t now, bnjr_responder_stats& st);
+  void handle_response(iface_link& l, const uint8_t* buffer, size_t size, bnjr_responder_stats& st);
+  void flush(shard& sh, iface_link& l, int64_t now);
+  void send(const database& db, const bnjr_egress& out, const struct sockaddr* to, size_t tolen,
+            const std::vector<entry_ref>& rrs, uint16_t query_id, const std::string& question,
+            uint16_t qtype, bool legacy, bnjr_responder_stats& st);
+  void additional_for(const database& db, const std::vector<entry_ref>& answers,
+                      std::vector<entry_ref>& out) const;
+
+  mutable std::mutex db_m_;     // serializes writers of db_
+  database_ref db_;             // read with std::atomic_load
+
+  std::vector<std::unique_ptr<shard>> shards_;
+  bnjr_responder_stats retired_;  // from shards of earlier runs
+  std::atomic<bool> stop_;
+
+};
@@ -0,0 +1,238 @@
+#include "bonjour-scan.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <unordered_set>
+
+#include "bonjour-packet.h"
+
+static const char services_name[] = "_services._dns-sd._udp.local.";
+
+// Send a PTR question carrying the known answers, spilling into extra
+// (TC-flagged) packets when they don't all fit, per RFC 6762 7.2.
+static int send_with_known_answers(const bnjr_egress& out, const std::string& name,
+                                   const std::vector<bnjr_record>& known,
+                                   std::vector<char>& buffer, bnjr_priority priority) {
+
+  size_t next = 0;
+  bool first = true;
+
+  do {
+
+    bnjr_packet_writer pkt(buffer.data(), buffer.size());
+
+    if (first &&
+        !pkt.add_question(name, MDNS_RECORDTYPE_PTR, bnjr_socket_wants_unicast(out.sock)))
+      return(-1);
+
+    while ((next < known.size()) && pkt.add_answer_ptr(name, known[next].ttl, known[next].target))
+      ++next;
+
+    if (!first && !pkt.answers()) return(-1);  // a single answer that can't fit
+    if (next < known.size()) pkt.set_truncated();
+
+    if (bnjr_pacer::shared().send(out, buffer.data(), pkt.size(), priority)) return(-1);
+
+    first = false;
+
+  } while (next < known.size());
+
+  return(0);
+
+}
+
+// Latency is measured from the query that went out of the interface a
+// record came in on (or the first one sent, when that isn't known).
+static void stamp_sent(bnjr_record& rec, const std::vector<std::pair<unsigned int, int64_t>>& sent) {
+
+  if (sent.empty()) return;
+
+  rec.sent_ns = sent[0].second;
+  for (size_t i = 1; i < sent.size(); ++i) rec.sent_ns = std::min(rec.sent_ns, sent[i].second);
+
+  for (size_t i = 0; i < sent.size(); ++i) {
+    if (sent[i].first == rec.ifindex) {
+      rec.sent_ns = sent[i].second;
+      break;
+    }
+  }
+
+}
+
+void bnjr_scan(const bnjr_scan_spec& spec, bnjr_scan_result& result) {
+
+  int sockets[32];
+
+  std::vector<bnjr_egress> egress;
+  std::vector<std::string> ifnames;
+
+  const bnjr_netns* ns = spec.netns.size() ? bnjr_netns::get(spec.netns) : 0;
+  int num_sockets = 0;
+
+  // listening means hearing everyone's multicast: port 5353 on the wildcard
+  // address, joined on every selected interface
+  bool listen = (spec.mode == BNJR_SCAN_LISTEN);
+
+  auto open_sockets = [&]() {
+    num_sockets = open_query_sockets(sockets, sizeof(sockets) / sizeof(sockets[0]),
+                                     listen ? MDNS_PORT : 0, spec.interfaces,
+                                     listen ? BNJR_SOCKETS_FAMILY : spec.sockets, egress,
+                                     &ifnames);
+  };
+
+  if (ns) {
+    std::string err;
+    if (!ns->enter(open_sockets, err)) {
+      result.warnings.push_back("Skipping network namespace " + ns->name() + ": " + err);
+      return;
+    }
+    ns->add_interfaces(egress);
+    for (size_t i = 0; i < egress.size(); ++i) egress[i].netns = ns;
+  } else {
+    open_sockets();
+  }
+
+  if (num_sockets <= 0) {
+    result.error = "Failed to open any client sockets";
+    return;
+  }
+
+  size_t capacity = 2048;
+  std::vector<char> buffer(capacity);
+
+  std::vector<bnjr_record> known;
+  std::string question = (spec.mode == BNJR_SCAN_DISCOVER) ? services_name : spec.query;
+
+  if (spec.cache && !listen) {
+    int64_t now = bnjr_cache::now_ms();
+    spec.cache->expire(now);
+    known = spec.cache->known_answers(question, MDNS_RECORDTYPE_PTR, now, ns);
+  }
+
+  // when each interface's query left, by interface index
+  std::vector<std::pair<unsigned int, int64_t>> sent;
+
+  bnjr_pacer& pacer = bnjr_pacer::shared();
+
+  // queries go out with id 0, so replies are matched on the question alone
+  for (size_t i = 0; !listen && (i < egress.size()); ++i) {
+    if (known.size()) {
+      if ((send_with_known_answers(egress[i], question, known, buffer, spec.priority) < 0) &&
+          (errno != EHOSTUNREACH))
+        result.warnings.push_back(std::string("Failed to send mDNS query: ") + strerror(errno));
+    } else if (spec.mode == BNJR_SCAN_DISCOVER) {
+      if (pacer.send(egress[i], mdns_services_query, sizeof(mdns_services_query), spec.priority) &&
+          (errno != EHOSTUNREACH))
+        result.warnings.push_back(std::string("Failed to send DNS-DS discovery: ") + strerror(errno));
+    } else {
+      bnjr_packet_writer pkt(buffer.data(), capacity);
+      if ((!pkt.add_question(spec.query, MDNS_RECORDTYPE_PTR,
+                             bnjr_socket_wants_unicast(egress[i].sock)) ||
+           pacer.send(egress[i], buffer.data(), pkt.size(), spec.priority)) &&
+          (errno != EHOSTUNREACH))
+        result.warnings.push_back(std::string("Failed to send mDNS query: ") + strerror(errno));
+    }
+    // stamped once the pacer has let the query go, so its wait isn't
+    // counted as the responders' latency
+    unsigned int ifindex = egress[i].ifindex;
+    bool seen = false;
+    for (size_t j = 0; !seen && (j < sent.size()); ++j) seen = (sent[j].first == ifindex);
+    if (!seen) sent.push_back(std::make_pair(ifindex, bnjr_wall_ns()));
+  }
+
+  // register this scan's sockets as capture interfaces before anything is received
+  int iface_id[32];
+  bool recording = spec.recorder && spec.recorder->is_open();
+
+  if (recording) {
+    for (int isock = 0; isock < num_sockets; ++isock) {
+      struct sockaddr_storage local;
+      socklen_t len = sizeof(local);
+      memset(&local, 0, sizeof(local));
+      getsockname(sockets[isock], (struct sockaddr*)&local, &len);
+      iface_id[isock] = spec.recorder->add_interface(ifnames[isock], (struct sockaddr*)&local);
+    }
+  }
+
+  // keys of what was heard fresh, for the known answers below
+  std::unordered_set<std::string> seen;
+
+  {
+    bnjr_engine engine(sockets, 0, num_sockets, spec.mode, &spec.filter);
+    engine.set_cache(spec.cache.get());
+    engine.set_netns(ns);
+    engine.set_traffic(spec.traffic.get());
+    engine.set_stop(spec.stop.get());
+    if (recording) engine.set_recorder(spec.recorder.get(), iface_id);
+    if (spec.hosts && known.size()) {
+      // note what is heard fresh on its way into the host table
+      engine.set_sink([&](bnjr_record& rec) {
+        seen.insert(bnjr_record_key(rec));
+        spec.hosts->add(rec);
+      });
+    } else if (spec.hosts) {
+      engine.set_hosts(spec.hosts.get());
+    } else if (spec.on_record) {
+      engine.set_sink([&](bnjr_record& rec) {
+        stamp_sent(rec, sent);
+        if (known.size()) seen.insert(bnjr_record_key(rec));
+        spec.on_record(rec);
+      });
+    }
+    result.records = engine.run(spec.scan_time);
+  }
+
+  for (size_t i = 0; i < result.records.size(); ++i) {
+    stamp_sent(result.records[i], sent);
+    if (known.size()) seen.insert(bnjr_record_key(result.records[i]));
+  }
+
+  for (int isock = 0; isock < num_sockets; ++isock)
+    mdns_socket_close(sockets[isock]);
+
+  // Responders stay quiet about answers we already listed, so hand those
+  // back from the cache alongside whatever was heard fresh (just once).
+  for (size_t i = 0; i < known.size(); ++i) {
+    if (seen.count(bnjr_record_key(known[i]))) continue;
+    if (spec.hosts) {
+      spec.hosts->add(known[i]);
+    } else if (spec.on_record) {
+      spec.on_record(known[i]);
+    } else {
+      result.records.push_back(known[i]);
+    }
+  }
+
+}
+
+void bnjr_scan_all(const std::vector<bnjr_scan_spec>& specs,
+                   std::vector<bnjr_scan_result>& results) {
+
+  results.clear();
+  results.resize(specs.size());
+
+  if (specs.size() == 1) {
+    bnjr_scan(specs[0], results[0]);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < specs.size(); ++i)
+    threads.push_back(std::thread(bnjr_scan, std::cref(specs[i]), std::ref(results[i])));
+
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+
+}
+
+std::string bnjr_records_to_ndjson(const std::vector<bnjr_record>& records) {
+
+  std::string out;
+  out.reserve(records.size() * 128);
+
+  for (size_t i = 0; i < records.size(); ++i) bnjr_record_to_json(records[i], out);
+
+  return(out);
+
+}
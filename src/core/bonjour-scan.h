@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bonjour-engine.h"
+#include "bonjour-iface.h"
+#include "bonjour-pacer.h"
+
+// Everything needed to run one scan, independent of who asked for it (the
+// blocking R entry points or an async handle on a background thread).
+typedef struct {
+  bnjr_scan_mode mode = BNJR_SCAN_DISCOVER;
+  std::string query;
+  int scan_time = 10;
+  bnjr_filter filter;
+  bnjr_iface_select interfaces;
+  bnjr_socket_model sockets = BNJR_SOCKETS_INTERFACE;
+  bnjr_priority priority = BNJR_PRIORITY_INTERACTIVE;  // for the shared send pacer
+  std::shared_ptr<bnjr_cache> cache;
+  std::shared_ptr<bnjr_recorder> recorder;
+  std::shared_ptr<bnjr_host_table> hosts;  // aggregate into this instead of returning records
+  std::string netns;            // Linux network namespace to scan in, "" = ours
+  std::shared_ptr<bnjr_traffic> traffic;   // count every datagram heard into this
+  std::shared_ptr<std::atomic<bool>> stop;  // set to end the scan early, keeping what came in
+  // Streams records as they arrive instead of returning them, on the scan's
+  // own thread (so from several at once under bnjr_scan_all())
+  std::function<void(const bnjr_record&)> on_record;
+} bnjr_scan_spec;
+
+typedef struct {
+  std::vector<bnjr_record> records;
+  std::vector<std::string> warnings;
+  std::string error;
+} bnjr_scan_result;
+
+// Open sockets, send the discovery/query, run the receive engine and close
+// the sockets again. Never calls into R: problems are reported through
+// result.error (fatal) and result.warnings so this is safe on any thread.
+// With spec.netns set the sockets are opened inside that namespace and the
+// records come back tagged with it; a namespace that can't be entered is a
+// warning and an empty result, so one bad path doesn't sink a whole
+// bnjr_scan_all() across namespaces. BNJR_SCAN_LISTEN sends nothing and
+// listens on the mDNS port itself for scan_time seconds, so spec.traffic sees
+// everybody's queries and answers, not just replies to ours.
+void bnjr_scan(const bnjr_scan_spec& spec, bnjr_scan_result& result);
+
+// Run independent scans side by side, one thread each. A scan owns its
+// sockets, receive workers, decode buffers and result, so the only things
+// they can share are a cache or recorder, and those lock internally.
+void bnjr_scan_all(const std::vector<bnjr_scan_spec>& specs,
+                   std::vector<bnjr_scan_result>& results);
+
+std::string bnjr_records_to_ndjson(const std::vector<bnjr_record>& records);
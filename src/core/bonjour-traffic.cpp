@@ -0,0 +1,346 @@
+#include "bonjour-traffic.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// flagged sources kept at most; the least recently flagged go first
+#define BNJR_TRAFFIC_MAX_FLAGS 1024
+
+bnjr_traffic_spec bnjr_traffic_defaults() {
+  bnjr_traffic_spec spec;
+  spec.window = 60;
+  spec.limit = 1000;
+  spec.top = 10;
+  spec.capacity = 256;
+  spec.width = 4096;
+  spec.depth = 4;
+  return(spec);
+}
+
+// FNV-1a over the kind and the key, so the kinds share one sketch.
+static uint64_t key_hash(bnjr_traffic_kind kind, const std::string& key) {
+  uint64_t h = 14695981039346656037ULL;
+  h = (h ^ (uint64_t)kind) * 1099511628211ULL;
+  for (size_t i = 0; i < key.size(); ++i) h = (h ^ (unsigned char)key[i]) * 1099511628211ULL;
+  return(h);
+}
+
+// splitmix64 finaliser: the second hash for double hashing across rows
+static uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return(x ^ (x >> 31));
+}
+
+static std::string rtype_key(uint16_t rtype) {
+  switch (rtype) {
+  case MDNS_RECORDTYPE_PTR: return("PTR");
+  case MDNS_RECORDTYPE_SRV: return("SRV");
+  case MDNS_RECORDTYPE_A: return("A");
+  case MDNS_RECORDTYPE_AAAA: return("AAAA");
+  case MDNS_RECORDTYPE_TXT: return("TXT");
+  case MDNS_RECORDTYPE_ANY: return("ANY");
+  }
+  return(std::to_string(rtype));
+}
+
+bnjr_traffic::bnjr_traffic(const bnjr_traffic_spec& spec) : spec_(spec), slot_(0) {
+
+  if (spec_.window < 1) spec_.window = 1;
+  if (spec_.width < 16) spec_.width = 16;
+  if (spec_.depth < 1) spec_.depth = 1;
+  if (spec_.capacity < spec_.top) spec_.capacity = spec_.top;
+
+  slot_ns_ = (int64_t)spec_.window * 1000000000LL / (int64_t)slots_;
+  sketch_.assign(slots_ * spec_.depth * spec_.width, 0);
+  memset(slot_total_, 0, sizeof(slot_total_));
+
+  totals_.datagrams = totals_.bytes = totals_.queries = totals_.responses = 0;
+  totals_.malformed = totals_.recent = 0;
+  totals_.first_ns = totals_.last_ns = 0;
+
+}
+
+// Move the window up to ts, clearing the slots that fell out of it. Late
+// datagrams (another worker's, a hair older) count in the newest slot.
+void bnjr_traffic::advance(int64_t ts) {
+
+  int64_t slot = ts / slot_ns_;
+
+  if (!totals_.first_ns) {
+    slot_ = slot;
+    return;
+  }
+
+  if (slot <= slot_) return;
+
+  int64_t steps = std::min(slot - slot_, (int64_t)slots_);
+  size_t row = spec_.depth * spec_.width;
+
+  for (int64_t k = 1; k <= steps; ++k) {
+    size_t s = (size_t)((slot_ + k) % (int64_t)slots_);
+    std::fill(sketch_.begin() + s * row, sketch_.begin() + (s + 1) * row, 0);
+    slot_total_[s] = 0;
+  }
+
+  slot_ = slot;
+
+}
+
+// Datagrams (or questions) for a key over the whole window: per row, the
+// sum across slots; the smallest row wins.
+uint64_t bnjr_traffic::estimate(uint64_t hash) const {
+
+  uint64_t h2 = mix(hash) | 1;
+  uint64_t best = UINT64_MAX;
+  size_t row = spec_.depth * spec_.width;
+
+  for (size_t d = 0; d < spec_.depth; ++d) {
+    size_t col = (size_t)((hash + d * h2) % spec_.width);
+    uint64_t sum = 0;
+    for (size_t s = 0; s < slots_; ++s) sum += sketch_[s * row + d * spec_.width + col];
+    best = std::min(best, sum);
+  }
+
+  return(best);
+
+}
+
+// Count a key in the current slot and the space-saving table for its kind;
+// returns its count over the window.
+uint64_t bnjr_traffic::count(bnjr_traffic_kind kind, const std::string& key) {
+
+  uint64_t hash = key_hash(kind, key);
+  uint64_t h2 = mix(hash) | 1;
+  size_t base = (size_t)(slot_ % (int64_t)slots_) * spec_.depth * spec_.width;
+
+  for (size_t d = 0; d < spec_.depth; ++d) {
+    uint32_t& c = sketch_[base + d * spec_.width + (size_t)((hash + d * h2) % spec_.width)];
+    if (c < UINT32_MAX) ++c;
+  }
+
+  top_table& t = tables_[kind];
+  auto it = t.index.find(key);
+
+  if (it != t.index.end()) {
+    size_t i = it->second;
+    ++t.counters[i].count;
+    t.sift_down(i);
+  } else if (t.counters.size() < spec_.capacity) {
+    t.index[key] = t.counters.size();
+    counter c = { key, 1, 0 };
+    t.counters.push_back(c);
+    t.sift_up(t.counters.size() - 1);
+  } else {
+    // the new key takes over the smallest counter, inheriting its count as
+    // the bound on its own error
+    counter& c = t.counters[0];
+    t.index.erase(c.key);
+    t.index[key] = 0;
+    c.key = key;
+    c.error = c.count;
+    ++c.count;
+    t.sift_down(0);
+  }
+
+  return(estimate(hash));
+
+}
+
+void bnjr_traffic::top_table::swap(size_t i, size_t j) {
+  std::swap(counters[i], counters[j]);
+  index[counters[i].key] = i;
+  index[counters[j].key] = j;
+}
+
+void bnjr_traffic::top_table::sift_up(size_t i) {
+  while (i && (counters[i].count < counters[(i - 1) / 2].count)) {
+    swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+void bnjr_traffic::top_table::sift_down(size_t i) {
+  for (;;) {
+    size_t min = i;
+    size_t l = 2 * i + 1, r = 2 * i + 2;
+    if ((l < counters.size()) && (counters[l].count < counters[min].count)) min = l;
+    if ((r < counters.size()) && (counters[r].count < counters[min].count)) min = r;
+    if (min == i) return;
+    swap(i, min);
+    i = min;
+  }
+}
+
+double bnjr_traffic::per_minute(uint64_t n) const {
+  return((double)n * 60.0 / (double)spec_.window);
+}
+
+void bnjr_traffic::flag(const std::string& source, uint64_t recent, int64_t ts) {
+
+  double rate = per_minute(recent);
+  auto it = flags_.find(source);
+
+  if (it == flags_.end()) {
+    if (flags_.size() >= BNJR_TRAFFIC_MAX_FLAGS) {
+      auto oldest = flags_.begin();
+      for (auto f = flags_.begin(); f != flags_.end(); ++f) {
+        if (f->second.last_ns < oldest->second.last_ns) oldest = f;
+      }
+      flags_.erase(oldest);
+    }
+    bnjr_traffic_flag f = { source, ts, ts, rate, 0 };
+    it = flags_.insert(std::make_pair(source, f)).first;
+  }
+
+  bnjr_traffic_flag& f = it->second;
+  f.last_ns = std::max(f.last_ns, ts);
+  f.peak = std::max(f.peak, rate);
+  ++f.datagrams;
+
+}
+
+void bnjr_traffic::observe(const struct sockaddr* from, size_t addrlen, const void* data,
+                           size_t size, int64_t received_ns) {
+
+  std::string source = bnjr_address_key(from, addrlen);
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  advance(received_ns);
+
+  if (!totals_.first_ns || (received_ns < totals_.first_ns)) totals_.first_ns = received_ns;
+  if (received_ns > totals_.last_ns) totals_.last_ns = received_ns;
+
+  ++totals_.datagrams;
+  totals_.bytes += size;
+  ++slot_total_[slot_ % (int64_t)slots_];
+
+  uint64_t recent = count(BNJR_TRAFFIC_SOURCE, source);
+  if ((spec_.limit > 0) && (per_minute(recent) > spec_.limit)) flag(source, recent, received_ns);
+
+  const char* base = (const char*)data;
+
+  if (size < 12) {
+    ++totals_.malformed;
+    return;
+  }
+
+  if (mdns_load16(base + 2) & 0x8000) {
+    ++totals_.responses;
+    return;
+  }
+
+  ++totals_.queries;
+
+  // what the query asks for, one count per question
+  uint16_t questions = mdns_load16(base + 4);
+  size_t offset = 12;
+  char namebuffer[256];
+
+  for (uint16_t i = 0; i < questions; ++i) {
+    size_t name_offset = offset;
+    if (!mdns_string_skip(data, size, &offset) || (offset + 4 > size)) {
+      ++totals_.malformed;
+      return;
+    }
+    mdns_string_t name = mdns_string_extract(data, size, &name_offset, namebuffer,
+                                             sizeof(namebuffer));
+    count(BNJR_TRAFFIC_NAME, bnjr_name_key(name.str, name.length));
+    count(BNJR_TRAFFIC_RTYPE, rtype_key(mdns_load16(base + offset)));
+    offset += 4;
+  }
+
+}
+
+bnjr_traffic_report bnjr_traffic::report(int64_t now_ns) {
+
+  std::lock_guard<std::mutex> lock(m_);
+
+  if (now_ns && totals_.first_ns) advance(now_ns);
+
+  bnjr_traffic_report out = totals_;
+
+  out.recent = 0;
+  for (size_t s = 0; s < slots_; ++s) out.recent += slot_total_[s];
+
+  for (int kind = 0; kind < 3; ++kind) {
+
+    std::vector<counter> sorted = tables_[kind].counters;
+    std::sort(sorted.begin(), sorted.end(), [](const counter& a, const counter& b) {
+      return((a.count > b.count) || ((a.count == b.count) && (a.key < b.key)));
+    });
+    if (sorted.size() > spec_.top) sorted.resize(spec_.top);
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      bnjr_traffic_item item;
+      item.key = sorted[i].key;
+      item.count = sorted[i].count;
+      item.error = sorted[i].error;
+      item.recent = estimate(key_hash((bnjr_traffic_kind)kind, item.key));
+      out.top[kind].push_back(item);
+    }
+
+  }
+
+  for (auto it = flags_.begin(); it != flags_.end(); ++it) out.flagged.push_back(it->second);
+  std::sort(out.flagged.begin(), out.flagged.end(),
+            [](const bnjr_traffic_flag& a, const bnjr_traffic_flag& b) {
+              return(a.last_ns > b.last_ns);
+            });
+
+  return(out);
+
+}
+
+std::string bnjr_traffic_to_json(const bnjr_traffic_report& report,
+                                 const bnjr_traffic_spec& spec) {
+
+  static const char* kinds[3] = { "sources", "names", "rtypes" };
+
+  std::string out = "{ \"window\": " + std::to_string(spec.window) +
+    ", \"datagrams\": " + std::to_string(report.datagrams) +
+    ", \"bytes\": " + std::to_string(report.bytes) +
+    ", \"queries\": " + std::to_string(report.queries) +
+    ", \"responses\": " + std::to_string(report.responses) +
+    ", \"malformed\": " + std::to_string(report.malformed) +
+    ", \"recent\": " + std::to_string(report.recent) +
+    ", \"first\": " + std::to_string(report.first_ns) +
+    ", \"last\": " + std::to_string(report.last_ns);
+
+  char num[32];
+
+  for (int kind = 0; kind < 3; ++kind) {
+    out += ", \"";
+    out += kinds[kind];
+    out += "\": [ ";
+    for (size_t i = 0; i < report.top[kind].size(); ++i) {
+      const bnjr_traffic_item& item = report.top[kind][i];
+      if (i) out += ", ";
+      out += "{ \"key\": ";
+      bnjr_json_string(out, item.key);
+      out += ", \"count\": " + std::to_string(item.count) +
+        ", \"error\": " + std::to_string(item.error) +
+        ", \"recent\": " + std::to_string(item.recent) + " }";
+    }
+    out += " ]";
+  }
+
+  out += ", \"flagged\": [ ";
+  for (size_t i = 0; i < report.flagged.size(); ++i) {
+    const bnjr_traffic_flag& f = report.flagged[i];
+    if (i) out += ", ";
+    out += "{ \"source\": ";
+    bnjr_json_string(out, f.source);
+    snprintf(num, sizeof(num), "%.1f", f.peak);
+    out += ", \"first\": " + std::to_string(f.first_ns) +
+      ", \"last\": " + std::to_string(f.last_ns) +
+      ", \"peak\": " + num +
+      ", \"datagrams\": " + std::to_string(f.datagrams) + " }";
+  }
+  out += " ] }\n";
+
+  return(out);
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bonjour-record.h"
+
+// Passive traffic analytics: who is sending how much mDNS, and what they
+// ask for, in fixed memory however much traffic goes by.
+//
+// Every datagram is counted against its source address; every question in a
+// query against its name and its type. Two sketches keep the counts:
+//
+//   - a count-min sketch per time slot, slots making up a sliding window,
+//     answers "how many in the last window" for any key with a one-sided
+//     error of about e/width of the window's total;
+//   - a space-saving table per key kind keeps the heaviest keys since the
+//     start (top talkers), each count overestimated by at most its error.
+//
+// A source whose rate over the window goes past the limit is flagged, so a
+// device sending thousands of queries a minute stands out without a single
+// packet being kept.
+
+typedef struct {
+  int window;          // seconds rates are measured over
+  double limit;        // datagrams per minute from one source that flag it, 0 = never
+  size_t top;          // entries reported per table
+  size_t capacity;     // keys tracked per space-saving table (>= top)
+  size_t width;        // count-min counters per row
+  size_t depth;        // count-min rows
+} bnjr_traffic_spec;
+
+// Defaults: a 60 s window, 1000 datagrams/min, top 10 of 256 tracked keys,
+// a 4 x 4096 count-min sketch per slot.
+bnjr_traffic_spec bnjr_traffic_defaults();
+
+typedef enum {
+  BNJR_TRAFFIC_SOURCE = 0,   // sender address (no port or scope)
+  BNJR_TRAFFIC_NAME = 1,     // question name, lower-cased
+  BNJR_TRAFFIC_RTYPE = 2     // question type
+} bnjr_traffic_kind;
+
+typedef struct {
+  std::string key;
+  uint64_t count;      // since the start (space-saving: may overestimate...)
+  uint64_t error;      // ...by at most this much
+  uint64_t recent;     // in the last window (count-min estimate)
+} bnjr_traffic_item;
+
+typedef struct {
+  std::string source;
+  int64_t first_ns;    // when it first went over the limit
+  int64_t last_ns;     // and was last seen over it
+  double peak;         // highest rate seen, datagrams per minute
+  uint64_t datagrams;  // sent while over the limit
+} bnjr_traffic_flag;
+
+typedef struct {
+  uint64_t datagrams;
+  uint64_t bytes;
+  uint64_t queries;
+  uint64_t responses;
+  uint64_t malformed;  // too short for a DNS header, or questions cut short
+  uint64_t recent;     // datagrams in the last window
+  int64_t first_ns;    // first and last datagram seen, 0 = none yet
+  int64_t last_ns;
+  std::vector<bnjr_traffic_item> top[3];   // by bnjr_traffic_kind, heaviest first
+  std::vector<bnjr_traffic_flag> flagged;  // most recently flagged first
+} bnjr_traffic_report;
+
+// Safe to feed from several threads (one per receive worker).
+class bnjr_traffic {
+
+public:
+
+  explicit bnjr_traffic(const bnjr_traffic_spec& spec);
+
+  // Count one datagram heard at received_ns (ns since the epoch; captures
+  // pass their capture time, so a replayed capture gets its own rates).
+  void observe(const struct sockaddr* from, size_t addrlen, const void* data, size_t size,
+               int64_t received_ns);
+
+  // Counts so far; recent counts are for the window ending at now_ns (0 =
+  // the last datagram seen).
+  bnjr_traffic_report report(int64_t now_ns = 0);
+
+  const bnjr_traffic_spec& spec() const { return(spec_); }
+
+private:
+
+  static const size_t slots_ = 6;   // window granularity: window / slots
+
+  // space-saving top-K
+  struct counter {
+    std::string key;
+    uint64_t count;
+    uint64_t error;
+  };
+
+  // counters form a min-heap on count, with each key's position in it, so
+  // the counter to evict is always at the front: O(log capacity) a datagram
+  struct top_table {
+    std::vector<counter> counters;
+    std::unordered_map<std::string, size_t> index;
+    void sift_up(size_t i);
+    void sift_down(size_t i);
+    void swap(size_t i, size_t j);
+  };
+
+  uint64_t count(bnjr_traffic_kind kind, const std::string& key);
+  uint64_t estimate(uint64_t hash) const;
+  void advance(int64_t ts);
+  void flag(const std::string& source, uint64_t recent, int64_t ts);
+  double per_minute(uint64_t n) const;
+
+  bnjr_traffic_spec spec_;
+  int64_t slot_ns_;
+
+  std::mutex m_;
+  std::vector<uint32_t> sketch_;      // slots x depth x width
+  uint64_t slot_total_[slots_];
+  int64_t slot_;                      // absolute slot number of the newest one
+  top_table tables_[3];
+  std::unordered_map<std::string, bnjr_traffic_flag> flags_;
+  bnjr_traffic_report totals_;        // counters only; tables are built by report()
+
+};
+
+// The report as one JSON object (followed by a newline), for NDJSON streams.
+std::string bnjr_traffic_to_json(const bnjr_traffic_report& report,
+                                 const bnjr_traffic_spec& spec);
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "bonjour-filter.h"
+#include "bonjour-record.h"
+
+// Compile-time record dispatch: the header-only counterpart of
+// mdns_message_parse()/mdns_records_parse() and their 15-argument callback.
+//
+// A visitor derives from bnjr_visitor<Self> and overrides the handlers it
+// cares about:
+//
+//   bool accept(const bnjr_wire_record& r);   // false skips the record
+//   bool ptr(r), srv(r), a(r), aaaa(r), txt(r), other(r);
+//   bool record(r);                            // what the others default to
+//
+// Handlers return false to stop the walk. The loops below are instantiated
+// per visitor and call handlers directly (no function pointer, no void*),
+// so the per-rtype switch and any handler left at its default inline away:
+// a PTR-only visitor compiles down to a walk over the record headers. The
+// walk has the same bounds checks and name limits as mdns.h's parsers.
+
+// One resource record, in place in the message it came in.
+typedef struct {
+  const void* data;       // the whole message
+  size_t size;
+  mdns_entry_type_t entry;
+  uint16_t query_id;
+  uint16_t rtype;
+  uint16_t rclass;
+  uint32_t ttl;
+  size_t name_offset;     // owner name
+  size_t name_length;
+  size_t offset;          // rdata
+  size_t length;
+} bnjr_wire_record;
+
+template <class Self>
+class bnjr_visitor {
+
+public:
+
+  bool accept(const bnjr_wire_record&) { return(true); }
+
+  bool ptr(const bnjr_wire_record& r) { return(self().record(r)); }
+  bool srv(const bnjr_wire_record& r) { return(self().record(r)); }
+  bool a(const bnjr_wire_record& r) { return(self().record(r)); }
+  bool aaaa(const bnjr_wire_record& r) { return(self().record(r)); }
+  bool txt(const bnjr_wire_record& r) { return(self().record(r)); }
+  bool other(const bnjr_wire_record& r) { return(self().record(r)); }
+
+  bool record(const bnjr_wire_record&) { return(true); }
+
+protected:
+
+  Self& self() { return(*static_cast<Self*>(this)); }
+
+};
+
+template <class V>
+inline bool bnjr_visit_record(V& v, const bnjr_wire_record& r) {
+  if (!v.accept(r)) return(true);
+  switch (r.rtype) {
+  case MDNS_RECORDTYPE_PTR: return(v.ptr(r));
+  case MDNS_RECORDTYPE_SRV: return(v.srv(r));
+  case MDNS_RECORDTYPE_A: return(v.a(r));
+  case MDNS_RECORDTYPE_AAAA: return(v.aaaa(r));
+  case MDNS_RECORDTYPE_TXT: return(v.txt(r));
+  default: return(v.other(r));
+  }
+}
+
+// Walk count records starting at *offset (left just past the last one read).
+// Returns the number of records handed to the visitor; *stopped is set if a
+// handler asked to stop.
+template <class V>
+size_t bnjr_visit_records(V& v, const void* buffer, size_t size, size_t* offset,
+                          mdns_entry_type_t entry, uint16_t query_id, size_t count,
+                          bool* stopped) {
+
+  const char* base = (const char*)buffer;
+  size_t visited = 0;
+
+  bnjr_wire_record r;
+  r.data = buffer;
+  r.size = size;
+  r.entry = entry;
+  r.query_id = query_id;
+
+  for (size_t i = 0; (i < count) && !*stopped; ++i) {
+
+    r.name_offset = *offset;
+    if (!mdns_string_skip(buffer, size, offset) || ((*offset) + 10 > size)) break;
+    r.name_length = (*offset) - r.name_offset;
+
+    r.rtype = mdns_load16(base + *offset);
+    r.rclass = mdns_load16(base + *offset + 2);
+    r.ttl = mdns_load32(base + *offset + 4);
+    r.length = mdns_load16(base + *offset + 8);
+
+    *offset += 10;
+    if ((*offset) + r.length > size) break;
+    r.offset = *offset;
+
+    ++visited;
+    if (!bnjr_visit_record(v, r)) *stopped = true;
+
+    *offset += r.length;
+
+  }
+
+  return(visited);
+
+}
+
+// Every answer, authority and additional record of a message, like
+// mdns_message_parse(): only_query_id > 0 drops other ids, max_questions >= 0
+// drops messages asking more than that.
+template <class V>
+size_t bnjr_visit_message(V& v, const void* buffer, size_t size, int only_query_id,
+                          int max_questions) {
+
+  if (size < 12) return(0);
+
+  const char* base = (const char*)buffer;
+
+  uint16_t query_id = mdns_load16(base);
+  uint16_t questions = mdns_load16(base + 4);
+  uint16_t answer_rrs = mdns_load16(base + 6);
+  uint16_t authority_rrs = mdns_load16(base + 8);
+  uint16_t additional_rrs = mdns_load16(base + 10);
+
+  if ((only_query_id > 0) && (query_id != only_query_id)) return(0);
+  if ((max_questions >= 0) && (questions > max_questions)) return(0);
+
+  size_t offset = 12;
+  for (int i = 0; i < questions; ++i) {
+    if (!mdns_string_skip(buffer, size, &offset) || (offset + 4 > size)) return(0);
+    offset += 4;
+  }
+
+  bool stopped = false;
+  size_t visited = 0;
+  visited += bnjr_visit_records(v, buffer, size, &offset, MDNS_ENTRYTYPE_ANSWER, query_id,
+                                answer_rrs, &stopped);
+  visited += bnjr_visit_records(v, buffer, size, &offset, MDNS_ENTRYTYPE_AUTHORITY, query_id,
+                                authority_rrs, &stopped);
+  visited += bnjr_visit_records(v, buffer, size, &offset, MDNS_ENTRYTYPE_ADDITIONAL, query_id,
+                                additional_rrs, &stopped);
+
+  return(visited);
+
+}
+
+// A reply to the DNS-SD service enumeration question, checked the way
+// mdns_discovery_parse() does: id 0, an authoritative response, every
+// question and answer naming _services._dns-sd._udp.local. (other answers
+// are skipped), then the authority and additional records as they are.
+template <class V>
+size_t bnjr_visit_discovery(V& v, const void* buffer, size_t size) {
+
+  if (size < 12) return(0);
+
+  const char* base = (const char*)buffer;
+
+  uint16_t query_id = mdns_load16(base);
+  uint16_t flags = mdns_load16(base + 2);
+  uint16_t questions = mdns_load16(base + 4);
+  uint16_t answer_rrs = mdns_load16(base + 6);
+  uint16_t authority_rrs = mdns_load16(base + 8);
+  uint16_t additional_rrs = mdns_load16(base + 10);
+
+  if (query_id || (flags != 0x8400)) return(0);
+
+  size_t offset = 12;
+
+  for (int i = 0; i < questions; ++i) {
+    size_t verify_ofs = 12;
+    if (!mdns_string_equal(buffer, size, &offset, mdns_services_query,
+                           sizeof(mdns_services_query), &verify_ofs) ||
+        (offset + 4 > size))
+      return(0);
+    uint16_t rtype = mdns_load16(base + offset);
+    uint16_t rclass = mdns_load16(base + offset + 2);
+    if ((rtype != MDNS_RECORDTYPE_PTR) || ((rclass & 0x7FFF) != MDNS_CLASS_IN)) return(0);
+    offset += 4;
+  }
+
+  size_t visited = 0;
+  bool stopped = false;
+
+  bnjr_wire_record r;
+  r.data = buffer;
+  r.size = size;
+  r.entry = MDNS_ENTRYTYPE_ANSWER;
+  r.query_id = query_id;
+
+  for (int i = 0; i < answer_rrs; ++i) {
+    size_t verify_ofs = 12;
+    r.name_offset = offset;
+    bool is_answer = mdns_string_equal(buffer, size, &offset, mdns_services_query,
+                                       sizeof(mdns_services_query), &verify_ofs);
+    // a mismatch leaves the offset on the name (mdns_discovery_parse() then
+    // reads the name as the record header)
+    if (!is_answer && !mdns_string_skip(buffer, size, &offset)) return(visited);
+    r.name_length = offset - r.name_offset;
+    if (offset + 10 > size) return(visited);
+    r.rtype = mdns_load16(base + offset);
+    r.rclass = mdns_load16(base + offset + 2);
+    r.ttl = mdns_load32(base + offset + 4);
+    r.length = mdns_load16(base + offset + 8);
+    offset += 10;
+    if (r.length > size - offset) return(visited);
+    r.offset = offset;
+    if (is_answer && !stopped) {
+      ++visited;
+      if (!bnjr_visit_record(v, r)) stopped = true;
+    }
+    offset += r.length;
+  }
+
+  visited += bnjr_visit_records(v, buffer, size, &offset, MDNS_ENTRYTYPE_AUTHORITY, query_id,
+                                authority_rrs, &stopped);
+  visited += bnjr_visit_records(v, buffer, size, &offset, MDNS_ENTRYTYPE_ADDITIONAL, query_id,
+                                additional_rrs, &stopped);
+
+  return(visited);
+
+}
+
+// The visitor the decoders use: builds a bnjr_record for every record the
+// filter accepts (bnjr_decoder doing the per-rtype work) and hands it to
+// sink(rec), which may move from it. Filter needs the bnjr_filter::accept()
+// signature; a null filter accepts everything.
+template <class Sink, class Filter = bnjr_filter>
+class bnjr_record_builder : public bnjr_visitor<bnjr_record_builder<Sink, Filter>> {
+
+public:
+
+  bnjr_record_builder(bnjr_decoder& decoder, Sink& sink, const Filter* filter = 0) :
+    decoder_(decoder), sink_(sink), filter_(filter), from_(0), addrlen_(0) {}
+
+  // the sender of the datagram about to be visited
+  void source(const struct sockaddr* from, size_t addrlen) {
+    from_ = from;
+    addrlen_ = addrlen;
+  }
+
+  bool accept(const bnjr_wire_record& r) {
+    return(!filter_ || filter_->accept(from_, r.entry, r.rtype, r.data, r.size, r.name_offset));
+  }
+
+  bool ptr(const bnjr_wire_record& r) {
+    decoder_.ptr(r.data, r.size, r.offset, r.length, start(r));
+    return(finish());
+  }
+
+  bool srv(const bnjr_wire_record& r) {
+    decoder_.srv(r.data, r.size, r.offset, r.length, start(r));
+    return(finish());
+  }
+
+  bool a(const bnjr_wire_record& r) {
+    decoder_.a(r.data, r.size, r.offset, r.length, start(r));
+    return(finish());
+  }
+
+  bool aaaa(const bnjr_wire_record& r) {
+    decoder_.aaaa(r.data, r.size, r.offset, r.length, start(r));
+    return(finish());
+  }
+
+  bool txt(const bnjr_wire_record& r) {
+    decoder_.txt(r.data, r.size, r.offset, r.length, start(r));
+    return(finish());
+  }
+
+  bool other(const bnjr_wire_record& r) {
+    start(r);
+    return(finish());
+  }
+
+private:
+
+  bnjr_record& start(const bnjr_wire_record& r) {
+    decoder_.begin(from_, addrlen_, r.entry, r.rtype, r.rclass, r.ttl, r.data, r.size,
+                   r.name_offset, r.length, rec_);
+    return(rec_);
+  }
+
+  bool finish() {
+    sink_(rec_);
+    return(true);
+  }
+
+  bnjr_decoder& decoder_;
+  Sink& sink_;
+  const Filter* filter_;
+  const struct sockaddr* from_;
+  size_t addrlen_;
+  bnjr_record rec_;
+
+};
@@ -44,6 +44,11 @@ extern "C" {
 #define MDNS_POINTER_DIFF(a, b) ((size_t)((const char*)(a) - (const char*)(b)))
 
 #define MDNS_PORT 5353
+
+// Limits on walking a (possibly compressed) name, so that a hostile packet
+// can't make a pointer loop or chain cost more than a real name does.
+#define MDNS_MAX_NAME_HOPS 16
+#define MDNS_MAX_LABELS 128
 #define MDNS_UNICAST_RESPONSE 0x8000U
 #define MDNS_CACHE_FLUSH 0x8000U
 
@@ -58,7 +63,9 @@ extern "C" {
     // IP6 Address [Thomson]
     MDNS_RECORDTYPE_AAAA = 28,
     // Server Selection [RFC2782]
-    MDNS_RECORDTYPE_SRV = 33
+    MDNS_RECORDTYPE_SRV = 33,
+    // Any available records
+    MDNS_RECORDTYPE_ANY = 255
   };
 
   enum mdns_entry_type {
@@ -179,6 +186,12 @@ extern "C" {
     mdns_discovery_recv(int sock, void* buffer, size_t capacity, mdns_record_callback_fn callback,
                         void* user_data);
 
+  //! Parse a response to mdns_discovery_send that has already been received (see
+  //  mdns_discovery_recv). Returns the number of records parsed.
+  static size_t
+    mdns_discovery_parse(int sock, const struct sockaddr* from, size_t addrlen, const void* buffer,
+                         size_t size, mdns_record_callback_fn callback, void* user_data);
+
   //! Send a unicast DNS-SD answer with a single record to the given address. Returns 0 if success,
   //  or <0 if error.
   static int
@@ -203,6 +216,16 @@ extern "C" {
     mdns_query_recv(int sock, void* buffer, size_t capacity, mdns_record_callback_fn callback,
                     void* user_data, int query_id);
 
+  //! Parse every resource record of an mDNS message that is already in memory (a datagram read
+  //  elsewhere, or a payload sliced out of a capture). Questions are skipped. Set only_query_id to
+  //  ignore messages with a different query ID and max_questions to ignore messages with more
+  //  questions than that (<0 for no limit). Any data will be piped to the given callback for
+  //  parsing. Returns the number of records parsed.
+  static size_t
+    mdns_message_parse(int sock, const struct sockaddr* from, size_t addrlen, const void* buffer,
+                       size_t size, mdns_record_callback_fn callback, void* user_data,
+                       int only_query_id, int max_questions);
+
   //! Send a unicast or multicast mDNS query answer with a single record to the given address. The
   //  answer will be sent multicast if address size is 0, otherwise it will be sent unicast to the
   //  given address. Use the top bit of the query class field (MDNS_UNICAST_RESPONSE) to determine
@@ -352,6 +375,8 @@ extern "C" {
       req.ipv6mr_multiaddr.s6_addr[0] = 0xFF;
       req.ipv6mr_multiaddr.s6_addr[1] = 0x02;
       req.ipv6mr_multiaddr.s6_addr[15] = 0xFB;
+      if (saddr)
+        req.ipv6mr_interface = saddr->sin6_scope_id;
       if (setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, (char*)&req, sizeof(req)))
         return -1;
 
@@ -365,10 +390,12 @@ extern "C" {
         saddr->sin6_len = sizeof(struct sockaddr_in6);
 #endif
       } else {
-        unsigned int ifindex = 0;
+        // Interface index to send from is passed in the scope id (0 = default)
+        unsigned int ifindex = saddr->sin6_scope_id;
         setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (const char*)&ifindex, sizeof(ifindex));
 #ifndef _WIN32
         saddr->sin6_addr = in6addr_any;
+        saddr->sin6_scope_id = 0;
 #endif
       }
 
@@ -400,25 +427,49 @@ extern "C" {
       return (0xC0 == (val & 0xC0));
     }
 
+  // Network-order loads from any offset; messages come with no alignment
+  // guarantees (captures, records after odd-length names); memcpy compiles
+  // to a plain load where unaligned access is allowed.
+  static uint16_t
+    mdns_load16(const void* p) {
+      uint16_t v;
+      memcpy(&v, p, sizeof(v));
+      return ntohs(v);
+    }
+
+  static uint32_t
+    mdns_load32(const void* p) {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return ntohl(v);
+    }
+
   static mdns_string_pair_t
     mdns_get_next_substring(const void* rawdata, size_t size, size_t offset) {
       const uint8_t* buffer = (const uint8_t*)rawdata;
       mdns_string_pair_t pair = {MDNS_INVALID_POS, 0, 0};
+      if (offset >= size)
+        return pair;
       if (!buffer[offset]) {
         pair.offset = offset;
         return pair;
       }
-      if (mdns_is_string_ref(buffer[offset])) {
-        if (size < offset + 2)
+      int hops = 0;
+      while (mdns_is_string_ref(buffer[offset])) {
+        if ((size < offset + 2) || (++hops > MDNS_MAX_NAME_HOPS))
           return pair;
 
-        offset = 0x3fff & ntohs(*(uint16_t*)MDNS_POINTER_OFFSET(buffer, offset));
+        offset = 0x3fff & mdns_load16(buffer + offset);
         if (offset >= size)
           return pair;
 
         pair.ref = 1;
       }
 
+      // label types 0x40 and 0x80 aren't in use
+      if (buffer[offset] & 0xC0)
+        return pair;
+
       size_t length = (size_t)buffer[offset++];
       if (size < offset + length)
         return pair;
@@ -429,23 +480,30 @@ extern "C" {
       return pair;
     }
 
+  // Steps over a name without following its compression pointer (a skip only
+  // moves forward, so it needs no hop limit); where the pointer leads is
+  // checked when the name is read.
   static int
     mdns_string_skip(const void* buffer, size_t size, size_t* offset) {
+      const uint8_t* data = (const uint8_t*)buffer;
       size_t cur = *offset;
-      mdns_string_pair_t substr;
-      do {
-        substr = mdns_get_next_substring(buffer, size, cur);
-        if (substr.offset == MDNS_INVALID_POS)
-          return 0;
-        if (substr.ref) {
+      while (cur < size) {
+        uint8_t length = data[cur];
+        if (mdns_is_string_ref(length)) {
+          if ((size < cur + 2) || ((0x3fff & mdns_load16(data + cur)) >= size))
+            return 0;
           *offset = cur + 2;
           return 1;
         }
-        cur = substr.offset + substr.length;
-      } while (substr.length);
-
-      *offset = cur + 1;
-      return 1;
+        if (length & 0xC0)
+          return 0;
+        if (!length) {
+          *offset = cur + 1;
+          return 1;
+        }
+        cur += 1 + (size_t)length;
+      }
+      return 0;
     }
 
   static int
@@ -457,7 +515,10 @@ extern "C" {
       size_t rhs_end = MDNS_INVALID_POS;
       mdns_string_pair_t lhs_substr;
       mdns_string_pair_t rhs_substr;
+      int labels = 0;
       do {
+        if (++labels > MDNS_MAX_LABELS)
+          return 0;
         lhs_substr = mdns_get_next_substring(buffer_lhs, size_lhs, lhs_cur);
         rhs_substr = mdns_get_next_substring(buffer_rhs, size_rhs, rhs_cur);
         if ((lhs_substr.offset == MDNS_INVALID_POS) || (rhs_substr.offset == MDNS_INVALID_POS))
@@ -496,7 +557,10 @@ extern "C" {
       result.length = 0;
       char* dst = str;
       size_t remain = capacity;
+      int labels = 0;
       do {
+        if (++labels > MDNS_MAX_LABELS)
+          return result;
         substr = mdns_get_next_substring(buffer, size, cur);
         if (substr.offset == MDNS_INVALID_POS)
           return result;
@@ -597,17 +661,19 @@ extern "C" {
       int do_callback = (callback ? 1 : 0);
       for (size_t i = 0; i < records; ++i) {
         size_t name_offset = *offset;
-        mdns_string_skip(buffer, size, offset);
+        if (!mdns_string_skip(buffer, size, offset) || ((*offset) + 10 > size))
+          break;
         size_t name_length = (*offset) - name_offset;
-        const uint16_t* data = (const uint16_t*)((const char*)buffer + (*offset));
+        const uint8_t* data = (const uint8_t*)buffer + (*offset);
 
-        uint16_t rtype = ntohs(*data++);
-        uint16_t rclass = ntohs(*data++);
-        uint32_t ttl = ntohl(*(const uint32_t*)(const void*)data);
-        data += 2;
-        uint16_t length = ntohs(*data++);
+        uint16_t rtype = mdns_load16(data);
+        uint16_t rclass = mdns_load16(data + 2);
+        uint32_t ttl = mdns_load32(data + 4);
+        uint16_t length = mdns_load16(data + 8);
 
         *offset += 10;
+        if ((*offset) + length > size)
+          break;
 
         if (do_callback) {
           ++parsed;
@@ -704,16 +770,24 @@ extern "C" {
       if (ret <= 0)
         return 0;
 
-      size_t data_size = (size_t)ret;
+      return mdns_discovery_parse(sock, saddr, addrlen, buffer, (size_t)ret, callback, user_data);
+    }
+
+  static size_t
+    mdns_discovery_parse(int sock, const struct sockaddr* saddr, size_t addrlen, const void* buffer,
+                         size_t data_size, mdns_record_callback_fn callback, void* user_data) {
+      if (data_size < sizeof(struct mdns_header_t))
+        return 0;
+
       size_t records = 0;
-      uint16_t* data = (uint16_t*)buffer;
+      const uint8_t* data = (const uint8_t*)buffer;
 
-      uint16_t query_id = ntohs(*data++);
-      uint16_t flags = ntohs(*data++);
-      uint16_t questions = ntohs(*data++);
-      uint16_t answer_rrs = ntohs(*data++);
-      uint16_t authority_rrs = ntohs(*data++);
-      uint16_t additional_rrs = ntohs(*data++);
+      uint16_t query_id = mdns_load16(data);
+      uint16_t flags = mdns_load16(data + 2);
+      uint16_t questions = mdns_load16(data + 4);
+      uint16_t answer_rrs = mdns_load16(data + 6);
+      uint16_t authority_rrs = mdns_load16(data + 8);
+      uint16_t additional_rrs = mdns_load16(data + 10);
 
       // According to RFC 6762 the query ID MUST match the sent query ID (which is 0 in our case)
       if (query_id || (flags != 0x8400))
@@ -726,18 +800,19 @@ extern "C" {
        return 0;
        */
 
+      size_t ofs = sizeof(struct mdns_header_t);
       int i;
       for (i = 0; i < questions; ++i) {
-        size_t ofs = (size_t)((char*)data - (char*)buffer);
         size_t verify_ofs = 12;
         // Verify it's our question, _services._dns-sd._udp.local.
         if (!mdns_string_equal(buffer, data_size, &ofs, mdns_services_query,
-                               sizeof(mdns_services_query), &verify_ofs))
+                               sizeof(mdns_services_query), &verify_ofs) ||
+            (ofs + 4 > data_size))
           return 0;
-        data = (uint16_t*)((char*)buffer + ofs);
 
-        uint16_t rtype = ntohs(*data++);
-        uint16_t rclass = ntohs(*data++);
+        uint16_t rtype = mdns_load16(data + ofs);
+        uint16_t rclass = mdns_load16(data + ofs + 2);
+        ofs += 4;
 
         // Make sure we get a reply based on our PTR question for class IN
         if ((rtype != MDNS_RECORDTYPE_PTR) || ((rclass & 0x7FFF) != MDNS_CLASS_IN))
@@ -746,34 +821,36 @@ extern "C" {
 
       int do_callback = 1;
       for (i = 0; i < answer_rrs; ++i) {
-        size_t ofs = (size_t)((char*)data - (char*)buffer);
         size_t verify_ofs = 12;
         // Verify it's an answer to our question, _services._dns-sd._udp.local.
         size_t name_offset = ofs;
         int is_answer = mdns_string_equal(buffer, data_size, &ofs, mdns_services_query,
                                           sizeof(mdns_services_query), &verify_ofs);
+        // a name that doesn't match is left unread
+        if (!is_answer && !mdns_string_skip(buffer, data_size, &ofs))
+          return records;
         size_t name_length = ofs - name_offset;
-        data = (uint16_t*)((char*)buffer + ofs);
-
-        uint16_t rtype = ntohs(*data++);
-        uint16_t rclass = ntohs(*data++);
-        uint32_t ttl = ntohl(*(uint32_t*)(void*)data);
-        data += 2;
-        uint16_t length = ntohs(*data++);
-        if (length >= (data_size - ofs))
-          return 0;
+        if (ofs + 10 > data_size)
+          return records;
+
+        uint16_t rtype = mdns_load16(data + ofs);
+        uint16_t rclass = mdns_load16(data + ofs + 2);
+        uint32_t ttl = mdns_load32(data + ofs + 4);
+        uint16_t length = mdns_load16(data + ofs + 8);
+        ofs += 10;
+        if (length > (data_size - ofs))
+          return records;
 
         if (is_answer && do_callback) {
           ++records;
-          ofs = (size_t)((char*)data - (char*)buffer);
           if (callback(sock, saddr, addrlen, MDNS_ENTRYTYPE_ANSWER, query_id, rtype, rclass, ttl,
                        buffer, data_size, name_offset, name_length, ofs, length, user_data))
             do_callback = 0;
         }
-        data = (uint16_t*)((char*)data + length);
+        ofs += length;
       }
 
-      size_t offset = (size_t)((char*)data - (char*)buffer);
+      size_t offset = ofs;
       records +=
         mdns_records_parse(sock, saddr, addrlen, buffer, data_size, &offset,
                            MDNS_ENTRYTYPE_AUTHORITY, query_id, authority_rrs, callback, user_data);
@@ -799,22 +876,19 @@ extern "C" {
         return 0;
 
       size_t data_size = (size_t)ret;
-      uint16_t* data = (uint16_t*)buffer;
+      if (data_size < sizeof(struct mdns_header_t))
+        return 0;
 
-      uint16_t query_id = ntohs(*data++);
-      uint16_t flags = ntohs(*data++);
-      uint16_t questions = ntohs(*data++);
-      /*
-       This data is unused at the moment, skip
-       uint16_t answer_rrs = ntohs(*data++);
-       uint16_t authority_rrs = ntohs(*data++);
-       uint16_t additional_rrs = ntohs(*data++);
-       */
-      data += 3;
+      const uint8_t* data = (const uint8_t*)buffer;
+
+      uint16_t query_id = mdns_load16(data);
+      uint16_t flags = mdns_load16(data + 2);
+      uint16_t questions = mdns_load16(data + 4);
+      // answer, authority and additional counts are unused at the moment
 
       size_t parsed = 0;
+      size_t question_offset = sizeof(struct mdns_header_t);
       for (int iquestion = 0; iquestion < questions; ++iquestion) {
-        size_t question_offset = (size_t)((char*)data - (char*)buffer);
         size_t offset = question_offset;
         size_t verify_ofs = 12;
         if (mdns_string_equal(buffer, data_size, &offset, mdns_services_query,
@@ -827,10 +901,11 @@ extern "C" {
             break;
         }
         size_t length = offset - question_offset;
-        data = (uint16_t*)((char*)buffer + offset);
+        if (offset + 4 > data_size)
+          break;
 
-        uint16_t rtype = ntohs(*data++);
-        uint16_t rclass = ntohs(*data++);
+        uint16_t rtype = mdns_load16(data + offset);
+        uint16_t rclass = mdns_load16(data + offset + 2);
 
         // Make sure we get a question of class IN
         if ((rclass & 0x7FFF) != MDNS_CLASS_IN)
@@ -842,6 +917,7 @@ extern "C" {
                    user_data);
 
         ++parsed;
+        question_offset = offset + 4;
       }
 
       return parsed;
@@ -947,44 +1023,47 @@ extern "C" {
       if (ret <= 0)
         return 0;
 
-      size_t data_size = (size_t)ret;
-      uint16_t* data = (uint16_t*)buffer;
+      return mdns_message_parse(sock, saddr, addrlen, buffer, (size_t)ret, callback, user_data,
+                                only_query_id, 1);
+    }
 
-      uint16_t query_id = ntohs(*data++);
-      uint16_t flags = ntohs(*data++);
-      uint16_t questions = ntohs(*data++);
-      uint16_t answer_rrs = ntohs(*data++);
-      uint16_t authority_rrs = ntohs(*data++);
-      uint16_t additional_rrs = ntohs(*data++);
-      (void)sizeof(flags);
+  static size_t
+    mdns_message_parse(int sock, const struct sockaddr* from, size_t addrlen, const void* buffer,
+                       size_t size, mdns_record_callback_fn callback, void* user_data,
+                       int only_query_id, int max_questions) {
+      if (size < sizeof(struct mdns_header_t))
+        return 0;
+
+      const uint8_t* data = (const uint8_t*)buffer;
+
+      uint16_t query_id = mdns_load16(data);
+      uint16_t questions = mdns_load16(data + 4);
+      uint16_t answer_rrs = mdns_load16(data + 6);
+      uint16_t authority_rrs = mdns_load16(data + 8);
+      uint16_t additional_rrs = mdns_load16(data + 10);
 
       if ((only_query_id > 0) && (query_id != only_query_id))
         return 0;  // Not a reply to the wanted one-shot query
 
-      if (questions > 1)
+      if ((max_questions >= 0) && (questions > max_questions))
         return 0;
 
       // Skip questions part
+      size_t offset = sizeof(struct mdns_header_t);
       int i;
       for (i = 0; i < questions; ++i) {
-        size_t ofs = (size_t)((char*)data - (char*)buffer);
-        if (!mdns_string_skip(buffer, data_size, &ofs))
+        if (!mdns_string_skip(buffer, size, &offset) || (offset + 4 > size))
           return 0;
-        data = (uint16_t*)((char*)buffer + ofs);
-        uint16_t rtype = ntohs(*data++);
-        uint16_t rclass = ntohs(*data++);
-        (void)sizeof(rtype);
-        (void)sizeof(rclass);
+        offset += 4;  // type and class
       }
 
       size_t records = 0;
-      size_t offset = MDNS_POINTER_DIFF(data, buffer);
-      records += mdns_records_parse(sock, saddr, addrlen, buffer, data_size, &offset,
+      records += mdns_records_parse(sock, from, addrlen, buffer, size, &offset,
                                     MDNS_ENTRYTYPE_ANSWER, query_id, answer_rrs, callback, user_data);
       records +=
-        mdns_records_parse(sock, saddr, addrlen, buffer, data_size, &offset,
+        mdns_records_parse(sock, from, addrlen, buffer, size, &offset,
                            MDNS_ENTRYTYPE_AUTHORITY, query_id, authority_rrs, callback, user_data);
-      records += mdns_records_parse(sock, saddr, addrlen, buffer, data_size, &offset,
+      records += mdns_records_parse(sock, from, addrlen, buffer, size, &offset,
                                     MDNS_ENTRYTYPE_ADDITIONAL, query_id, additional_rrs, callback,
                                     user_data);
       return records;
@@ -1175,10 +1254,10 @@ extern "C" {
       // 2 bytes network-order unsigned port
       // string: discovery (domain) name, minimum 2 bytes when compressed
       if ((size >= offset + length) && (length >= 8)) {
-        const uint16_t* recorddata = (const uint16_t*)((const char*)buffer + offset);
-        srv.priority = ntohs(*recorddata++);
-        srv.weight = ntohs(*recorddata++);
-        srv.port = ntohs(*recorddata++);
+        const uint8_t* recorddata = (const uint8_t*)buffer + offset;
+        srv.priority = mdns_load16(recorddata);
+        srv.weight = mdns_load16(recorddata + 2);
+        srv.port = mdns_load16(recorddata + 4);
         offset += 6;
         srv.name = mdns_string_extract(buffer, size, &offset, strbuffer, capacity);
       }
@@ -1194,7 +1273,7 @@ extern "C" {
       addr->sin_len = sizeof(struct sockaddr_in);
 #endif
       if ((size >= offset + length) && (length == 4))
-        addr->sin_addr.s_addr = *(const uint32_t*)((const char*)buffer + offset);
+        memcpy(&addr->sin_addr.s_addr, (const char*)buffer + offset, 4);
       return addr;
     }
 
@@ -1207,7 +1286,7 @@ extern "C" {
       addr->sin6_len = sizeof(struct sockaddr_in6);
 #endif
       if ((size >= offset + length) && (length == 16))
-        addr->sin6_addr = *(const struct in6_addr*)((const char*)buffer + offset);
+        memcpy(&addr->sin6_addr, (const char*)buffer + offset, 16);
       return addr;
     }
 
@@ -1226,6 +1305,10 @@ extern "C" {
         strdata = (const char*)buffer + offset;
         sublength = *(const unsigned char*)strdata;
 
+        // a string running past the record is cut off, not read beyond
+        if (sublength > end - offset - 1)
+          break;
+
         ++strdata;
         offset += sublength + 1;
 
@@ -0,0 +1,241 @@
+// bonjour-scan: the package's mDNS engine (src/core) as a command-line
+// scanner, for collectors and appliances without R and for profiling the
+// hot path with perf and friends.
+//
+//   bonjour-scan [options] [service ...]
+//
+// With no services it browses (DNS-SD service enumeration); otherwise every
+// service given is queried, side by side. With -L it asks nothing and counts
+// everyone's traffic instead (see below). Records go to stdout as NDJSON, one
+// object per line (the same lines the package writes) as they arrive, or
+// with -b as cache file images (bnjr_cache_decode()), one per scan window.
+// Each image is self-delimiting: its header carries the entry count and
+// string table size.
+//
+// SIGINT/SIGTERM end the current window early (what came in so far is still
+// written) and then the run; a second one kills.
+//
+//   -t SECONDS   scan window (default 10)
+//   -c           keep scanning, one window after another, until interrupted
+//   -b           binary output (cache images) instead of NDJSON
+//   -r TYPE      only records of this type (PTR, SRV, TXT, A, AAAA, ... or a
+//                number); repeatable
+//   -n NAME      only owner names ending in / matching NAME; repeatable
+//   -i IFACE     only these interfaces (name, glob, index or CIDR); repeatable
+//   -x IFACE     never these interfaces; repeatable
+//   -4, -6       one address family only
+//   -S           one socket per address family (IP_PKTINFO) instead of one
+//                per interface address
+//   -w FILE      also record every datagram received to a pcapng file
+//   -N NETNS     scan in this Linux network namespace (a path, or a name from
+//                `ip netns`; "" is our own) instead of ours; repeatable, all
+//                of them at once. NDJSON lines say which one ("netns"); cache
+//                images can't, so -b only carries records from our own.
+//   -L           passive analytics: listen on the mDNS port and write one
+//                JSON report per scan window (datagram counts, top sources,
+//                names and types, sources over the limit); with -c the
+//                counts carry on from window to window
+//   -W SECONDS   with -L, the sliding window rates are measured over (60)
+//   -l RATE      with -L, datagrams per minute that flag a source (1000)
+//
+// Warnings go to stderr; the exit status is 1 if a scan fails outright.
+//
+// Build from this directory with `make` (tools/Makefile), which compiles
+// ../src/core into build/libbonjour.a and links against it.
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "bonjour-scan.h"
+
+// the scans' stop flag; lock-free, so safe to set from a signal handler
+static std::atomic<bool>* stop_flag = 0;
+
+static void on_signal(int) {
+  if (stop_flag) stop_flag->store(true);
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bonjour-scan [-t seconds] [-c] [-b] [-r type] [-n name] [-i iface] [-x iface]\n"
+          "                    [-4|-6] [-S] [-w file.pcapng] [-N netns] [service ...]\n"
+          "       bonjour-scan -L [-W window] [-l rate] [-t seconds] [-c] [-i iface] ...\n");
+  exit(2);
+}
+
+static bool parse_rtype(const char* s, uint16_t& rtype) {
+
+  static const struct { const char* name; uint16_t code; } types[] = {
+    { "A", 1 }, { "NS", 2 }, { "CNAME", 5 }, { "PTR", 12 }, { "HINFO", 13 }, { "TXT", 16 },
+    { "AAAA", 28 }, { "SRV", 33 }, { "NSEC", 47 }, { "ANY", 255 }
+  };
+
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+    if (!strcasecmp(s, types[i].name)) {
+      rtype = types[i].code;
+      return(true);
+    }
+  }
+
+  char* end;
+  long code = strtol(s, &end, 10);
+  if (*s && !*end && (code > 0) && (code < 65536)) {
+    rtype = (uint16_t)code;
+    return(true);
+  }
+
+  return(false);
+
+}
+
+static void fail(const std::string& err) {
+  fprintf(stderr, "bonjour-scan: %s\n", err.c_str());
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+
+  bnjr_scan_spec spec;
+
+  bool continuous = false;
+  bool binary = false;
+  bool listen = false;
+  bnjr_traffic_spec traffic = bnjr_traffic_defaults();
+  std::string pcap;
+  std::vector<std::string> netns;
+  std::string err;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:cbr:n:i:x:46Sw:N:LW:l:h")) != -1) {
+    switch (opt) {
+    case 't':
+      spec.scan_time = atoi(optarg);
+      if (spec.scan_time <= 0) fail("scan time must be a positive number of seconds");
+      break;
+    case 'c': continuous = true; break;
+    case 'b': binary = true; break;
+    case 'r': {
+      uint16_t rtype;
+      if (!parse_rtype(optarg, rtype)) fail(std::string("unknown record type '") + optarg + "'");
+      spec.filter.add_rtype(rtype);
+      break;
+    }
+    case 'n': if (!spec.filter.add_name(optarg, err)) fail(err); break;
+    case 'i': if (!spec.interfaces.allow(optarg, err)) fail(err); break;
+    case 'x': if (!spec.interfaces.deny(optarg, err)) fail(err); break;
+    case '4': spec.interfaces.family = BNJR_FAMILY_IPV4; break;
+    case '6': spec.interfaces.family = BNJR_FAMILY_IPV6; break;
+    case 'S': spec.sockets = BNJR_SOCKETS_FAMILY; break;
+    case 'w': pcap = optarg; break;
+    case 'N': netns.push_back(optarg); break;
+    case 'L': listen = true; break;
+    case 'W':
+      traffic.window = atoi(optarg);
+      if (traffic.window <= 0) fail("window must be a positive number of seconds");
+      break;
+    case 'l':
+      traffic.limit = atof(optarg);
+      if (traffic.limit < 0) fail("rate limit can't be negative");
+      break;
+    default: usage();
+    }
+  }
+
+  if (pcap.size()) {
+    spec.recorder = std::make_shared<bnjr_recorder>();
+    if (!spec.recorder->open(pcap, err)) fail(err);
+  }
+
+  if (listen && (optind < argc)) fail("-L listens; it takes no services");
+  if (listen) spec.traffic = std::make_shared<bnjr_traffic>(traffic);
+
+  if (netns.empty()) netns.push_back("");
+
+  spec.stop = std::make_shared<std::atomic<bool>>(false);
+  stop_flag = spec.stop.get();
+
+  // NDJSON lines go out as the scans hear them; a reader that went away
+  // ends the run
+  std::mutex out_m;
+  bool broken = false;
+  bool stream = !listen && !binary;
+
+  if (stream) {
+    spec.on_record = [&](const bnjr_record& rec) {
+      std::string line;
+      bnjr_record_to_json(rec, line);
+      std::lock_guard<std::mutex> lock(out_m);
+      if (broken) return;
+      if ((fwrite(line.data(), 1, line.size(), stdout) != line.size()) || fflush(stdout)) {
+        broken = true;
+        spec.stop->store(true);
+      }
+    };
+  }
+
+  // one scan per service (or the browse) per namespace
+  std::vector<bnjr_scan_spec> specs;
+  spec.mode = listen ? BNJR_SCAN_LISTEN :
+    ((optind == argc) ? BNJR_SCAN_DISCOVER : BNJR_SCAN_QUERY);
+  for (int i = optind; i < std::max(argc, optind + 1); ++i) {
+    for (size_t j = 0; j < netns.size(); ++j) {
+      specs.push_back(spec);
+      if (i < argc) specs.back().query = argv[i];
+      specs.back().netns = netns[j];
+    }
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sa.sa_flags = SA_RESETHAND;
+  sigaction(SIGINT, &sa, 0);
+  sigaction(SIGTERM, &sa, 0);
+  signal(SIGPIPE, SIG_IGN);
+
+  int status = 0;
+
+  do {
+
+    std::vector<bnjr_scan_result> results;
+    bnjr_scan_all(specs, results);
+
+    if (broken) break;
+
+    std::vector<bnjr_record> records;
+    for (size_t i = 0; i < results.size(); ++i) {
+      for (size_t w = 0; w < results[i].warnings.size(); ++w)
+        fprintf(stderr, "bonjour-scan: %s\n", results[i].warnings[w].c_str());
+      if (results[i].error.size()) {
+        fprintf(stderr, "bonjour-scan: %s\n", results[i].error.c_str());
+        status = 1;
+      }
+      records.insert(records.end(), results[i].records.begin(), results[i].records.end());
+    }
+
+    std::string out;
+    if (spec.traffic) {
+      out = bnjr_traffic_to_json(spec.traffic->report(bnjr_wall_ns()), spec.traffic->spec());
+    } else if (binary) {
+      out = bnjr_cache_encode(records, bnjr_cache::now_ms());
+    }
+
+    if (out.size() && ((fwrite(out.data(), 1, out.size(), stdout) != out.size()) || fflush(stdout)))
+      break;
+
+  } while (continuous && !spec.stop->load() && !status);
+
+  if (spec.recorder) spec.recorder->close();
+
+  return(status);
+
+}